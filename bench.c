@@ -0,0 +1,625 @@
+/*
+ * sam-bench: time the allocation code, the budgeters, sam_allocate() for
+ * each variant and nupoco_allocate() for each of its phases, across machine
+ * shapes (made with make_cpuinfo()) and numbers of applications, and count
+ * the heap allocations each call makes.
+ *
+ * The applications are synthetic, like sam-sim's: each window they get
+ * fresh counters, the policy allocates for them and the result is applied
+ * as samd applies it, so that the policies run on the state they would have
+ * in a daemon that has been up for a while. Only the calls themselves are
+ * timed. SAM needs sam_min_contexts CPUs for every application and aborts
+ * otherwise, so those cases are skipped.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "budgets.h"
+#include "cpuinfo.h"
+#include "log.h"
+#include "mapper.h"
+#include "tunables.h"
+#include "util.h"
+#include "schedulers/nupoco.h"
+#include "schedulers/policy.h"
+
+#define DEFAULT_TOPOLOGIES  "2x20,2x48,4x32,8x64,16x64"
+#define DEFAULT_APPS        "2,10,50,100,500,1000"
+/* windows run before timing, to get past SAM's initial allocations */
+#define WARMUP_WINDOWS      (SAM_INITIAL_ALLOCS + 4)
+#define MAX_CALLS           100000
+#define MAX_LIST            16
+#define MAX_SLOW            16
+
+/* the budgeters look up the machine here */
+struct cpuinfo *cpuinfo;
+
+/*
+ * Every allocation goes through these, so the ones made while counting is
+ * set are counted.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static bool counting;
+static uint64_t num_allocs;
+static uint64_t alloc_bytes;
+
+void *malloc(size_t size)
+{
+    if (counting) {
+        num_allocs++;
+        alloc_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (counting) {
+        num_allocs++;
+        alloc_bytes += nmemb * size;
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting) {
+        num_allocs++;
+        alloc_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+struct stats {
+    uint64_t calls;
+    double ns;
+    uint64_t allocs;
+    uint64_t bytes;
+};
+
+struct timer {
+    struct timespec start;
+    uint64_t allocs;
+    uint64_t bytes;
+};
+
+/* what clock_gettime() itself costs, taken off every call */
+static double timer_overhead_ns;
+
+static void timer_start(struct timer *t)
+{
+    t->allocs = num_allocs;
+    t->bytes = alloc_bytes;
+    counting = true;
+    clock_gettime(CLOCK_MONOTONIC, &t->start);
+}
+
+static void timer_stop(const struct timer *t, struct stats *st)
+{
+    struct timespec now;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    counting = false;
+    ns = 1e9 * timespec_to_secs(timespec_sub(now, t->start)) - timer_overhead_ns;
+    st->calls++;
+    st->ns += ns > 0 ? ns : 0;
+    st->allocs += num_allocs - t->allocs;
+    st->bytes += alloc_bytes - t->bytes;
+}
+
+static void measure_timer_overhead(void)
+{
+    struct stats st = { 0 };
+    struct timer t;
+
+    for (int i = 0; i < 10000; ++i) {
+        timer_start(&t);
+        timer_stop(&t, &st);
+    }
+    timer_overhead_ns = st.ns / st.calls;
+}
+
+/* a case runs until it has had this long, or MAX_CALLS calls */
+static double min_secs = 0.1;
+static const char *filter;
+
+static bool case_done(const struct stats *st, const struct timespec *began)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return st->calls >= MAX_CALLS || (st->calls > 0 && timespec_to_secs(timespec_sub(now, *began)) >= min_secs);
+}
+
+static bool wanted(const char *name)
+{
+    return !filter || strstr(name, filter);
+}
+
+/*
+ * A function that took longer than max_call_secs a call is not run for more
+ * applications on the same machine: NuPoCo's greedy phase would take hours.
+ */
+static double max_call_secs = 1;
+static struct {
+    const char *name;
+    int num_apps;
+} slow[MAX_SLOW];
+static int num_slow;
+
+static int slow_at(const char *name)
+{
+    for (int i = 0; i < num_slow; ++i)
+        if (strcmp(slow[i].name, name) == 0)
+            return slow[i].num_apps;
+    return 0;
+}
+
+static void check_slow(const char *name, int num_apps, const struct stats *st)
+{
+    if (st->calls > 0 && st->ns / st->calls > 1e9 * max_call_secs && !slow_at(name) && num_slow < MAX_SLOW) {
+        slow[num_slow].name = name;
+        slow[num_slow].num_apps = num_apps;
+        num_slow++;
+    }
+}
+
+static void report(const char *name, const char *topology, int num_apps, const struct stats *st)
+{
+    if (st->calls == 0)
+        return;
+    printf("%-26s %-9s %5d %8lu %14.0f %12.1f %12.0f\n", name, topology, num_apps, (unsigned long)st->calls,
+           st->ns / st->calls, (double)st->allocs / st->calls, (double)st->bytes / st->calls);
+    fflush(stdout);
+}
+
+static void report_skipped(const char *name, const char *topology, int num_apps, const char *why)
+{
+    printf("%-26s %-9s %5d %8s %14s  (%s)\n", name, topology, num_apps, "-", "-", why);
+}
+
+static bool skip_slow(const char *name, const char *topology, int num_apps)
+{
+    char why[64];
+
+    if (!slow_at(name))
+        return false;
+    snprintf(why, sizeof why, "over %g s a call with %d applications", max_call_secs, slow_at(name));
+    report_skipped(name, topology, num_apps, why);
+    return true;
+}
+
+/*
+ * The synthetic daemon state.
+ */
+struct bench {
+    struct appinfo *apps;
+    int num_apps;
+    size_t sz;
+    unsigned int seed;
+    struct appinfo **apps_unsorted;
+    struct appinfo **apps_sorted;
+    cpu_set_t **new_cpusets;
+    int **per_app_socket_orders;
+    cpu_set_t *remaining_cpus;
+    int range_ends[N_METRICS + 1];
+    int initial_remaining_cpus;
+    int fair_share;
+};
+
+static double uniform(unsigned int *seed)
+{
+    return rand_r(seed) / ((double)RAND_MAX + 1);
+}
+
+static void bench_init(struct bench *b, int num_apps, unsigned int seed)
+{
+    int fair = MAX(cpuinfo->total_cpus / num_apps, 1);
+    int next = 0;
+
+    memset(b, 0, sizeof *b);
+    b->num_apps = num_apps;
+    b->sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+    b->seed = seed;
+    b->apps = calloc(num_apps, sizeof *b->apps);
+    b->apps_unsorted = calloc(num_apps, sizeof *b->apps_unsorted);
+    b->apps_sorted = calloc(num_apps, sizeof *b->apps_sorted);
+    b->new_cpusets = calloc(num_apps, sizeof *b->new_cpusets);
+    b->per_app_socket_orders = calloc(num_apps, sizeof *b->per_app_socket_orders);
+    b->remaining_cpus = CPU_ALLOC(cpuinfo->total_cpus);
+
+    /* start from a fair share each, in socket order, while the CPUs last */
+    for (int i = 0; i < num_apps; ++i) {
+        struct appinfo *app = &b->apps[i];
+
+        app->pid = i + 1;
+        app->pidfd = -1;
+        app->appno = i;
+        app->cpuset[0] = CPU_ALLOC(cpuinfo->total_cpus);
+        app->cpuset[1] = CPU_ALLOC(cpuinfo->total_cpus);
+        CPU_ZERO_S(b->sz, app->cpuset[0]);
+        CPU_ZERO_S(b->sz, app->cpuset[1]);
+        app->perf_history = (uint64_t(*)[2])calloc(cpuinfo->total_cpus + 1, sizeof *app->perf_history);
+        for (int k = 0; k < fair && next < cpuinfo->total_cpus; ++k, ++next) {
+            int s = next / cpuinfo->sockets[0].num_cpus;
+
+            CPU_SET_S(cpuinfo->sockets[s].cpus[next % cpuinfo->sockets[0].num_cpus].tnumber, b->sz, app->cpuset[0]);
+        }
+        b->per_app_socket_orders[i] = calloc(cpuinfo->num_sockets, sizeof *b->per_app_socket_orders[i]);
+    }
+}
+
+static void bench_free(struct bench *b)
+{
+    for (int i = 0; i < b->num_apps; ++i) {
+        CPU_FREE(b->apps[i].cpuset[0]);
+        CPU_FREE(b->apps[i].cpuset[1]);
+        free(b->apps[i].perf_history);
+        free(b->per_app_socket_orders[i]);
+    }
+    free(b->apps);
+    free(b->apps_unsorted);
+    free(b->apps_sorted);
+    free(b->new_cpusets);
+    free(b->per_app_socket_orders);
+    CPU_FREE(b->remaining_cpus);
+}
+
+/**
+ * Make up the counters for a window, as sam-sim's model would: a third of
+ * the applications each are compute bound, memory bound and communicating,
+ * and their instructions per second follow their CPUs, with some noise.
+ */
+static void bench_sample(struct bench *b)
+{
+    for (int i = 0; i < b->num_apps; ++i) {
+        struct appinfo *app = &b->apps[i];
+        const int threads = SAM_MIN_THREADS + 1 + i % cpuinfo->sockets[0].num_cpus;
+        const uint64_t ips = (CPU_COUNT_S(b->sz, app->cpuset[0]) + 1) * 1e9 * (0.9 + 0.2 * uniform(&b->seed));
+        enum metric met = i % 3 == 0 ? METRIC_AVGIPC : i % 3 == 1 ? METRIC_MEM : METRIC_INTRA;
+
+        memset(app->bottleneck, 0, sizeof app->bottleneck);
+        memset(app->metric, 0, sizeof app->metric);
+        app->bottleneck[METRIC_ACTIVE] = threads;
+        app->metric[METRIC_ACTIVE] = threads;
+        app->bottleneck[met] = threads;
+        app->metric[met] = met == METRIC_AVGIPC ? ips : met == METRIC_MEM ? ips / 50 : ips / 1000;
+        app->extra_metric[EXTRA_METRIC_IPS] = ips;
+        app->extra_metric[EXTRA_METRIC_LLC_MISSES] = met == METRIC_MEM ? ips / 50 : ips / 5000;
+        app->extra_metric[EXTRA_METRIC_DRAM_REQUESTS] = app->extra_metric[EXTRA_METRIC_LLC_MISSES];
+        app->extra_metric[EXTRA_METRIC_CPU_MILLI] = MIN(threads, CPU_COUNT_S(b->sz, app->cpuset[0])) * 1000;
+    }
+}
+
+/**
+ * Set up the arguments of a policy's allocate(), as samd's scheduler does.
+ */
+static void bench_prepare(struct bench *b, const struct policy *p)
+{
+    b->initial_remaining_cpus = cpuinfo->total_cpus;
+    CPU_ZERO_S(b->sz, b->remaining_cpus);
+    for (int c = 0; c < cpuinfo->total_cpus; ++c)
+        CPU_SET_S(c, b->sz, b->remaining_cpus);
+    for (int i = 0; i < b->num_apps; ++i) {
+        b->apps_unsorted[i] = &b->apps[i];
+        b->new_cpusets[i] = NULL;
+        memset(b->per_app_socket_orders[i], 0, cpuinfo->num_sockets * sizeof *b->per_app_socket_orders[i]);
+        b->initial_remaining_cpus -= CPU_COUNT_S(b->sz, b->apps[i].cpuset[0]);
+    }
+    b->initial_remaining_cpus = MIN(MAX(b->initial_remaining_cpus, 0), cpuinfo->total_cpus);
+    b->fair_share = MAX(cpuinfo->total_cpus / b->num_apps, tunables.sam_min_contexts);
+    policy_group_apps(p, b->apps_unsorted, b->num_apps, tunables.num_counter_orders, tunables.counter_order,
+                      b->apps_sorted, b->range_ends);
+}
+
+static void bench_allocate(struct bench *b, const struct policy *p)
+{
+    p->allocate(b->num_apps, b->apps_sorted, b->range_ends, cpuinfo, b->sz, b->initial_remaining_cpus,
+                b->fair_share, tunables.num_counter_orders, tunables.counter_order, b->per_app_socket_orders,
+                b->new_cpusets, b->remaining_cpus);
+}
+
+/**
+ * Apply the budgets, as samd does once the cpusets are written.
+ */
+static void bench_apply(struct bench *b)
+{
+    for (int i = 0; i < N_METRICS; ++i) {
+        for (int k = b->range_ends[i]; k < b->range_ends[i + 1]; ++k) {
+            struct appinfo *an = b->apps_sorted[k];
+            int count = b->new_cpusets[k] ? CPU_COUNT_S(b->sz, b->new_cpusets[k]) : 0;
+
+            if (count > 0) {
+                if (!CPU_EQUAL_S(b->sz, an->cpuset[0], b->new_cpusets[k]) || (enum metric)i != an->curr_bottleneck) {
+                    memcpy(an->cpuset[1], an->cpuset[0], b->sz);
+                    memcpy(an->cpuset[0], b->new_cpusets[k], b->sz);
+                    an->prev_bottleneck = an->curr_bottleneck;
+                    an->curr_bottleneck = (enum metric)i;
+                }
+                an->times_allocated++;
+                if (count == b->fair_share)
+                    an->curr_fair_share = count;
+            }
+            if (b->new_cpusets[k])
+                CPU_FREE(b->new_cpusets[k]);
+            b->new_cpusets[k] = NULL;
+        }
+    }
+}
+
+static void bench_budgeters(const char *topology, int num_apps)
+{
+    static const struct {
+        const char *name;
+        budgeter_t fn;
+    } budgeters[] = {
+        { "budget_collocate",      NULL },
+        { "budget_spread",         budget_spread },
+        { "budget_no_hyperthread", budget_no_hyperthread },
+    };
+    const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+    const int budget = MAX(cpuinfo->total_cpus / num_apps, 1);
+    cpu_set_t *old_cpuset = CPU_ALLOC(cpuinfo->total_cpus);
+    cpu_set_t *new_cpuset = CPU_ALLOC(cpuinfo->total_cpus);
+    cpu_set_t *remaining_cpus = CPU_ALLOC(cpuinfo->total_cpus);
+    int socket_order[cpuinfo->num_sockets];
+
+    for (int s = 0; s < cpuinfo->num_sockets; ++s)
+        socket_order[s] = s;
+    CPU_ZERO_S(sz, remaining_cpus);
+    for (int c = 0; c < cpuinfo->total_cpus; ++c)
+        CPU_SET_S(c, sz, remaining_cpus);
+
+    for (size_t f = 0; f < sizeof budgeters / sizeof budgeters[0]; ++f) {
+        /* the collocating budgeter is only reachable by bottleneck */
+        budgeter_t fn = budgeters[f].fn ? budgeters[f].fn : budgeter_functions[METRIC_INTER];
+        struct stats st = { 0 };
+        struct timespec began;
+        struct timer t;
+
+        if (!wanted(budgeters[f].name))
+            continue;
+
+        /* the application keeps what it had, as it does most windows */
+        CPU_ZERO_S(sz, old_cpuset);
+        fn(old_cpuset, old_cpuset, false, remaining_cpus, sz, budget, socket_order);
+
+        clock_gettime(CLOCK_MONOTONIC, &began);
+        while (!case_done(&st, &began)) {
+            CPU_ZERO_S(sz, new_cpuset);
+            timer_start(&t);
+            fn(old_cpuset, new_cpuset, true, remaining_cpus, sz, budget, socket_order);
+            timer_stop(&t, &st);
+        }
+        report(budgeters[f].name, topology, num_apps, &st);
+    }
+
+    CPU_FREE(old_cpuset);
+    CPU_FREE(new_cpuset);
+    CPU_FREE(remaining_cpus);
+}
+
+static void bench_group(const char *topology, int num_apps, unsigned int seed)
+{
+    const struct policy *p = policy_find("default");
+    struct stats st = { 0 };
+    struct timespec began;
+    struct bench b;
+    struct timer t;
+
+    if (!wanted("policy_group_apps") || skip_slow("policy_group_apps", topology, num_apps))
+        return;
+
+    bench_init(&b, num_apps, seed);
+    clock_gettime(CLOCK_MONOTONIC, &began);
+    while (!case_done(&st, &began)) {
+        bench_sample(&b);
+        for (int i = 0; i < num_apps; ++i)
+            b.apps_unsorted[i] = &b.apps[i];
+        timer_start(&t);
+        policy_group_apps(p, b.apps_unsorted, num_apps, tunables.num_counter_orders, tunables.counter_order,
+                          b.apps_sorted, b.range_ends);
+        timer_stop(&t, &st);
+    }
+    report("policy_group_apps", topology, num_apps, &st);
+    check_slow("policy_group_apps", num_apps, &st);
+    bench_free(&b);
+}
+
+static void bench_sam(const char *topology, int num_apps, unsigned int seed)
+{
+    static const char *variants[] = { "default", "fair", "hillclimb" };
+
+    for (size_t v = 0; v < sizeof variants / sizeof variants[0]; ++v) {
+        const struct policy *p = policy_find(variants[v]);
+        char name[64];
+        struct stats st = { 0 };
+        struct timespec began;
+        struct bench b;
+        struct timer t;
+
+        snprintf(name, sizeof name, "sam_allocate/%s", variants[v]);
+        if (!wanted(name))
+            continue;
+        if (skip_slow(variants[v], topology, num_apps))
+            continue;
+
+        srandom(seed);
+        bench_init(&b, num_apps, seed);
+        for (int w = 0; w < WARMUP_WINDOWS; ++w) {
+            bench_sample(&b);
+            bench_prepare(&b, p);
+            bench_allocate(&b, p);
+            bench_apply(&b);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &began);
+        while (!case_done(&st, &began)) {
+            bench_sample(&b);
+            bench_prepare(&b, p);
+            timer_start(&t);
+            bench_allocate(&b, p);
+            timer_stop(&t, &st);
+            bench_apply(&b);
+        }
+        report(name, topology, num_apps, &st);
+        check_slow(variants[v], num_apps, &st);
+        bench_free(&b);
+    }
+}
+
+static void bench_nupoco(const char *topology, int num_apps, unsigned int seed)
+{
+    static const char *phases[] = {
+        "nupoco_allocate/profile",
+        "nupoco_allocate/greedy",
+        "nupoco_allocate/adaptive",
+    };
+    const struct policy *p = policy_find("nupoco");
+    struct stats st[3] = { { 0 } };
+    struct timespec began;
+    struct bench b;
+    struct timer t;
+    bool any = false;
+
+    for (int ph = 0; ph < 3; ++ph)
+        any |= wanted(phases[ph]);
+    if (!any || skip_slow("nupoco_allocate", topology, num_apps))
+        return;
+
+    /* each round starts over, as when an application exits */
+    bench_init(&b, num_apps, seed);
+    clock_gettime(CLOCK_MONOTONIC, &began);
+    while (!case_done(&st[2], &began)) {
+        p->reset();
+        for (int ph = 0; ph < 3; ++ph) {
+            bench_sample(&b);
+            bench_prepare(&b, p);
+            timer_start(&t);
+            bench_allocate(&b, p);
+            timer_stop(&t, &st[ph]);
+            bench_apply(&b);
+        }
+    }
+    for (int ph = 0; ph < 3; ++ph)
+        if (wanted(phases[ph]))
+            report(phases[ph], topology, num_apps, &st[ph]);
+    for (int ph = 0; ph < 3; ++ph)
+        check_slow("nupoco_allocate", num_apps, &st[ph]);
+    bench_free(&b);
+}
+
+static int parse_list(char *arg, char *items[], int max)
+{
+    char *save = NULL;
+    int n = 0;
+
+    for (char *tok = strtok_r(arg, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (n == max)
+            return -1;
+        items[n++] = tok;
+    }
+    return n;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-T SOCKETSxCPUS[xCPUS_PER_CORE],...] [-n apps,...] [-t milliseconds-per-case]\n"
+            "       [-x max-seconds-per-call] [-f function] [-r seed]\n"
+            "Defaults: -T %s -n %s -t 100 -x 1\n",
+            prog, DEFAULT_TOPOLOGIES, DEFAULT_APPS);
+}
+
+int main(int argc, char *argv[])
+{
+    char topologies_arg[256] = DEFAULT_TOPOLOGIES;
+    char apps_arg[256] = DEFAULT_APPS;
+    char *topologies[MAX_LIST], *apps[MAX_LIST];
+    int num_topologies, num_app_counts;
+    unsigned int seed = 1;
+    int opt;
+
+    log_set_level(LOG_LEVEL_WARN);
+
+    while ((opt = getopt(argc, argv, "T:n:t:x:f:r:h")) != -1) {
+        switch (opt) {
+        case 'T':
+            snprintf(topologies_arg, sizeof topologies_arg, "%s", optarg);
+            break;
+        case 'n':
+            snprintf(apps_arg, sizeof apps_arg, "%s", optarg);
+            break;
+        case 't':
+            min_secs = atoi(optarg) / 1000.0;
+            if (min_secs <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'x':
+            max_call_secs = atof(optarg);
+            if (max_call_secs <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt != 'h';
+        }
+    }
+    if ((num_topologies = parse_list(topologies_arg, topologies, MAX_LIST)) <= 0 ||
+        (num_app_counts = parse_list(apps_arg, apps, MAX_LIST)) <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    measure_timer_overhead();
+    printf("%-26s %-9s %5s %8s %14s %12s %12s\n", "function", "topology", "apps", "calls", "ns/call",
+           "allocs/call", "bytes/call");
+
+    for (int ti = 0; ti < num_topologies; ++ti) {
+        int num_sockets, cpus_per_socket, cpus_per_core = 2;
+        char topology[32];
+
+        if (sscanf(topologies[ti], "%dx%dx%d", &num_sockets, &cpus_per_socket, &cpus_per_core) < 2 ||
+            !(cpuinfo = make_cpuinfo(num_sockets, cpus_per_socket, cpus_per_core, 2000000000UL))) {
+            fprintf(stderr, "Impossible topology %s\n", topologies[ti]);
+            return 1;
+        }
+        snprintf(topology, sizeof topology, "%dx%dx%d", num_sockets, cpus_per_socket, cpus_per_core);
+        tunables_default(&tunables, cpuinfo->total_cores);
+        num_slow = 0;
+
+        for (int ai = 0; ai < num_app_counts; ++ai) {
+            int num_apps = atoi(apps[ai]);
+
+            if (num_apps < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+            bench_budgeters(topology, num_apps);
+            bench_group(topology, num_apps, seed);
+            bench_sam(topology, num_apps, seed);
+            bench_nupoco(topology, num_apps, seed);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * BPF collector for samd.
+ *
+ * Follows the threads of managed applications through fork and exit, and on
+ * every context switch accumulates the per-CPU counters into a per-application
+ * map. samd then reads one map entry per application per window instead of
+ * opening, reading and closing counters for every thread.
+ */
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+#include "samcollect.h"
+
+char LICENSE[] SEC("license") = "GPL";
+
+/* per-CPU counters, at index (cpu * SAMCOLLECT_NR_EVENTS + event) */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(u32));
+} events SEC(".maps");
+
+/* TID -> application PID */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, SAMCOLLECT_MAX_TASKS);
+    __type(key, u32);
+    __type(value, u32);
+} tasks SEC(".maps");
+
+/* application PID -> counters accumulated since samd last read them */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, SAMCOLLECT_MAX_APPS);
+    __type(key, u32);
+    __type(value, struct samcollect_counts);
+} app_counts SEC(".maps");
+
+/* the application running on this CPU and its counters at switch-in */
+struct cpu_state {
+    u32 app;
+    u32 pad;
+    struct bpf_perf_event_value start[SAMCOLLECT_NR_EVENTS];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct cpu_state);
+} cpu_states SEC(".maps");
+
+SEC("tp_btf/sched_process_fork")
+int BPF_PROG(sam_fork, struct task_struct *parent, struct task_struct *child)
+{
+    u32 parent_tid = parent->pid;
+    u32 child_tid = child->pid;
+    u32 *app = bpf_map_lookup_elem(&tasks, &parent_tid);
+
+    if (app) {
+        u32 app_pid = *app;
+        bpf_map_update_elem(&tasks, &child_tid, &app_pid, BPF_ANY);
+    }
+    return 0;
+}
+
+SEC("tp_btf/sched_process_exit")
+int BPF_PROG(sam_exit, struct task_struct *p)
+{
+    u32 tid = p->pid;
+
+    bpf_map_delete_elem(&tasks, &tid);
+    return 0;
+}
+
+SEC("tp_btf/sched_switch")
+int BPF_PROG(sam_switch, bool preempt, struct task_struct *prev, struct task_struct *next)
+{
+    struct bpf_perf_event_value now[SAMCOLLECT_NR_EVENTS];
+    u32 cpu = bpf_get_smp_processor_id();
+    u32 zero = 0;
+    u32 next_tid = next->pid;
+    struct cpu_state *st = bpf_map_lookup_elem(&cpu_states, &zero);
+    u32 *next_app = bpf_map_lookup_elem(&tasks, &next_tid);
+
+    if (!st || (!st->app && !next_app))
+        return 0;
+
+    for (int e = 0; e < SAMCOLLECT_NR_EVENTS; e++) {
+        if (bpf_perf_event_read_value(&events, cpu * SAMCOLLECT_NR_EVENTS + e, &now[e], sizeof now[e]) != 0)
+            __builtin_memset(&now[e], 0, sizeof now[e]);
+    }
+
+    if (st->app) {
+        u32 app = st->app;
+        struct samcollect_counts *c = bpf_map_lookup_elem(&app_counts, &app);
+
+        if (!c) {
+            struct samcollect_counts empty = {};
+
+            bpf_map_update_elem(&app_counts, &app, &empty, BPF_NOEXIST);
+            c = bpf_map_lookup_elem(&app_counts, &app);
+        }
+
+        if (c) {
+            for (int e = 0; e < SAMCOLLECT_NR_EVENTS; e++) {
+                if (now[e].counter < st->start[e].counter)
+                    continue;
+                c->counter[e] += now[e].counter - st->start[e].counter;
+                c->enabled[e] += now[e].enabled - st->start[e].enabled;
+                c->running[e] += now[e].running - st->start[e].running;
+            }
+        }
+    }
+
+    st->app = next_app ? *next_app : 0;
+    __builtin_memcpy(st->start, now, sizeof now);
+    return 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * Definitions shared between the BPF collector and samd.
+ */
+#ifndef SAMCOLLECT_H
+#define SAMCOLLECT_H
+
+#define SAMCOLLECT_NR_EVENTS    5           /* must be N_EVENTS in perfio.h */
+#define SAMCOLLECT_MAX_TASKS    (1 << 22)
+#define SAMCOLLECT_MAX_APPS     4096
+
+/*
+ * Counter deltas accumulated for one application on one CPU, indexed by
+ * enum perf_event. enabled and running are kept per event so that samd can
+ * scale for multiplexing.
+ */
+struct samcollect_counts {
+    __u64 counter[SAMCOLLECT_NR_EVENTS];
+    __u64 enabled[SAMCOLLECT_NR_EVENTS];
+    __u64 running[SAMCOLLECT_NR_EVENTS];
+};
+
+#endif  /* SAMCOLLECT_H */
@@ -0,0 +1,178 @@
+/*
+ * sched_ext scheduler for samd.
+ *
+ * Threads of managed applications only run on the CPUs in their
+ * application's mask, which samd updates in app_masks. Each is queued on the
+ * local queue of one of those CPUs, preferring the CPU it last ran on, then an
+ * idle one, then the next one round-robin, so applications whose masks
+ * overlap share those CPUs. All other tasks are queued globally and run
+ * wherever there is room, like tasks outside the sam cgroup do with cpusets.
+ *
+ * Written against the sched_ext interface of Linux 6.12.
+ */
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+#include "samsched.h"
+
+char LICENSE[] SEC("license") = "GPL";
+
+/* set by samd before loading */
+const volatile u32 nr_cpus = 1;
+
+s32 scx_bpf_select_cpu_dfl(struct task_struct *p, s32 prev_cpu, u64 wake_flags, bool *is_idle) __ksym;
+void scx_bpf_dispatch(struct task_struct *p, u64 dsq_id, u64 slice, u64 enq_flags) __ksym;
+bool scx_bpf_consume(u64 dsq_id) __ksym;
+bool scx_bpf_test_and_clear_cpu_idle(s32 cpu) __ksym;
+void scx_bpf_kick_cpu(s32 cpu, u64 flags) __ksym;
+s32 scx_bpf_task_cpu(const struct task_struct *p) __ksym;
+bool bpf_cpumask_test_cpu(u32 cpu, const struct cpumask *cpumask) __ksym;
+
+/* TID -> application PID */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, SAMSCHED_MAX_TASKS);
+    __type(key, u32);
+    __type(value, u32);
+} tasks SEC(".maps");
+
+/* application PID -> the CPUs its threads may run on */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, SAMSCHED_MAX_APPS);
+    __type(key, u32);
+    __type(value, struct samsched_mask);
+} app_masks SEC(".maps");
+
+static bool mask_test(const struct samsched_mask *mask, s32 cpu)
+{
+    if (cpu < 0 || cpu >= SAMSCHED_MAX_CPUS)
+        return false;
+    return mask->bits[cpu / 64] & (1ULL << (cpu % 64));
+}
+
+/* the application's mask, or NULL if @p is not managed or has no CPUs yet */
+static struct samsched_mask *task_mask(struct task_struct *p)
+{
+    u32 tid = p->pid;
+    u32 *app = bpf_map_lookup_elem(&tasks, &tid);
+
+    return app ? bpf_map_lookup_elem(&app_masks, app) : NULL;
+}
+
+static bool task_may_run(struct task_struct *p, const struct samsched_mask *mask, s32 cpu)
+{
+    return mask_test(mask, cpu) && bpf_cpumask_test_cpu(cpu, p->cpus_ptr);
+}
+
+/* an idle CPU for @p from its application's mask, claimed for @p, or -1 */
+static s32 pick_idle_cpu(struct task_struct *p, const struct samsched_mask *mask, s32 prev_cpu)
+{
+    if (task_may_run(p, mask, prev_cpu) && scx_bpf_test_and_clear_cpu_idle(prev_cpu))
+        return prev_cpu;
+
+    for (u32 cpu = 0; cpu < SAMSCHED_MAX_CPUS && cpu < nr_cpus; ++cpu) {
+        if (task_may_run(p, mask, cpu) && scx_bpf_test_and_clear_cpu_idle(cpu))
+            return cpu;
+    }
+
+    return -1;
+}
+
+/* a CPU for @p from its application's mask, or -1 */
+static s32 pick_cpu(struct task_struct *p, struct samsched_mask *mask, s32 prev_cpu)
+{
+    s32 cpu = pick_idle_cpu(p, mask, prev_cpu);
+    u32 start = mask->cursor;
+
+    if (cpu >= 0)
+        return cpu;
+    if (task_may_run(p, mask, prev_cpu))
+        return prev_cpu;
+
+    for (u32 i = 0; i < SAMSCHED_MAX_CPUS && i < nr_cpus; ++i) {
+        cpu = (start + i) % nr_cpus;
+        if (task_may_run(p, mask, cpu)) {
+            mask->cursor = cpu + 1;
+            return cpu;
+        }
+    }
+
+    return -1;
+}
+
+SEC("struct_ops/samsched_select_cpu")
+s32 BPF_PROG(samsched_select_cpu, struct task_struct *p, s32 prev_cpu, u64 wake_flags)
+{
+    struct samsched_mask *mask = task_mask(p);
+    bool is_idle = false;
+    s32 cpu;
+
+    if (mask) {
+        /* if none of its CPUs is idle, enqueue picks one to wait on */
+        if ((cpu = pick_idle_cpu(p, mask, prev_cpu)) < 0)
+            return prev_cpu;
+        scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, 0);
+        return cpu;
+    }
+
+    cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+    if (is_idle)
+        scx_bpf_dispatch(p, SCX_DSQ_LOCAL, SCX_SLICE_DFL, 0);
+    return cpu;
+}
+
+SEC("struct_ops/samsched_enqueue")
+void BPF_PROG(samsched_enqueue, struct task_struct *p, u64 enq_flags)
+{
+    struct samsched_mask *mask = task_mask(p);
+    s32 cpu;
+
+    if (mask && (cpu = pick_cpu(p, mask, scx_bpf_task_cpu(p))) >= 0) {
+        scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | cpu, SCX_SLICE_DFL, enq_flags);
+        scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+        return;
+    }
+
+    scx_bpf_dispatch(p, SCX_DSQ_GLOBAL, SCX_SLICE_DFL, enq_flags);
+}
+
+SEC("struct_ops/samsched_dispatch")
+void BPF_PROG(samsched_dispatch, s32 cpu, struct task_struct *prev)
+{
+    scx_bpf_consume(SCX_DSQ_GLOBAL);
+}
+
+/* threads created by a managed thread belong to the same application */
+SEC("struct_ops.s/samsched_init_task")
+s32 BPF_PROG(samsched_init_task, struct task_struct *p, struct scx_init_task_args *args)
+{
+    u32 parent_tid = (u32)bpf_get_current_pid_tgid();
+    u32 child_tid = p->pid;
+    u32 *app;
+
+    if (args->fork && (app = bpf_map_lookup_elem(&tasks, &parent_tid))) {
+        u32 app_pid = *app;
+        bpf_map_update_elem(&tasks, &child_tid, &app_pid, BPF_ANY);
+    }
+    return 0;
+}
+
+SEC("struct_ops/samsched_exit_task")
+void BPF_PROG(samsched_exit_task, struct task_struct *p, struct scx_exit_task_args *args)
+{
+    u32 tid = p->pid;
+
+    bpf_map_delete_elem(&tasks, &tid);
+}
+
+SEC(".struct_ops.link")
+struct sched_ext_ops samsched_ops = {
+    .select_cpu     = (void *)samsched_select_cpu,
+    .enqueue        = (void *)samsched_enqueue,
+    .dispatch       = (void *)samsched_dispatch,
+    .init_task      = (void *)samsched_init_task,
+    .exit_task      = (void *)samsched_exit_task,
+    .name           = "sam",
+};
@@ -0,0 +1,22 @@
+/*
+ * Definitions shared between the sched_ext scheduler and samd.
+ */
+#ifndef SAMSCHED_H
+#define SAMSCHED_H
+
+#define SAMSCHED_MAX_TASKS      (1 << 22)
+#define SAMSCHED_MAX_APPS       4096
+#define SAMSCHED_MAX_CPUS       1024
+
+/*
+ * The CPUs an application may run on. Masks of different applications may
+ * overlap, in which case the applications time-share those CPUs.
+ */
+struct samsched_mask {
+    __u64 bits[SAMSCHED_MAX_CPUS / 64];
+    /* the next CPU to try when none of the application's CPUs is idle */
+    __u32 cursor;
+    __u32 pad;
+};
+
+#endif  /* SAMSCHED_H */
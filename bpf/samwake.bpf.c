@@ -0,0 +1,125 @@
+/*
+ * Wakeup tracer for samd.
+ *
+ * Follows the threads of managed applications through fork and exit like
+ * samcollect, and counts every wakeup of one of an application's threads by
+ * another of its threads. Wakeups done from within a futex wake are counted
+ * separately, since they are the handoffs of locks, condition variables and
+ * barriers that usually guard shared data.
+ */
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+#include "samwake.h"
+
+char LICENSE[] SEC("license") = "GPL";
+
+/* TID -> task state */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, SAMWAKE_MAX_TASKS);
+    __type(key, u32);
+    __type(value, struct samwake_task);
+} tasks SEC(".maps");
+
+/* waker -> wakee edges accumulated since samd last read them */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, SAMWAKE_MAX_EDGES);
+    __type(key, struct samwake_edge_key);
+    __type(value, struct samwake_edge);
+} edges SEC(".maps");
+
+SEC("tp_btf/sched_process_fork")
+int BPF_PROG(samwake_fork, struct task_struct *parent, struct task_struct *child)
+{
+    u32 parent_tid = parent->pid;
+    u32 child_tid = child->pid;
+    struct samwake_task *pt = bpf_map_lookup_elem(&tasks, &parent_tid);
+
+    if (pt) {
+        struct samwake_task ct = { .app = pt->app };
+        bpf_map_update_elem(&tasks, &child_tid, &ct, BPF_ANY);
+    }
+    return 0;
+}
+
+SEC("tp_btf/sched_process_exit")
+int BPF_PROG(samwake_exit, struct task_struct *p)
+{
+    u32 tid = p->pid;
+
+    bpf_map_delete_elem(&tasks, &tid);
+    return 0;
+}
+
+SEC("tracepoint/syscalls/sys_enter_futex")
+int samwake_futex_enter(struct trace_event_raw_sys_enter *ctx)
+{
+    u32 tid = (u32)bpf_get_current_pid_tgid();
+    struct samwake_task *t = bpf_map_lookup_elem(&tasks, &tid);
+
+    if (!t)
+        return 0;
+
+    switch (ctx->args[1] & SAMWAKE_FUTEX_CMD_MASK) {
+    case SAMWAKE_FUTEX_WAKE:
+    case SAMWAKE_FUTEX_REQUEUE:
+    case SAMWAKE_FUTEX_CMP_REQUEUE:
+    case SAMWAKE_FUTEX_WAKE_OP:
+    case SAMWAKE_FUTEX_WAKE_BITSET:
+        t->in_futex_wake = 1;
+        break;
+    }
+    return 0;
+}
+
+SEC("tracepoint/syscalls/sys_exit_futex")
+int samwake_futex_exit(struct trace_event_raw_sys_exit *ctx)
+{
+    u32 tid = (u32)bpf_get_current_pid_tgid();
+    struct samwake_task *t = bpf_map_lookup_elem(&tasks, &tid);
+
+    if (t)
+        t->in_futex_wake = 0;
+    return 0;
+}
+
+/*
+ * sched_waking runs in the context of the waker, whereas sched_wakeup may run
+ * on the wakee's CPU. Wakeups from interrupts are attributed to whichever
+ * thread they interrupted, but only count when it is a sibling of the wakee.
+ */
+SEC("tp_btf/sched_waking")
+int BPF_PROG(samwake_waking, struct task_struct *p)
+{
+    u32 waker_tid = (u32)bpf_get_current_pid_tgid();
+    u32 wakee_tid = p->pid;
+    struct samwake_task *waker, *wakee;
+    struct samwake_edge_key key;
+    struct samwake_edge *e;
+
+    if (waker_tid == wakee_tid)
+        return 0;
+    if (!(waker = bpf_map_lookup_elem(&tasks, &waker_tid)) ||
+        !(wakee = bpf_map_lookup_elem(&tasks, &wakee_tid)) ||
+        waker->app != wakee->app)
+        return 0;
+
+    key.app = waker->app;
+    key.waker = waker_tid;
+    key.wakee = wakee_tid;
+    if (!(e = bpf_map_lookup_elem(&edges, &key))) {
+        struct samwake_edge empty = {};
+
+        bpf_map_update_elem(&edges, &key, &empty, BPF_NOEXIST);
+        if (!(e = bpf_map_lookup_elem(&edges, &key)))
+            return 0;
+    }
+
+    __sync_fetch_and_add(&e->wakeups, 1);
+    if (waker->in_futex_wake)
+        __sync_fetch_and_add(&e->futex_wakeups, 1);
+    return 0;
+}
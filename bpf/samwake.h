@@ -0,0 +1,40 @@
+/*
+ * Definitions shared between the wakeup tracer and samd.
+ */
+#ifndef SAMWAKE_H
+#define SAMWAKE_H
+
+#define SAMWAKE_MAX_TASKS       (1 << 22)
+#define SAMWAKE_MAX_EDGES       (1 << 20)
+
+/* futex(2) operations that wake other threads (see linux/futex.h) */
+#define SAMWAKE_FUTEX_CMD_MASK      0x7f
+#define SAMWAKE_FUTEX_WAKE          1
+#define SAMWAKE_FUTEX_REQUEUE       3
+#define SAMWAKE_FUTEX_CMP_REQUEUE   4
+#define SAMWAKE_FUTEX_WAKE_OP       5
+#define SAMWAKE_FUTEX_WAKE_BITSET   10
+
+/*
+ * A traced thread: the application it belongs to, and whether it is inside a
+ * futex wake right now.
+ */
+struct samwake_task {
+    __u32 app;
+    __u32 in_futex_wake;
+};
+
+/* a waker -> wakee edge within one application */
+struct samwake_edge_key {
+    __u32 app;
+    __u32 waker;
+    __u32 wakee;
+};
+
+/* wakeups along an edge since samd last read it */
+struct samwake_edge {
+    __u64 wakeups;          /* all wakeups, including futex wakes */
+    __u64 futex_wakeups;    /* wakeups from FUTEX_WAKE and friends */
+};
+
+#endif  /* SAMWAKE_H */
@@ -0,0 +1,328 @@
+/*
+ * sam-calibrate: measure the rates of the events that samd's thresholds are
+ * compared with on this machine, under microbenchmarks that do and do not
+ * contend, and write thresholds in the configuration file format (see
+ * tunables.h) for samd to load.
+ *
+ * The kernels are:
+ *   compute    arithmetic in registers; the rates of a thread with no
+ *              bottleneck
+ *   intra      two threads on different cores of one socket writing to the
+ *              same cache line (false sharing); snoops
+ *   inter      the same, with the threads on different sockets; remote HITMs
+ *   stream     one thread per core reading buffers larger than the LLC;
+ *              LLC misses
+ *
+ * A threshold is a fraction (-f) of the rate under contention, but never
+ * less than twice the rate of the compute kernel.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "cpuinfo.h"
+#include "perfio.h"
+#include "util.h"
+
+#define CACHE_LINE          64
+/* larger than the last-level cache of any machine we have */
+#define STREAM_BYTES        (64 << 20)
+#define MAX_WORKERS         4096
+
+enum kernel {
+    KERNEL_COMPUTE,
+    KERNEL_PINGPONG,
+    KERNEL_STREAM,
+};
+
+struct worker {
+    pthread_t thread;
+    enum kernel kernel;
+    int cpu;
+    pid_t tid;
+    /* the ping-pong kernel's word, which shares a line with another's */
+    volatile uint64_t *word;
+    /* the stream kernel's buffer */
+    char *buffer;
+    /* keeps the compute and stream kernels from being optimized away */
+    volatile uint64_t sink;
+};
+
+/* the rates of one kernel's threads, in events per second of running */
+struct rates {
+    /* the mean over the threads */
+    double per_thread[N_EVENTS];
+    /* the sum over the threads */
+    double total[N_EVENTS];
+    double ipc;
+};
+
+static int running;
+static int num_ready;
+static struct cpuinfo *cpuinfo;
+
+static void *run_worker(void *arg)
+{
+    struct worker *w = (struct worker *)arg;
+    cpu_set_t set;
+    uint64_t x = 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    if (sched_setaffinity(0, sizeof set, &set) != 0)
+        fprintf(stderr, "Failed to pin a thread to CPU %d: %s\n", w->cpu, strerror(errno));
+    w->tid = syscall(SYS_gettid);
+    __atomic_add_fetch(&num_ready, 1, __ATOMIC_RELEASE);
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        switch (w->kernel) {
+        case KERNEL_COMPUTE:
+            for (int i = 0; i < (1 << 16); ++i)
+                x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            w->sink = x;
+            break;
+        case KERNEL_PINGPONG:
+            for (int i = 0; i < (1 << 12); ++i)
+                (*w->word)++;
+            break;
+        case KERNEL_STREAM:
+            for (size_t off = 0; off < STREAM_BYTES; off += CACHE_LINE)
+                x += w->buffer[off];
+            w->sink = x;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Run @kernel on each of the @n CPUs in @cpus for @duration_ms, and fill in
+ * @out with the rates measured.
+ *
+ * Returns 0, or -1 if the counters did not count.
+ */
+static int measure(enum kernel kernel, const int cpus[], int n, int duration_ms, struct rates *out)
+{
+    struct worker *workers = calloc(n, sizeof *workers);
+    uint64_t *line = NULL;
+    pid_t *tids = calloc(n, sizeof *tids);
+    struct timespec group_ts;
+    int ret = 0;
+
+    if (!workers || !tids || posix_memalign((void **)&line, CACHE_LINE, CACHE_LINE) != 0) {
+        perror("measure");
+        exit(1);
+    }
+    memset(line, 0, CACHE_LINE);
+
+    running = 1;
+    num_ready = 0;
+    for (int i = 0; i < n; ++i) {
+        workers[i].kernel = kernel;
+        workers[i].cpu = cpus[i];
+        workers[i].word = &line[i % (CACHE_LINE / sizeof *line)];
+        if (kernel == KERNEL_STREAM) {
+            if (!(workers[i].buffer = malloc(STREAM_BYTES))) {
+                perror("malloc");
+                exit(1);
+            }
+            memset(workers[i].buffer, i, STREAM_BYTES);
+        }
+        if ((errno = pthread_create(&workers[i].thread, NULL, run_worker, &workers[i])) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    while (__atomic_load_n(&num_ready, __ATOMIC_ACQUIRE) < n)
+        sched_yield();
+    for (int i = 0; i < n; ++i)
+        tids[i] = workers[i].tid;
+
+    /* count each group for its share of the duration, as samd does */
+    group_ts.tv_sec = duration_ms / perfio_num_groups() / 1000;
+    group_ts.tv_nsec = (duration_ms / perfio_num_groups() % 1000) * 1000000L;
+    perfio_open_counters(tids, n, NULL);
+    for (int grp = 0; grp < perfio_num_groups(); ++grp) {
+        perfio_start_group(grp, NULL);
+        nanosleep(&group_ts, NULL);
+        perfio_stop_group(grp, NULL);
+    }
+    displayTIDEvents(tids, n);
+
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < n; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].buffer);
+    }
+
+    memset(out, 0, sizeof *out);
+    for (int i = 0; i < THREADS.index_tid; ++i) {
+        const uint64_t *events = THREADS.event[i];
+        const uint64_t cycles = events[EVENT_UNHALTED_CYCLES];
+
+        if (cycles == 0) {
+            ret = -1;
+            continue;
+        }
+        for (int e = 0; e < N_EVENTS; ++e) {
+            double rate = (double)cpuinfo->clock_rate * events[e] / cycles;
+
+            out->total[e] += rate;
+            out->per_thread[e] += rate / n;
+        }
+        out->ipc += (double)events[EVENT_INSTRUCTIONS] / cycles / n;
+    }
+    if (THREADS.index_tid != n)
+        ret = -1;
+
+    free(workers);
+    free(tids);
+    free(line);
+    return ret;
+}
+
+static void print_rates(FILE *out, const char *name, const struct rates *r)
+{
+    fprintf(out, "# %-8s %14.0f snoops/s %14.0f remote HITMs/s %14.0f LLC misses/s per thread (%.0f in all), IPC %.2f\n",
+            name, r->per_thread[EVENT_SNP], r->per_thread[EVENT_REMOTE_HITM], r->per_thread[EVENT_LLC_MISSES],
+            r->total[EVENT_LLC_MISSES], r->ipc);
+}
+
+static long threshold(double baseline, double contended, double fraction)
+{
+    double t = fraction * contended;
+
+    return t > 2 * baseline ? t : 2 * baseline;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t milliseconds-per-kernel] [-f fraction] [-o config-file]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int duration_ms = 2000;
+    double fraction = 0.05;
+    const char *path = NULL;
+    FILE *out = stdout;
+    struct rates compute, intra, inter, stream;
+    bool have_intra = false, have_inter = false;
+    int cpus[MAX_WORKERS];
+    int n = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:f:o:h")) != -1) {
+        switch (opt) {
+        case 't':
+            duration_ms = atoi(optarg);
+            if (duration_ms < 10) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'f':
+            fraction = atof(optarg);
+            if (!(fraction > 0 && fraction <= 1)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt != 'h';
+        }
+    }
+
+    if (!(cpuinfo = get_cpuinfo())) {
+        fprintf(stderr, "Failed to get CPU topology.\n");
+        return 1;
+    }
+
+    fprintf(stderr, "Running the compute kernel...\n");
+    cpus[0] = cpuinfo->sockets[0].cpus[0].tnumber;
+    if (measure(KERNEL_COMPUTE, cpus, 1, duration_ms, &compute) != 0) {
+        fprintf(stderr, "Nothing was counted; are the performance counters available?\n");
+        return 1;
+    }
+
+    /* two CPUs of socket 0 that are on different cores */
+    for (int j = 1; j < cpuinfo->sockets[0].num_cpus; ++j) {
+        if (cpuinfo->sockets[0].cpus[j].core_id != cpuinfo->sockets[0].cpus[0].core_id) {
+            cpus[1] = cpuinfo->sockets[0].cpus[j].tnumber;
+            fprintf(stderr, "Running the intra-socket ping-pong kernel...\n");
+            have_intra = measure(KERNEL_PINGPONG, cpus, 2, duration_ms, &intra) == 0;
+            break;
+        }
+    }
+
+    if (cpuinfo->num_sockets > 1) {
+        cpus[1] = cpuinfo->sockets[1].cpus[0].tnumber;
+        fprintf(stderr, "Running the inter-socket ping-pong kernel...\n");
+        have_inter = measure(KERNEL_PINGPONG, cpus, 2, duration_ms, &inter) == 0;
+    }
+
+    /* the first CPU of every core */
+    for (int s = 0; s < cpuinfo->num_sockets; ++s) {
+        for (int j = 0; j < cpuinfo->sockets[s].num_cpus && n < MAX_WORKERS; ++j) {
+            bool seen = false;
+
+            for (int k = 0; k < j; ++k)
+                seen |= cpuinfo->sockets[s].cpus[k].core_id == cpuinfo->sockets[s].cpus[j].core_id;
+            if (!seen)
+                cpus[n++] = cpuinfo->sockets[s].cpus[j].tnumber;
+        }
+    }
+    fprintf(stderr, "Running the stream kernel on %d cores...\n", n);
+    if (measure(KERNEL_STREAM, cpus, n, duration_ms, &stream) != 0) {
+        fprintf(stderr, "Nothing was counted for the stream kernel.\n");
+        return 1;
+    }
+
+    if (path && !(out = fopen(path, "w"))) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "# Thresholds measured by sam-calibrate on %d CPUs in %d sockets at %lu Hz, set to %g of\n"
+            "# the rates under contention. Load them with \"samd -c FILE\", or install them as %s.\n#\n",
+            cpuinfo->total_cpus, cpuinfo->num_sockets, cpuinfo->clock_rate, fraction, SAM_CONFIG_FILE);
+    print_rates(out, "compute", &compute);
+    if (have_intra)
+        print_rates(out, "intra", &intra);
+    if (have_inter)
+        print_rates(out, "inter", &inter);
+    print_rates(out, "stream", &stream);
+    fprintf(out, "\n");
+
+    if (have_intra)
+        fprintf(out, "shar_coherence_thresh = %ld\n",
+                threshold(compute.per_thread[EVENT_SNP], intra.per_thread[EVENT_SNP], fraction));
+    else
+        fprintf(out, "# shar_coherence_thresh: needs two cores in a socket\n");
+    if (have_inter)
+        fprintf(out, "thresh_pt.inter = %ld\n",
+                threshold(compute.per_thread[EVENT_REMOTE_HITM], inter.per_thread[EVENT_REMOTE_HITM], fraction));
+    else
+        fprintf(out, "# thresh_pt.inter: needs two sockets\n");
+    fprintf(out, "shar_mem_thresh = %ld\n",
+            threshold(compute.per_thread[EVENT_LLC_MISSES] * n, stream.total[EVENT_LLC_MISSES], fraction));
+
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,306 @@
+/*
+ * Batched cgroup writes through io_uring, set up with the raw system calls
+ * so that there is no dependency on liburing.
+ */
+#include "cgbatch.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "cgroup.h"
+#include "util.h"
+
+/* the writes in flight at once; a larger batch is submitted in turns */
+#define CG_BATCH_ENTRIES 256
+
+struct cg_batch_write {
+    int fd;
+    /* the text written, at text + off */
+    size_t off;
+    size_t len;
+    bool barrier;
+    int result;
+};
+
+struct cg_batch {
+    /* the io_uring instance, or -1 if writes are made with pwrite() */
+    int ring_fd;
+    void *sq_ring;
+    size_t sq_ring_sz;
+    void *cq_ring;
+    size_t cq_ring_sz;
+    struct io_uring_sqe *sqes;
+    size_t sqes_sz;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct cg_batch_write *writes;
+    int num_writes;
+    int max_writes;
+    char *text;
+    size_t text_len;
+    size_t text_cap;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void close_ring(struct cg_batch *b)
+{
+    if (b->sqes && b->sqes != MAP_FAILED)
+        munmap(b->sqes, b->sqes_sz);
+    if (b->cq_ring && b->cq_ring != MAP_FAILED)
+        munmap(b->cq_ring, b->cq_ring_sz);
+    if (b->sq_ring && b->sq_ring != MAP_FAILED)
+        munmap(b->sq_ring, b->sq_ring_sz);
+    if (b->ring_fd >= 0)
+        close(b->ring_fd);
+    b->sqes = NULL;
+    b->cq_ring = b->sq_ring = NULL;
+    b->ring_fd = -1;
+}
+
+/* whether the ring can write to files (IORING_OP_WRITE is from Linux 5.6) */
+static bool ring_can_write(int ring_fd)
+{
+    const size_t sz = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, sz);
+    bool ok;
+
+    if (!probe)
+        return false;
+    ok = sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+         probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+static int open_ring(struct cg_batch *b)
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof p);
+    if ((b->ring_fd = sys_io_uring_setup(CG_BATCH_ENTRIES, &p)) < 0)
+        return -1;
+    if (!ring_can_write(b->ring_fd)) {
+        close_ring(b);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    b->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    b->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    b->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    b->sq_ring = mmap(NULL, b->sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->ring_fd,
+                      IORING_OFF_SQ_RING);
+    b->cq_ring = mmap(NULL, b->cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->ring_fd,
+                      IORING_OFF_CQ_RING);
+    b->sqes = mmap(NULL, b->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->ring_fd,
+                   IORING_OFF_SQES);
+    if (b->sq_ring == MAP_FAILED || b->cq_ring == MAP_FAILED || b->sqes == MAP_FAILED) {
+        int err = errno;
+
+        close_ring(b);
+        errno = err;
+        return -1;
+    }
+
+    b->sq_head = (unsigned *)((char *)b->sq_ring + p.sq_off.head);
+    b->sq_tail = (unsigned *)((char *)b->sq_ring + p.sq_off.tail);
+    b->sq_mask = (unsigned *)((char *)b->sq_ring + p.sq_off.ring_mask);
+    b->sq_array = (unsigned *)((char *)b->sq_ring + p.sq_off.array);
+    b->cq_head = (unsigned *)((char *)b->cq_ring + p.cq_off.head);
+    b->cq_tail = (unsigned *)((char *)b->cq_ring + p.cq_off.tail);
+    b->cq_mask = (unsigned *)((char *)b->cq_ring + p.cq_off.ring_mask);
+    b->cqes = (struct io_uring_cqe *)((char *)b->cq_ring + p.cq_off.cqes);
+    return 0;
+}
+
+struct cg_batch *cg_batch_create(void)
+{
+    struct cg_batch *b = calloc(1, sizeof *b);
+
+    if (!b)
+        return NULL;
+    b->ring_fd = -1;
+    /* without a ring, the writes are still made, one at a time */
+    open_ring(b);
+    return b;
+}
+
+void cg_batch_destroy(struct cg_batch *b)
+{
+    if (!b)
+        return;
+    close_ring(b);
+    free(b->writes);
+    free(b->text);
+    free(b);
+}
+
+bool cg_batch_uses_uring(const struct cg_batch *b)
+{
+    return b->ring_fd >= 0;
+}
+
+int cg_batch_write_cpus(struct cg_batch *b, int fd, const cpu_set_t *set, int num_cpus, bool barrier)
+{
+    struct cg_batch_write *w;
+    int len;
+
+    if (b->num_writes == b->max_writes) {
+        int n = b->max_writes ? 2 * b->max_writes : 64;
+        struct cg_batch_write *grown = realloc(b->writes, n * sizeof *grown);
+
+        if (!grown)
+            return -1;
+        b->writes = grown;
+        b->max_writes = n;
+    }
+    if (b->text_cap - b->text_len < CG_CPUS_BUFLEN) {
+        size_t n = b->text_cap ? 2 * b->text_cap : 16 * CG_CPUS_BUFLEN;
+        char *grown = realloc(b->text, n);
+
+        if (!grown)
+            return -1;
+        b->text = grown;
+        b->text_cap = n;
+    }
+
+    if ((len = cpuset_to_string(set, num_cpus, b->text + b->text_len, CG_CPUS_BUFLEN)) < 0)
+        return -1;
+    /* the kernel takes an empty write as "no CPUs", so send a newline */
+    if (len == 0)
+        b->text[b->text_len + len++] = '\n';
+
+    w = &b->writes[b->num_writes];
+    w->fd = fd;
+    w->off = b->text_len;
+    w->len = len;
+    w->barrier = barrier;
+    w->result = 0;
+    b->text_len += len;
+    return b->num_writes++;
+}
+
+static int write_result(const struct cg_batch_write *w, long ret)
+{
+    if (ret < 0)
+        return (int)-ret;
+    return (size_t)ret == w->len ? 0 : EIO;
+}
+
+/* make writes [@start, @end) through the ring, which holds them all at once */
+static int submit_ring(struct cg_batch *b, int start, int end)
+{
+    unsigned tail = *b->sq_tail;
+    const unsigned mask = *b->sq_mask;
+    int pending = end - start;
+
+    for (int i = start; i < end; ++i) {
+        const struct cg_batch_write *w = &b->writes[i];
+        const unsigned idx = tail++ & mask;
+        struct io_uring_sqe *sqe = &b->sqes[idx];
+
+        memset(sqe, 0, sizeof *sqe);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = w->fd;
+        sqe->addr = (uintptr_t)(b->text + w->off);
+        sqe->len = w->len;
+        sqe->off = 0;
+        sqe->flags = w->barrier ? IOSQE_IO_DRAIN : 0;
+        sqe->user_data = i;
+        b->sq_array[idx] = idx;
+    }
+    __atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (pending > 0) {
+        const unsigned to_submit = tail - __atomic_load_n(b->sq_head, __ATOMIC_ACQUIRE);
+        unsigned head, cq_tail;
+
+        if (sys_io_uring_enter(b->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            int err = errno;
+
+            /* the writes that were not made report why */
+            for (int i = start; i < end; ++i)
+                if (b->writes[i].result == -1)
+                    b->writes[i].result = err;
+            errno = err;
+            return -1;
+        }
+
+        head = *b->cq_head;
+        cq_tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; ++head, --pending) {
+            const struct io_uring_cqe *cqe = &b->cqes[head & *b->cq_mask];
+            struct cg_batch_write *w = &b->writes[cqe->user_data];
+
+            w->result = write_result(w, cqe->res);
+        }
+        __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+int cg_batch_submit(struct cg_batch *b)
+{
+    if (b->ring_fd < 0) {
+        for (int i = 0; i < b->num_writes; ++i) {
+            struct cg_batch_write *w = &b->writes[i];
+            ssize_t n = pwrite(w->fd, b->text + w->off, w->len, 0);
+
+            w->result = write_result(w, n < 0 ? -errno : n);
+        }
+        return 0;
+    }
+
+    /* marks the writes that are still to be made */
+    for (int i = 0; i < b->num_writes; ++i)
+        b->writes[i].result = -1;
+    for (int start = 0; start < b->num_writes; start += CG_BATCH_ENTRIES) {
+        const int end = MIN(start + CG_BATCH_ENTRIES, b->num_writes);
+
+        if (submit_ring(b, start, end) != 0) {
+            int err = errno;
+
+            for (int i = end; i < b->num_writes; ++i)
+                b->writes[i].result = err;
+            /* later batches are made with pwrite() */
+            close_ring(b);
+            errno = err;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int cg_batch_result(const struct cg_batch *b, int i)
+{
+    if (i < 0 || i >= b->num_writes)
+        return EINVAL;
+    return b->writes[i].result;
+}
+
+void cg_batch_reset(struct cg_batch *b)
+{
+    b->num_writes = 0;
+    b->text_len = 0;
+}
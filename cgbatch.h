@@ -0,0 +1,73 @@
+#ifndef CGBATCH_H
+#define CGBATCH_H
+
+#include <stdbool.h>
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * A batch of writes to cgroup control files that the caller keeps open,
+ * e.g. the cpuset.cpus of every application whose budget changed in a
+ * window. The batch is submitted through io_uring, so the writes take one
+ * system call rather than one each, and the kernel runs writes to different
+ * files on its own workers. Where io_uring is missing or disabled, the same
+ * writes are made one at a time with pwrite(), in order, with the same
+ * results.
+ */
+struct cg_batch;
+
+/**
+ * Create an empty batch, with an io_uring instance if the kernel allows.
+ *
+ * Returns the batch, or NULL (with errno set) if there is no memory.
+ */
+struct cg_batch *cg_batch_create(void);
+
+void cg_batch_destroy(struct cg_batch *b);
+
+/**
+ * Whether @b submits through io_uring, rather than with pwrite().
+ */
+bool cg_batch_uses_uring(const struct cg_batch *b);
+
+/**
+ * Queue writing the CPUs of @set, of @num_cpus, to the cpuset.cpus file open
+ * as @fd, as cg_pwrite_cpus() would. If @barrier, the write starts only once
+ * every write queued before it has finished, and those queued after it wait
+ * for it; otherwise the writes may be made in any order.
+ *
+ * Returns the index of the write, for cg_batch_result(), or -1 (with errno
+ * set) if it could not be queued.
+ */
+int cg_batch_write_cpus(struct cg_batch *b, int fd, const cpu_set_t *set, int num_cpus, bool barrier);
+
+/**
+ * Make every queued write and wait for all of them to finish.
+ *
+ * Returns 0 if they were all made, whether or not they succeeded, or -1
+ * (with errno set) if the ring failed; the writes it did not make then
+ * report that error.
+ */
+int cg_batch_submit(struct cg_batch *b);
+
+/**
+ * The outcome of write @i of the last submission: 0, or an errno value.
+ */
+int cg_batch_result(const struct cg_batch *b, int i);
+
+/**
+ * Forget the queued writes and their results, to start the next batch.
+ */
+void cg_batch_reset(struct cg_batch *b);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* CGBATCH_H */
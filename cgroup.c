@@ -3,19 +3,102 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <linux/magic.h>
 
 #include "util.h"
 
+static enum cg_version version = CG_V1;
+
+/* root/controller/path[/param]; there are no controller directories on v2 */
+static void cg_path(char *buf, size_t buflen,
+                    const char *root,
+                    const char *controller,
+                    const char *path,
+                    const char *param) {
+    int n;
+
+    if (version == CG_V2)
+        n = snprintf(buf, buflen, "%s/%s", root, path);
+    else
+        n = snprintf(buf, buflen, "%s/%s/%s", root, controller, path);
+    if (param && n >= 0 && (size_t) n < buflen)
+        snprintf(buf + n, buflen - n, "/%s", param);
+}
+
+/* whether @word is one of the space-separated words in file @file_path */
+static bool file_has_word(const char *file_path, const char *word) {
+    FILE *fp = fopen(file_path, "r");
+    char w[64];
+    bool found = false;
+
+    if (!fp)
+        return false;
+    while (!found && fscanf(fp, "%63s", w) == 1)
+        found = strcmp(w, word) == 0;
+    fclose(fp);
+    return found;
+}
+
+int cg_detect(const char *root, const char *controller) {
+    char file_path[256];
+    struct statfs fs;
+
+    /* a v1 hierarchy of its own takes precedence, as on hybrid systems */
+    snprintf(file_path, sizeof file_path, "%s/%s", root, controller);
+    if (statfs(file_path, &fs) == 0 && fs.f_type == CGROUP_SUPER_MAGIC) {
+        version = CG_V1;
+        return version;
+    }
+
+    snprintf(file_path, sizeof file_path, "%s/cgroup.controllers", root);
+    if (statfs(root, &fs) == 0 && fs.f_type == CGROUP2_SUPER_MAGIC &&
+        file_has_word(file_path, controller)) {
+        version = CG_V2;
+        return version;
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+enum cg_version cg_version(void) {
+    return version;
+}
+
+const char *cg_procs_param(void) {
+    return version == CG_V2 ? "cgroup.procs" : "tasks";
+}
+
+const char *cg_effective_param(const char *param) {
+    if (version != CG_V2)
+        return param;
+    if (strcmp(param, "cpuset.cpus") == 0)
+        return "cpuset.cpus.effective";
+    if (strcmp(param, "cpuset.mems") == 0)
+        return "cpuset.mems.effective";
+    return param;
+}
+
+int cg_enable_controller(const char *root,
+                         const char *controller,
+                         const char *path) {
+    if (version != CG_V2)
+        return 0;
+    return cg_write_string(root, controller, path, "cgroup.subtree_control", "+%s", controller);
+}
+
 int cg_create_cgroup(const char *root,
                      const char *controller,
                      const char *path) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s", root, controller, path);
+    cg_path(file_path, sizeof file_path, root, controller, path, NULL);
 
     return mkdir(file_path, 01777);
 }
@@ -24,18 +107,133 @@ int cg_remove_cgroup(const char *root,
                      const char *controller,
                      const char *path) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s", root, controller, path);
+    cg_path(file_path, sizeof file_path, root, controller, path, NULL);
 
     return rmdir(file_path);
 }
 
+int cg_inherit_cpuset(const char *root,
+                      const char *controller,
+                      const char *parent,
+                      const char *path) {
+    char *mems_string = NULL;
+    char *cpus_string = NULL;
+    int ret = -1;
+
+    if (cg_read_string(root, controller, parent, cg_effective_param("cpuset.mems"), &mems_string) == 0 &&
+        cg_write_string(root, controller, path, "cpuset.mems", "%s", mems_string) == 0 &&
+        cg_read_string(root, controller, parent, cg_effective_param("cpuset.cpus"), &cpus_string) == 0 &&
+        cg_write_string(root, controller, path, "cpuset.cpus", "%s", cpus_string) == 0)
+        ret = 0;
+
+    free(mems_string);
+    free(cpus_string);
+    return ret;
+}
+
+int cg_set_partition(const char *root,
+                     const char *controller,
+                     const char *path,
+                     const char *type, char *state, size_t len) {
+    char file_path[256];
+    FILE *fp;
+
+    state[0] = '\0';
+    if (version != CG_V2) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    if (cg_write_string(root, controller, path, "cpuset.cpus.partition", "%s", type) != 0)
+        return -1;
+
+    cg_path(file_path, sizeof file_path, root, controller, path, "cpuset.cpus.partition");
+    if (!(fp = fopen(file_path, "r")))
+        return -1;
+    if (!fgets(state, len, fp))
+        state[0] = '\0';
+    fclose(fp);
+    state[strcspn(state, "\n")] = '\0';
+    if (strcmp(state, type) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int cg_populated(const char *root,
+                 const char *controller,
+                 const char *path) {
+    char file_path[256];
+    char key[32];
+    long value;
+    int populated = -1;
+    FILE *fp;
+
+    /* v1 has no cgroup.events, so count the cgroup's own tasks, as those asked about have no children */
+    if (version != CG_V2) {
+        cg_path(file_path, sizeof file_path, root, controller, path, "cgroup.procs");
+        if (!(fp = fopen(file_path, "r")))
+            return -1;
+        populated = fscanf(fp, "%ld", &value) == 1;
+        fclose(fp);
+        return populated;
+    }
+
+    cg_path(file_path, sizeof file_path, root, controller, path, "cgroup.events");
+    if (!(fp = fopen(file_path, "r")))
+        return -1;
+    while (populated < 0 && fscanf(fp, "%31s %ld", key, &value) == 2)
+        if (strcmp(key, "populated") == 0)
+            populated = value != 0;
+    fclose(fp);
+    if (populated < 0)
+        errno = EINVAL;
+    return populated;
+}
+
+int cg_find(pid_t pid, const char *controller, char *path, size_t len) {
+    char file_path[64];
+    char line[1024];
+    bool found = false;
+    FILE *fp;
+
+    snprintf(file_path, sizeof file_path, "/proc/%d/cgroup", pid);
+    if (!(fp = fopen(file_path, "r")))
+        return -1;
+
+    /* "id:controller,controller:/path" on v1, "0::/path" on v2 */
+    while (!found && fgets(line, sizeof line, fp)) {
+        char *controllers = strchr(line, ':');
+        char *cg = controllers ? strchr(controllers + 1, ':') : NULL;
+        char *tok, *save;
+
+        if (!cg)
+            continue;
+        *cg++ = '\0';
+        controllers++;
+        cg[strcspn(cg, "\n")] = '\0';
+        if (version == CG_V2)
+            found = *controllers == '\0';
+        else
+            for (tok = strtok_r(controllers, ",", &save); tok && !found; tok = strtok_r(NULL, ",", &save))
+                found = strcmp(tok, controller) == 0;
+        if (found)
+            snprintf(path, len, "%s", cg + strspn(cg, "/"));
+    }
+    fclose(fp);
+
+    if (!found)
+        errno = ENOENT;
+    return found ? 0 : -1;
+}
+
 int cg_write_intlist(const char *root,
                      const char *controller,
                      const char *path,
                      const char *param,
                      int *values, int length) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s/%s", root, controller, path, param);
+    cg_path(file_path, sizeof file_path, root, controller, path, param);
 
     FILE *fp = fopen(file_path, "w");
     int err = 0;
@@ -62,7 +260,7 @@ int cg_write_string(const char *root,
                     const char *path,
                     const char *param, const char *fmt, ...) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s/%s", root, controller, path, param);
+    cg_path(file_path, sizeof file_path, root, controller, path, param);
     va_list args;
 
     FILE *fp = fopen(file_path, "w");
@@ -88,7 +286,7 @@ int cg_write_bool(const char *root,
                   const char *path,
                   const char *param, bool value) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s/%s", root, controller, path, param);
+    cg_path(file_path, sizeof file_path, root, controller, path, param);
 
     FILE *fp = fopen(file_path, "w");
     int err = 0;
@@ -111,7 +309,7 @@ int cg_read_int(const char *root,
                 const char *path,
                 const char *param, int *value_in) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s/%s", root, controller, path, param);
+    cg_path(file_path, sizeof file_path, root, controller, path, param);
 
     FILE *fp = fopen(file_path, "r");
     int err = 0;
@@ -134,7 +332,7 @@ int cg_read_string(const char *root,
                    const char *path,
                    const char *param, char **value_in) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s/%s", root, controller, path, param);
+    cg_path(file_path, sizeof file_path, root, controller, path, param);
 
     FILE *fp = fopen(file_path, "r");
     int err = 0;
@@ -157,7 +355,7 @@ int cg_read_intlist(const char *root,
                     const char *path,
                     const char *param, int **value_in, size_t *length_in) {
     char file_path[256];
-    snprintf(file_path, sizeof file_path, "%s/%s/%s/%s", root, controller, path, param);
+    cg_path(file_path, sizeof file_path, root, controller, path, param);
 
     FILE *fp = fopen(file_path, "r");
     int err = 0;
@@ -180,3 +378,55 @@ int cg_read_intlist(const char *root,
     return errno ? -1 : 0;
 }
 
+
+int cg_open(const char *root,
+            const char *controller,
+            const char *path,
+            const char *param, int flags) {
+    char file_path[256];
+    cg_path(file_path, sizeof file_path, root, controller, path, param);
+
+    return open(file_path, flags | O_CLOEXEC);
+}
+
+int cg_pwrite_cpus(int fd, const cpu_set_t *set, int num_cpus) {
+    char buf[CG_CPUS_BUFLEN];
+    int len = cpuset_to_string(set, num_cpus, buf, sizeof buf);
+
+    if (len < 0)
+        return -1;
+    /* the kernel takes an empty write as "no CPUs", so send a newline */
+    if (len == 0)
+        buf[len++] = '\n';
+    ssize_t n = pwrite(fd, buf, len, 0);
+
+    if (n != len) {
+        if (n >= 0)
+            errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+int cg_pread_cpus(int fd, cpu_set_t *set, int num_cpus) {
+    char buf[CG_CPUS_BUFLEN];
+    ssize_t len = pread(fd, buf, sizeof buf - 1, 0);
+
+    if (len < 0)
+        return -1;
+    buf[len] = '\0';
+    return string_to_cpuset(buf, set, num_cpus);
+}
+
+int cg_pwrite_int(int fd, long value) {
+    char buf[24];
+    int len = snprintf(buf, sizeof buf, "%ld", value);
+    ssize_t n = pwrite(fd, buf, len, 0);
+
+    if (n != len) {
+        if (n >= 0)
+            errno = EIO;
+        return -1;
+    }
+    return 0;
+}
@@ -3,11 +3,62 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/types.h>
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
 
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
+/*
+ * A controller is either mounted as a v1 hierarchy of its own, at
+ * root/controller, or enabled on the v2 (unified) hierarchy mounted at root,
+ * which all controllers share. The functions here take the root and the
+ * controller either way, and build paths for the version cg_detect() found;
+ * until it is called they assume v1.
+ */
+enum cg_version {
+    CG_V1 = 1,
+    CG_V2 = 2,
+};
+
+/**
+ * Find out which hierarchy @controller is on under @root. A v1 hierarchy of
+ * its own wins over the unified one, as on hybrid systems.
+ *
+ * Returns the version, or -1 (with errno set to ENOENT) if the controller is
+ * on neither.
+ */
+int cg_detect(const char *root, const char *controller);
+
+enum cg_version cg_version(void);
+
+/**
+ * The file that tasks are moved into a cgroup by: "tasks" on v1, which takes
+ * threads, and "cgroup.procs" on v2, which moves the whole process of the
+ * thread written to it.
+ */
+const char *cg_procs_param(void);
+
+/**
+ * The file to read instead of cpuset.cpus or cpuset.mems (@param) for the
+ * CPUs or nodes a cgroup actually has. On v2 those of a cgroup are empty
+ * until written, and the root cgroup has none, so this is the
+ * ".effective" file; on v1 it is @param itself.
+ */
+const char *cg_effective_param(const char *param);
+
+/**
+ * Make @controller's files appear in the children of cgroup @path, by
+ * writing it to the cgroup.subtree_control of @path. Does nothing on v1.
+ */
+int cg_enable_controller(const char *root,
+                         const char *controller,
+                         const char *path);
+
 int cg_create_cgroup(const char *root,
                      const char *controller,
                      const char *path);
@@ -16,6 +67,47 @@ int cg_remove_cgroup(const char *root,
                      const char *controller,
                      const char *path);
 
+/**
+ * Give cgroup @path the CPUs and memory nodes that cgroup @parent has, as
+ * a cpuset cgroup must have some before tasks can join it.
+ */
+int cg_inherit_cpuset(const char *root,
+                      const char *controller,
+                      const char *parent,
+                      const char *path);
+
+/**
+ * Make cgroup @path a cpuset partition of @type ("member", "root" or
+ * "isolated") on v2, and read back what the kernel made of it into @state,
+ * of @len bytes.
+ *
+ * Returns 0, or -1 (with errno set): EOPNOTSUPP on v1, and EINVAL with the
+ * kernel's reason in @state if the partition is not valid, as when its CPUs
+ * are not exclusive or would leave the parent none.
+ */
+int cg_set_partition(const char *root,
+                     const char *controller,
+                     const char *path,
+                     const char *type, char *state, size_t len);
+
+/**
+ * Whether any task is in cgroup @path or below it.
+ *
+ * Returns 1 or 0, or -1 (with errno set) if it cannot be told.
+ */
+int cg_populated(const char *root,
+                 const char *controller,
+                 const char *path);
+
+/**
+ * Find the cgroup that process @pid is in on @controller's hierarchy, as a
+ * path under the root of the hierarchy ("sam/app-1234") into @path, of
+ * @len bytes.
+ *
+ * Returns 0, or -1 (with errno set) if @pid or the hierarchy is not there.
+ */
+int cg_find(pid_t pid, const char *controller, char *path, size_t len);
+
 int cg_write_intlist(const char *root,
                      const char *controller,
                      const char *path,
@@ -48,6 +140,44 @@ int cg_read_intlist(const char *root,
                     const char *path,
                     const char *param, int **value_in, size_t *length_in);
 
+/*
+ * The daemon writes the same few files of every application's cgroup each
+ * window, so it keeps them open and uses these instead, which neither build
+ * paths nor go through stdio: each is one pread() or pwrite().
+ */
+
+/* a list of ranges of up to 1024 CPUs, at worst every other CPU */
+#define CG_CPUS_BUFLEN 8192
+
+/**
+ * Open control file @param of cgroup @path with @flags (O_RDONLY, O_WRONLY
+ * or O_RDWR). It is closed on exec.
+ *
+ * Returns the file descriptor, or -1 (with errno set).
+ */
+int cg_open(const char *root,
+            const char *controller,
+            const char *path,
+            const char *param, int flags);
+
+/**
+ * Write the CPUs of @set, of @num_cpus, to the cpuset.cpus file open as @fd,
+ * as a list of ranges ("0-19,40-59").
+ */
+int cg_pwrite_cpus(int fd, const cpu_set_t *set, int num_cpus);
+
+/**
+ * Read the cpuset.cpus file open as @fd into @set, of @num_cpus.
+ *
+ * Returns the number of CPUs in @set, or -1 (with errno set).
+ */
+int cg_pread_cpus(int fd, cpu_set_t *set, int num_cpus);
+
+/**
+ * Write @value to the file open as @fd, e.g. a task to cg_procs_param().
+ */
+int cg_pwrite_int(int fd, long value);
+
 #if defined(__cplusplus)
 };
 #endif
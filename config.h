@@ -1,2 +1,6 @@
 #define SAM_RUN_DIR     "/var/run/sam"
 #define SAM_CGROUP_NAME "sam"
+#define SAM_CGROUP_POOL_PREFIX "pool-"
+#define SAM_CTL_SOCKET  "/var/run/sam.sock"
+#define SAM_METRICS_FILE "/var/run/sam.prom"
+#define SAM_CONFIG_FILE "/etc/sam.conf"
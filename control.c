@@ -0,0 +1,187 @@
+/*
+ * The client side of the control protocol; see control.h. The daemon's side
+ * is in mapper.cpp.
+ */
+#define _GNU_SOURCE
+#include "control.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "config.h"
+
+int sam_ctl_connect(void)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int conn;
+
+    strncpy(addr.sun_path, SAM_CTL_SOCKET, sizeof addr.sun_path - 1);
+
+    if ((conn = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+
+    if (connect(conn, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        int saved_errno = errno;
+
+        close(conn);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return conn;
+}
+
+int sam_ctl_call(int conn,
+                 const struct sam_ctl_request *req,
+                 int pass_fd,
+                 struct sam_ctl_response *resp,
+                 void *payload,
+                 size_t payload_len)
+{
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct sam_ctl_request out = *req;
+    struct iovec iov = { &out, sizeof out };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    char in[SAM_CTL_MAX_MESSAGE];
+    ssize_t len;
+
+    if (pass_fd >= 0) {
+        struct cmsghdr *cmsg;
+
+        memset(&control, 0, sizeof control);
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof control.buf;
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) < 0)
+        return -1;
+
+    if ((len = recv(conn, in, sizeof in, 0)) < 0)
+        return -1;
+    if ((size_t)len < sizeof *resp) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    memcpy(resp, in, sizeof *resp);
+    if (resp->status != 0) {
+        errno = -resp->status;
+        return -1;
+    }
+
+    if (payload && payload_len > 0) {
+        size_t n = (size_t)len - sizeof *resp;
+
+        if (n > resp->length)
+            n = resp->length;
+        if (n > payload_len)
+            n = payload_len;
+        memcpy(payload, in + sizeof *resp, n);
+    }
+
+    return 0;
+}
+
+int sam_ctl_register(int conn, pid_t pid, int pidfd)
+{
+    struct sam_ctl_request req = { SAM_CTL_REGISTER, pid, 0 };
+    struct sam_ctl_response resp;
+
+    return sam_ctl_call(conn, &req, pidfd, &resp, NULL, 0);
+}
+
+int sam_ctl_unregister(int conn, pid_t pid)
+{
+    struct sam_ctl_request req = { SAM_CTL_UNREGISTER, pid, 0 };
+    struct sam_ctl_response resp;
+
+    return sam_ctl_call(conn, &req, -1, &resp, NULL, 0);
+}
+
+int sam_ctl_get_app(int conn, pid_t pid, struct sam_ctl_app *app, char *cpus, size_t cpus_len)
+{
+    struct sam_ctl_request req = { SAM_CTL_GET_APP, pid, 0 };
+    struct sam_ctl_response resp;
+
+    if (cpus_len > 0)
+        memset(cpus, 0, cpus_len);
+    if (sam_ctl_call(conn, &req, -1, &resp, cpus, cpus_len > 0 ? cpus_len - 1 : 0) != 0)
+        return -1;
+
+    *app = resp.app;
+    return 0;
+}
+
+int sam_ctl_get_timings(int conn, struct sam_ctl_timings *timings)
+{
+    struct sam_ctl_request req = { SAM_CTL_GET_TIMINGS, 0, 0 };
+    struct sam_ctl_response resp;
+
+    if (sam_ctl_call(conn, &req, -1, &resp, NULL, 0) != 0)
+        return -1;
+
+    *timings = resp.timings;
+    return 0;
+}
+
+int sam_ctl_get_log_level(int conn)
+{
+    struct sam_ctl_request req = { SAM_CTL_GET_LOG_LEVEL, 0, 0 };
+    struct sam_ctl_response resp;
+
+    if (sam_ctl_call(conn, &req, -1, &resp, NULL, 0) != 0)
+        return -1;
+
+    return resp.level;
+}
+
+int sam_ctl_set_log_level(int conn, int level)
+{
+    struct sam_ctl_request req = { SAM_CTL_SET_LOG_LEVEL, 0, level };
+    struct sam_ctl_response resp;
+
+    return sam_ctl_call(conn, &req, -1, &resp, NULL, 0);
+}
+
+int sam_ctl_get_policy(int conn, char *names, size_t names_len)
+{
+    struct sam_ctl_request req = { SAM_CTL_GET_POLICY, 0, 0 };
+    struct sam_ctl_response resp;
+
+    if (names_len > 0)
+        memset(names, 0, names_len);
+    if (sam_ctl_call(conn, &req, -1, &resp, names, names_len > 0 ? names_len - 1 : 0) != 0)
+        return -1;
+
+    return resp.policy;
+}
+
+int sam_ctl_set_policy(int conn, const char *name)
+{
+    struct sam_ctl_request req = { SAM_CTL_SET_POLICY, 0, -1 };
+    struct sam_ctl_response resp;
+    char names[SAM_CTL_MAX_MESSAGE];
+
+    /* the daemon knows its policies by index */
+    if (sam_ctl_get_policy(conn, names, sizeof names) < 0)
+        return -1;
+    for (size_t off = 0, i = 0; off < sizeof names && names[off]; off += strlen(names + off) + 1, ++i)
+        if (strcmp(names + off, name) == 0)
+            req.arg = i;
+    if (req.arg < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    return sam_ctl_call(conn, &req, -1, &resp, NULL, 0);
+}
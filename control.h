@@ -0,0 +1,173 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * The control protocol. Clients connect to SAM_CTL_SOCKET (a SOCK_SEQPACKET
+ * socket) and send one struct sam_ctl_request per message. The daemon answers
+ * each request, in order, with one struct sam_ctl_response, which may be
+ * followed by a payload in the same message.
+ */
+
+enum sam_ctl_op {
+    /**
+     * Manage application @pid. The request may carry a pidfd for it in an
+     * SCM_RIGHTS message, so that the daemon cannot mistake a reused PID
+     * for the application. Only root and the owner of @pid may do this.
+     */
+    SAM_CTL_REGISTER = 1,
+    /**
+     * Stop managing application @pid, and remove its entry in SAM_RUN_DIR
+     * if it has one. Only root and the owner of @pid may do this.
+     */
+    SAM_CTL_UNREGISTER,
+    /**
+     * Get struct sam_ctl_app for application @pid, or for the application
+     * that thread @pid belongs to. The payload is the application's CPUs as
+     * a NUL-terminated list, e.g. "0-3,8".
+     */
+    SAM_CTL_GET_APP,
+    /**
+     * Get struct sam_ctl_timings for the last window.
+     */
+    SAM_CTL_GET_TIMINGS,
+    /**
+     * Get the log level, in @level.
+     */
+    SAM_CTL_GET_LOG_LEVEL,
+    /**
+     * Set the log level to @arg (enum log_level). Only root may do this.
+     */
+    SAM_CTL_SET_LOG_LEVEL,
+    /**
+     * Get the index of the allocation policy in use, in @policy. The payload
+     * is the names of all policies, in index order, each NUL-terminated.
+     */
+    SAM_CTL_GET_POLICY,
+    /**
+     * Switch to the allocation policy at index @arg from the next window.
+     * Only root may do this.
+     */
+    SAM_CTL_SET_POLICY,
+};
+
+struct sam_ctl_request {
+    uint32_t op;
+    int32_t pid;
+    int32_t arg;
+};
+
+#define SAM_CTL_N_METRICS   5
+
+struct sam_ctl_app {
+    int32_t pid;
+    int32_t num_threads;
+    int32_t num_cpus;
+    /* enum metric */
+    int32_t bottleneck;
+    /* the number of threads that hit each bottleneck over the last window */
+    uint64_t bottlenecks[SAM_CTL_N_METRICS];
+    /* instructions per second over the last window */
+    uint64_t ips;
+};
+
+/*
+ * The duration of each phase of the last window, in nanoseconds, as in the
+ * daemon's "Elapsed time" report.
+ */
+struct sam_ctl_timings {
+    uint64_t window;        /* sequence number */
+    uint64_t sleep;
+    uint64_t discovery;
+    uint64_t perf;
+    uint64_t setup;
+    uint64_t read;
+    uint64_t scheduler;
+    uint64_t cgroups;
+    uint64_t total;
+    /* the cpusets written, which is only those that changed */
+    uint64_t cpuset_writes;
+};
+
+struct sam_ctl_response {
+    /* 0, or a negated errno value */
+    int32_t status;
+    /* the size of the payload that follows */
+    uint32_t length;
+    union {
+        struct sam_ctl_app app;
+        struct sam_ctl_timings timings;
+        int32_t level;
+        int32_t policy;
+    };
+};
+
+/* the largest message either side sends */
+#define SAM_CTL_MAX_MESSAGE 8192
+
+/**
+ * Connect to the daemon.
+ *
+ * Returns the connection, or -1 with errno set (e.g. ENOENT or ECONNREFUSED
+ * if the daemon is not running).
+ */
+int sam_ctl_connect(void);
+
+/**
+ * Send @req, with @pass_fd attached unless it is negative, and wait for the
+ * response. Up to @payload_len bytes of the payload are copied to @payload.
+ *
+ * Returns 0 on success, or -1 with errno set, either by the failed call or
+ * from the response's status.
+ */
+int sam_ctl_call(int conn,
+                 const struct sam_ctl_request *req,
+                 int pass_fd,
+                 struct sam_ctl_response *resp,
+                 void *payload,
+                 size_t payload_len);
+
+/**
+ * Register application @pid, which @pidfd refers to (or -1).
+ */
+int sam_ctl_register(int conn, pid_t pid, int pidfd);
+
+int sam_ctl_unregister(int conn, pid_t pid);
+
+/**
+ * Get application @pid's state and, in @cpus, its CPUs.
+ */
+int sam_ctl_get_app(int conn, pid_t pid, struct sam_ctl_app *app, char *cpus, size_t cpus_len);
+
+int sam_ctl_get_timings(int conn, struct sam_ctl_timings *timings);
+
+/**
+ * Returns the log level, or -1 with errno set.
+ */
+int sam_ctl_get_log_level(int conn);
+
+int sam_ctl_set_log_level(int conn, int level);
+
+/**
+ * Returns the index of the policy in use, or -1 with errno set. The names of
+ * all policies are copied to @names, as NUL-terminated strings one after
+ * another, up to @names_len bytes.
+ */
+int sam_ctl_get_policy(int conn, char *names, size_t names_len);
+
+/**
+ * Switch to the policy called @name.
+ */
+int sam_ctl_set_policy(int conn, const char *name);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* CONTROL_H */
@@ -1,4 +1,5 @@
 #include "cpuinfo.h"
+#include <dirent.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,11 +7,15 @@
 #include <sys/sysinfo.h> /* for get_nprocs() */
 #include <stdbool.h>
 
+#include "util.h"
+
 #define MAX_CPUS 1024
 
 const struct cpu *get_cpu(int i) {
   static struct cpu info;
   FILE *fp = NULL;
+  DIR *dir = NULL;
+  struct dirent *de;
   char path[1024];
 
   info.tnumber = i;
@@ -34,9 +39,36 @@ const struct cpu *get_cpu(int i) {
     return NULL;
   }
 
+  /* the CPU's directory links to its node as nodeN; there is none without NUMA */
+  info.node_id = 0;
+  snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", i);
+  if ((dir = opendir(path))) {
+    while ((de = readdir(dir)) && sscanf(de->d_name, "node%d", &info.node_id) != 1)
+      ;
+    closedir(dir);
+  }
+
   return &info;
 }
 
+/* number of CPUs listed in a sysfs cpu list file, or 0 */
+static int count_cpu_list(const char *path) {
+  FILE *fp = NULL;
+  char *line = NULL;
+  size_t sz = 0;
+  int *list = NULL;
+  size_t list_l = 0;
+
+  if (!(fp = fopen(path, "r")))
+    return 0;
+  if (getline(&line, &sz, fp) > 0 && string_to_intlist(line, &list, &list_l) != 0)
+    list_l = 0;
+  free(line);
+  free(list);
+  fclose(fp);
+  return list_l;
+}
+
 struct cpuinfo *get_cpuinfo(void) {
   const struct cpu *ci;
   int num_cpus = 0;
@@ -44,6 +76,7 @@ struct cpuinfo *get_cpuinfo(void) {
   struct cpu cpus[MAX_CPUS];
   struct cpu_socket sockets[MAX_CPUS];
   int num_sockets = 0;
+  int num_nodes = 0;
   int num_cores = 0;
 
   if (nprocs > MAX_CPUS) {
@@ -64,19 +97,29 @@ struct cpuinfo *get_cpuinfo(void) {
     // int sock_cpus = sockets[cpus[i].sock_id].num_cpus;
     sockets[cpus[i].sock_id].num_cpus++;
     num_sockets = cpus[i].sock_id > num_sockets ? cpus[i].sock_id : num_sockets;
+    num_nodes = cpus[i].node_id > num_nodes ? cpus[i].node_id : num_nodes;
     num_cores = cpus[i].core_id > num_cores ? cpus[i].core_id : num_cores;
   }
 
   num_sockets++;
+  num_nodes++;
   num_cores++;
 
   struct cpuinfo *cpuinfo = (struct cpuinfo*) malloc(sizeof *cpuinfo);
 
   cpuinfo->sockets = (struct cpu_socket*) calloc(num_sockets, sizeof cpuinfo->sockets[0]);
   cpuinfo->num_sockets = num_sockets;
+  cpuinfo->num_nodes = num_nodes;
   cpuinfo->total_cpus = num_cpus;
   cpuinfo->total_cores = num_cores;
 
+  cpuinfo->cpus_per_core = count_cpu_list("/sys/devices/system/cpu/cpu0/topology/thread_siblings_list");
+  if (cpuinfo->cpus_per_core <= 0)
+    cpuinfo->cpus_per_core = 1;
+  cpuinfo->cpus_per_l3 = count_cpu_list("/sys/devices/system/cpu/cpu0/cache/index3/shared_cpu_list");
+  if (cpuinfo->cpus_per_l3 <= 0)
+    cpuinfo->cpus_per_l3 = sockets[cpus[0].sock_id].num_cpus;
+
   for (int i = 0; i < num_cpus; ++i) {
     if (cpuinfo->sockets[cpus[i].sock_id].cpus == NULL) {
       cpuinfo->sockets[cpus[i].sock_id].cpus =
@@ -115,3 +158,43 @@ struct cpuinfo *get_cpuinfo(void) {
 
   return cpuinfo;
 }
+
+struct cpuinfo *make_cpuinfo(int num_sockets, int cpus_per_socket, int cpus_per_core, unsigned long clock_rate) {
+  const int cores_per_socket = cpus_per_socket / cpus_per_core;
+  const int total_cores = num_sockets * cores_per_socket;
+  struct cpuinfo *cpuinfo;
+
+  if (num_sockets < 1 || cpus_per_core < 1 || cores_per_socket < 1 || cpus_per_socket % cpus_per_core != 0 ||
+      num_sockets * cpus_per_socket > MAX_CPUS) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  cpuinfo = (struct cpuinfo*) malloc(sizeof *cpuinfo);
+  cpuinfo->sockets = (struct cpu_socket*) calloc(num_sockets, sizeof cpuinfo->sockets[0]);
+  cpuinfo->num_sockets = num_sockets;
+  cpuinfo->num_nodes = num_sockets;
+  cpuinfo->total_cpus = num_sockets * cpus_per_socket;
+  cpuinfo->total_cores = total_cores;
+  cpuinfo->cpus_per_core = cpus_per_core;
+  cpuinfo->cpus_per_l3 = cpus_per_socket;
+  cpuinfo->clock_rate = clock_rate;
+
+  /* as Linux numbers them: the first thread of every core, then the second... */
+  for (int s = 0; s < num_sockets; ++s) {
+    cpuinfo->sockets[s].cpus = (struct cpu*) calloc(cpus_per_socket, sizeof cpuinfo->sockets[s].cpus[0]);
+    cpuinfo->sockets[s].num_cpus = cpus_per_socket;
+    for (int t = 0; t < cpus_per_core; ++t) {
+      for (int c = 0; c < cores_per_socket; ++c) {
+        struct cpu *cpu = &cpuinfo->sockets[s].cpus[t * cores_per_socket + c];
+
+        cpu->core_id = s * cores_per_socket + c;
+        cpu->sock_id = s;
+        cpu->node_id = s;
+        cpu->tnumber = t * total_cores + cpu->core_id;
+      }
+    }
+  }
+
+  return cpuinfo;
+}
@@ -9,14 +9,18 @@ struct cpu_socket {
 struct cpu {
   int core_id;
   int sock_id;
+  int node_id; // NUMA node
   int tnumber; // thread number
 };
 
 struct cpuinfo {
   struct cpu_socket *sockets;
   int num_sockets;
+  int num_nodes;
   int total_cpus;
   int total_cores;
+  int cpus_per_core; // hardware threads sharing a core
+  int cpus_per_l3;   // hardware threads sharing a last-level cache
   unsigned long clock_rate;
 };
 
@@ -26,6 +30,14 @@ extern "C" {
 
 struct cpuinfo *get_cpuinfo(void);
 
+/**
+ * Describe a machine of @num_sockets sockets of @cpus_per_socket CPUs each,
+ * @cpus_per_core to a core and a NUMA node to a socket, that need not be this
+ * one, e.g. to simulate or benchmark the schedulers. Returns NULL with errno set to EINVAL if the
+ * shape is impossible.
+ */
+struct cpuinfo *make_cpuinfo(int num_sockets, int cpus_per_socket, int cpus_per_core, unsigned long clock_rate);
+
 #if defined(__cplusplus)
 };
 #endif
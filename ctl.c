@@ -0,0 +1,143 @@
+/*
+ * sam-ctl: query and configure a running daemon through its control socket.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "control.h"
+#include "log.h"
+#include "util.h"
+
+static const char *bottleneck_names[SAM_CTL_N_METRICS] = {
+    "active", "ipc", "memory", "intra-socket", "inter-socket",
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s register PID\n"
+            "       %s unregister PID\n"
+            "       %s app PID\n"
+            "       %s timings\n"
+            "       %s log-level [off|error|warn|info|debug|trace]\n"
+            "       %s policy [NAME]\n",
+            prog, prog, prog, prog, prog, prog);
+}
+
+static int print_app(int conn, pid_t pid)
+{
+    struct sam_ctl_app app;
+    char cpus[SAM_CTL_MAX_MESSAGE];
+
+    if (sam_ctl_get_app(conn, pid, &app, cpus, sizeof cpus) != 0)
+        return -1;
+
+    printf("application %d\n", app.pid);
+    printf("  threads     %d\n", app.num_threads);
+    printf("  cpus        %s (%d)\n", cpus, app.num_cpus);
+    printf("  bottleneck  %s\n",
+           app.bottleneck >= 0 && app.bottleneck < SAM_CTL_N_METRICS ? bottleneck_names[app.bottleneck] : "?");
+    printf("  bottlenecks");
+    for (int i = 0; i < SAM_CTL_N_METRICS; ++i)
+        printf(" %" PRIu64, app.bottlenecks[i]);
+    printf("\n  ips         %" PRIu64 "\n", app.ips);
+    return 0;
+}
+
+static int print_timings(int conn)
+{
+    struct sam_ctl_timings t;
+
+    if (sam_ctl_get_timings(conn, &t) != 0)
+        return -1;
+
+    printf("window %" PRIu64 " (seconds):\n", t.window);
+    printf("  sleep     %.7f\n", t.sleep / 1e9);
+    printf("  discovery %.7f\n", t.discovery / 1e9);
+    printf("  perf      %.7f\n", t.perf / 1e9);
+    printf("    setup   %.7f\n", t.setup / 1e9);
+    printf("    read    %.7f\n", t.read / 1e9);
+    printf("  scheduler %.7f\n", t.scheduler / 1e9);
+    printf("  cgroups   %.7f (%" PRIu64 " cpusets written)\n", t.cgroups / 1e9, t.cpuset_writes);
+    printf("  total     %.7f\n", t.total / 1e9);
+    return 0;
+}
+
+/* list the policies, marking the one in use */
+static int print_policies(int conn)
+{
+    char names[SAM_CTL_MAX_MESSAGE];
+    int current;
+
+    if ((current = sam_ctl_get_policy(conn, names, sizeof names)) < 0)
+        return -1;
+
+    for (size_t off = 0, i = 0; off < sizeof names && names[off]; off += strlen(names + off) + 1, ++i)
+        printf("%c %s\n", (int)i == current ? '*' : ' ', names + off);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int conn;
+    int ret = 0;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if ((conn = sam_ctl_connect()) < 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", SAM_CTL_SOCKET, strerror(errno));
+        return 1;
+    }
+
+    if (strcmp(argv[1], "register") == 0 && argc == 3) {
+        pid_t pid = atoi(argv[2]);
+        int pidfd = sys_pidfd_open(pid, 0);
+
+        ret = sam_ctl_register(conn, pid, pidfd);
+        if (pidfd >= 0)
+            close(pidfd);
+    } else if (strcmp(argv[1], "unregister") == 0 && argc == 3)
+        ret = sam_ctl_unregister(conn, atoi(argv[2]));
+    else if (strcmp(argv[1], "app") == 0 && argc == 3)
+        ret = print_app(conn, atoi(argv[2]));
+    else if (strcmp(argv[1], "timings") == 0 && argc == 2)
+        ret = print_timings(conn);
+    else if (strcmp(argv[1], "log-level") == 0 && argc == 2) {
+        int level = sam_ctl_get_log_level(conn);
+
+        if ((ret = level < 0 ? -1 : 0) == 0)
+            printf("%s\n", log_level_name((enum log_level)level));
+    } else if (strcmp(argv[1], "log-level") == 0 && argc == 3) {
+        int level = log_level_from_string(argv[2]);
+
+        if (level < 0) {
+            fprintf(stderr, "Unknown log level '%s'\n", argv[2]);
+            close(conn);
+            return 1;
+        }
+        ret = sam_ctl_set_log_level(conn, level);
+    } else if (strcmp(argv[1], "policy") == 0 && argc == 2)
+        ret = print_policies(conn);
+    else if (strcmp(argv[1], "policy") == 0 && argc == 3)
+        ret = sam_ctl_set_policy(conn, argv[2]);
+    else {
+        usage(argv[0]);
+        close(conn);
+        return 1;
+    }
+
+    if (ret != 0)
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+
+    close(conn);
+    return ret != 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <dirent.h>
 #include <err.h>
 #include <errno.h>
@@ -6,20 +7,26 @@
 #include <locale.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h> // For random().
 #include <stdlib.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/shm.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <linux/sched.h>
 
 #include "config.h"
 #include "cgroup.h"
+#include "control.h"
+#include "util.h"
 
 const char *cgroup_root = "/sys/fs/cgroup";
 const char *controller = "cpuset";
@@ -33,12 +40,137 @@ void handle_quit(int sig) {
     kill(initial_pid, SIGKILL);
 }
 
+/**
+ * Claim one of the cgroups that samd keeps ready under SAM_CGROUP_NAME, by
+ * locking it, and set cg_name to it. A cgroup that is locked belongs to
+ * another launcher, or is being removed by samd, and one with tasks in it
+ * to an application whose launcher has gone.
+ *
+ * Returns the cgroup's directory, open and locked until it is closed, or -1
+ * if none is free.
+ */
+static int claim_pooled_cgroup(void)
+{
+    struct dirent *ent;
+    DIR *dir;
+    int fd = -1;
+    int dir_fd;
+
+    if ((dir_fd = cg_open(cgroup_root, controller, SAM_CGROUP_NAME, NULL, O_RDONLY | O_DIRECTORY)) < 0)
+        return -1;
+    if (!(dir = fdopendir(dir_fd))) {
+        close(dir_fd);
+        return -1;
+    }
+    while (fd < 0 && (ent = readdir(dir))) {
+        if (strncmp(ent->d_name, SAM_CGROUP_POOL_PREFIX, strlen(SAM_CGROUP_POOL_PREFIX)) != 0)
+            continue;
+        snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/%s", ent->d_name);
+        if ((fd = openat(dir_fd, ent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+            continue;
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0 || cg_populated(cgroup_root, controller, cg_name) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    closedir(dir);
+    return fd;
+}
+
+/**
+ * Create a cgroup of our own, as the launcher did before samd kept any
+ * ready, and set cg_name to it.
+ *
+ * Returns the cgroup's directory, open, or -1 (with errno set).
+ */
+static int create_cgroup(void)
+{
+    int fd;
+
+    snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/launch-%d", getpid());
+    if (cg_create_cgroup(cgroup_root, controller, cg_name) != 0)
+        return -1;
+    if (cg_inherit_cpuset(cgroup_root, controller, SAM_CGROUP_NAME, cg_name) != 0 ||
+        (fd = cg_open(cgroup_root, controller, cg_name, NULL, O_RDONLY | O_DIRECTORY)) < 0) {
+        int err = errno;
+
+        cg_remove_cgroup(cgroup_root, controller, cg_name);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static void exec_command(char *argv[])
+{
+    execvp(argv[0], argv);
+    fprintf(stderr, "Could not run %s: %s\n", argv[0], strerror(errno));
+    _exit(1);
+}
+
+/**
+ * Start the command in @argv in cg_name, open as @cg_fd, so that none of its
+ * threads ever runs outside it. On v2, clone3() creates the child there;
+ * otherwise the child waits on a pipe until it has been moved.
+ *
+ * Returns the child's pid, or -1 (with errno set).
+ */
+static pid_t spawn_in_cgroup(int cg_fd, char *argv[])
+{
+    int hold[2];
+    pid_t pid;
+    char go = 0;
+
+    if (cg_version() == CG_V2) {
+        struct clone_args args;
+
+        memset(&args, 0, sizeof args);
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = cg_fd;
+        if ((pid = syscall(SYS_clone3, &args, sizeof args)) == 0)
+            exec_command(argv);
+        if (pid > 0)
+            return pid;
+        /* CLONE_INTO_CGROUP is from Linux 5.7 */
+        if (errno != ENOSYS && errno != E2BIG && errno != EINVAL)
+            return -1;
+    }
+
+    if (pipe2(hold, O_CLOEXEC) != 0)
+        return -1;
+    if ((pid = fork()) == 0) {
+        close(hold[1]);
+        /* the pipe is closed without a byte if we could not be moved */
+        if (read(hold[0], &go, 1) != 1)
+            _exit(1);
+        exec_command(argv);
+    }
+    close(hold[0]);
+    if (pid < 0 || cg_write_string(cgroup_root, controller, cg_name, cg_procs_param(), "%d", pid) != 0 ||
+        write(hold[1], &go, 1) != 1) {
+        int err = errno;
+
+        close(hold[1]);
+        if (pid > 0)
+            waitpid(pid, NULL, 0);
+        errno = err;
+        return -1;
+    }
+    close(hold[1]);
+    return pid;
+}
+
 int main(int argc, char *argv[])
 {
     char cmdbuf[1024];
     int p = 0;
     int childret = 0;
     int childsig = 0;
+    char app_path[1024] = "";
+    int conn = -1;
+    bool pooled;
+    int cg_fd;
 
     if (argc < 2) {
         fprintf(stderr, "usage: %s program [arguments]\n", argv[0]);
@@ -50,89 +182,102 @@ int main(int argc, char *argv[])
     }
 
     printf("Command to be executed: %s\n", cmdbuf);
+    fflush(stdout);
 
-    initial_pid = fork();
+    if (cg_detect(cgroup_root, controller) < 0) {
+        fprintf(stderr, "There is no %s controller under %s\n", controller, cgroup_root);
+        return 1;
+    }
 
-    if (initial_pid == (pid_t) -1) {
-        perror("fork()");
+    /* a cgroup from samd's pool is ready to go; otherwise make one */
+    pooled = (cg_fd = claim_pooled_cgroup()) >= 0;
+    if (!pooled && (cg_fd = create_cgroup()) < 0) {
+        fprintf(stderr, "Failed to create/establish cgroup %s: %s\n", cg_name, strerror(errno));
         return 1;
     }
 
-    if (initial_pid == 0) {
-        /* Now launch the command from this process */
-        if (execvp(argv[1], &argv[1]) < 0) {
-            fprintf(stderr, "Could not run %s: %s\n", argv[1], strerror(errno));
-            return 1;
+    initial_pid = spawn_in_cgroup(cg_fd, &argv[1]);
+    if (initial_pid < 0 && pooled) {
+        /* samd removes the cgroups it keeps when it stops */
+        close(cg_fd);
+        if ((cg_fd = create_cgroup()) >= 0)
+            initial_pid = spawn_in_cgroup(cg_fd, &argv[1]);
+    }
+    if (initial_pid < 0) {
+        fprintf(stderr, "Failed to start %s in cgroup %s: %s\n", argv[1], cg_name, strerror(errno));
+        if (cg_fd >= 0) {
+            cg_remove_cgroup(cgroup_root, controller, cg_name);
+            close(cg_fd);
         }
-        return 0;
-    } else if (initial_pid > 0) {
-        char app_path[1024];
+        return 1;
+    }
+
+    /*
+     * Register with the daemon, now that the cgroup exists. If the daemon
+     * is not running yet, leave an entry in the run directory for it.
+     */
+    if ((conn = sam_ctl_connect()) >= 0) {
+        int pidfd = sys_pidfd_open(initial_pid, 0);
+
+        if (sam_ctl_register(conn, initial_pid, pidfd) != 0 && errno != ESRCH)
+            fprintf(stderr, "Failed to register process %d: %s\n", initial_pid, strerror(errno));
+        if (pidfd >= 0)
+            close(pidfd);
+    } else {
         snprintf(app_path, sizeof app_path, SAM_RUN_DIR "/%d", initial_pid);
 
         if (mkdir(app_path, 0) < 0 && errno != EEXIST) {
             fprintf(stderr, "Failed to create %s: %s\n", app_path, strerror(errno));
             kill(initial_pid, SIGKILL);
             waitpid(initial_pid, NULL, 0);
+            cg_remove_cgroup(cgroup_root, controller, cg_name);
+            close(cg_fd);
             return 1;
         }
+    }
 
-        snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/app-%d", initial_pid);
-        char *mems_string = NULL;
-        char *cpus_string = NULL;
-
-        if (cg_create_cgroup(cgroup_root, controller, cg_name) != 0 
-         || cg_read_string(cgroup_root, controller, SAM_CGROUP_NAME, "cpuset.mems", &mems_string) != 0
-         || cg_write_string(cgroup_root, controller, cg_name, "cpuset.mems", "%s", mems_string) != 0 
-         || cg_read_string(cgroup_root, controller, SAM_CGROUP_NAME, "cpuset.cpus", &cpus_string) != 0 
-         || cg_write_string(cgroup_root, controller, cg_name, "cpuset.cpus", "%s", cpus_string) != 0
-         || cg_write_string(cgroup_root, controller, cg_name, "tasks", "%d", initial_pid) != 0) {
-            fprintf(stderr, "Failed to create/establish cgroup for process %d: %s\n", 
-                    initial_pid,
-                    strerror(errno));
-            kill(initial_pid, SIGKILL);
-            waitpid(initial_pid, NULL, 0);
-            return 1;
-        }
+    signal(SIGTERM, &handle_quit);
+    signal(SIGQUIT, &handle_quit);
+    signal(SIGINT, &handle_quit);
 
-        free(mems_string);
-        free(cpus_string);
-
-        signal(SIGTERM, &handle_quit);
-        signal(SIGQUIT, &handle_quit);
-        signal(SIGINT, &handle_quit);
-
-        /* Wait and exit */
-        int timeouttokill = 3600;
-        int waited = 0;
-        int status, wpid;
-        do {
-            wpid = waitpid(initial_pid, &status, WNOHANG);
-            if (wpid == 0) {
-                if (waited < timeouttokill) {
-                    sleep(1);
-                    waited++;
-                } else {
-                    printf("Killing process %d \n", initial_pid);
-                    kill(initial_pid, SIGKILL);
-                }
+    /* Wait and exit */
+    int timeouttokill = 3600;
+    int waited = 0;
+    int status, wpid;
+    do {
+        wpid = waitpid(initial_pid, &status, WNOHANG);
+        if (wpid == 0) {
+            if (waited < timeouttokill) {
+                sleep(1);
+                waited++;
+            } else {
+                printf("Killing process %d \n", initial_pid);
+                kill(initial_pid, SIGKILL);
             }
-        } while (wpid == 0 && waited < timeouttokill);
-
-        if (WIFEXITED(status)) {
-            childret = WEXITSTATUS(status);
-            printf("Child exited, status=%d\n", childret);
-        } else if (WIFSIGNALED(status)) {
-            childsig = WTERMSIG(status);
-            printf("Child %d was terminated with a status of: %d \n", 
-                    initial_pid, childsig);
         }
+    } while (wpid == 0 && waited < timeouttokill);
 
-        if (rmdir(app_path) != 0) {
-            fprintf(stderr, "Failed to remove %s: %s\n", app_path, strerror(errno));
-        }
-        if (cg_remove_cgroup(cgroup_root, controller, cg_name) != 0)
-            perror("Failed to remove cgroup");
+    if (WIFEXITED(status)) {
+        childret = WEXITSTATUS(status);
+        printf("Child exited, status=%d\n", childret);
+    } else if (WIFSIGNALED(status)) {
+        childsig = WTERMSIG(status);
+        printf("Child %d was terminated with a status of: %d \n", 
+                initial_pid, childsig);
+    }
+
+    if (conn >= 0) {
+        /* the daemon has usually noticed the exit already */
+        if (sam_ctl_unregister(conn, initial_pid) != 0 && errno != ENOENT && errno != ESRCH)
+            fprintf(stderr, "Failed to unregister process %d: %s\n", initial_pid, strerror(errno));
+        close(conn);
+    } else if (rmdir(app_path) != 0 && errno != ENOENT) {
+        fprintf(stderr, "Failed to remove %s: %s\n", app_path, strerror(errno));
     }
+    /* the cgroup goes before the lock on it, so no launcher claims it again */
+    if (cg_remove_cgroup(cgroup_root, controller, cg_name) != 0)
+        perror("Failed to remove cgroup");
+    close(cg_fd);
 
     if (childsig)
         raise(childsig);
@@ -0,0 +1,471 @@
+/*
+ * Asynchronous logging; see log.h.
+ *
+ * Records are captured by walking the format string at the call site and
+ * storing each argument as a 64-bit value (or, for %s, a copy of the string),
+ * which is much cheaper than formatting. The background thread walks the
+ * format string again and formats one conversion at a time.
+ *
+ * The ring is a bounded multi-producer, single-consumer queue: producers claim
+ * a slot by advancing head with a compare-and-swap, and each slot's sequence
+ * number says whether it is free, being written, or ready to be consumed.
+ */
+#define _GNU_SOURCE
+#include "log.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_RING_SIZE   1024    /* must be a power of 2 */
+#define LOG_MAX_ARGS    12
+#define LOG_STR_BYTES   512
+#define LOG_IDLE_NS     5000000
+
+enum log_arg_type {
+    ARG_INT,
+    ARG_UINT,
+    ARG_DOUBLE,
+    ARG_CHAR,
+    ARG_STR,
+    ARG_PTR,
+};
+
+union log_arg {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void *p;
+    size_t str;         /* offset into log_record::strs */
+};
+
+struct log_record {
+    const char *fmt;
+    uint8_t level;
+    uint8_t nargs;
+    uint16_t strs_used;
+    union log_arg args[LOG_MAX_ARGS];
+    char strs[LOG_STR_BYTES];
+};
+
+struct log_slot {
+    uint64_t seq;
+    struct log_record rec;
+};
+
+/*
+ * One conversion specification in a format string.
+ */
+struct log_conv {
+    const char *start;      /* the '%' */
+    const char *prefix_end; /* end of flags, width and precision */
+    const char *end;        /* one past the conversion character */
+    bool star_width;
+    bool star_precision;
+    char length[3];
+    char conv;
+    enum log_arg_type type;
+};
+
+int log_current_level = LOG_LEVEL_DEBUG;
+
+static struct log_slot *ring;
+static uint64_t head;
+static uint64_t tail;
+static uint64_t dropped;
+static FILE *log_out;
+static pthread_t log_thread;
+static bool log_running;
+static bool log_stopping;
+
+/*
+ * Parse the conversion at @p, which points to a '%'. Returns false for "%%"
+ * and for conversions we do not support (e.g. %n), which are copied as text.
+ */
+static bool parse_conv(const char *p, struct log_conv *c)
+{
+    size_t n = 0;
+
+    memset(c, 0, sizeof *c);
+    c->start = p++;
+    while (*p && strchr("-+ #0'I", *p))
+        p++;
+    if (*p == '*') {
+        c->star_width = true;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9')
+        p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            c->star_precision = true;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+    c->prefix_end = p;
+    while (*p && strchr("hljztLq", *p) && n < sizeof c->length - 1)
+        c->length[n++] = *p++;
+    c->conv = *p;
+    c->end = *p ? p + 1 : p;
+
+    switch (c->conv) {
+    case 'd': case 'i':
+        c->type = ARG_INT;
+        return true;
+    case 'u': case 'o': case 'x': case 'X':
+        c->type = ARG_UINT;
+        return true;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        c->type = ARG_DOUBLE;
+        return true;
+    case 'c':
+        c->type = ARG_CHAR;
+        return true;
+    case 's':
+        c->type = ARG_STR;
+        return true;
+    case 'p':
+        c->type = ARG_PTR;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static long long va_arg_int(const char *length, va_list *ap)
+{
+    if (strcmp(length, "l") == 0)
+        return va_arg(*ap, long);
+    if (strcmp(length, "ll") == 0 || strcmp(length, "q") == 0)
+        return va_arg(*ap, long long);
+    if (strcmp(length, "j") == 0)
+        return va_arg(*ap, intmax_t);
+    if (strcmp(length, "z") == 0)
+        return va_arg(*ap, ssize_t);
+    if (strcmp(length, "t") == 0)
+        return va_arg(*ap, ptrdiff_t);
+    return va_arg(*ap, int);
+}
+
+static unsigned long long va_arg_uint(const char *length, va_list *ap)
+{
+    if (strcmp(length, "l") == 0)
+        return va_arg(*ap, unsigned long);
+    if (strcmp(length, "ll") == 0 || strcmp(length, "q") == 0)
+        return va_arg(*ap, unsigned long long);
+    if (strcmp(length, "j") == 0)
+        return va_arg(*ap, uintmax_t);
+    if (strcmp(length, "z") == 0)
+        return va_arg(*ap, size_t);
+    if (strcmp(length, "t") == 0)
+        return va_arg(*ap, ptrdiff_t);
+    return va_arg(*ap, unsigned int);
+}
+
+/* copy the arguments for @rec->fmt from @ap into @rec */
+static void capture(struct log_record *rec, va_list ap)
+{
+    struct log_conv c;
+    va_list aq;
+
+    va_copy(aq, ap);
+    rec->nargs = 0;
+    rec->strs_used = 0;
+    for (const char *p = rec->fmt; (p = strchr(p, '%')); ) {
+        if (!parse_conv(p, &c)) {
+            p = c.end;
+            continue;
+        }
+        p = c.end;
+
+        /* leave room for the worst case: width, precision and the value */
+        if (rec->nargs + 3 > LOG_MAX_ARGS)
+            break;
+
+        if (c.star_width)
+            rec->args[rec->nargs++].i = va_arg(aq, int);
+        if (c.star_precision)
+            rec->args[rec->nargs++].i = va_arg(aq, int);
+
+        union log_arg *arg = &rec->args[rec->nargs++];
+        switch (c.type) {
+        case ARG_INT:
+            arg->i = va_arg_int(c.length, &aq);
+            break;
+        case ARG_UINT:
+            arg->u = va_arg_uint(c.length, &aq);
+            break;
+        case ARG_DOUBLE:
+            arg->d = strcmp(c.length, "L") == 0 ? (double)va_arg(aq, long double) : va_arg(aq, double);
+            break;
+        case ARG_CHAR:
+            arg->i = va_arg(aq, int);
+            break;
+        case ARG_STR: {
+            const char *s = va_arg(aq, const char *);
+            size_t room = LOG_STR_BYTES - rec->strs_used;
+            size_t len;
+
+            if (!s)
+                s = "(null)";
+            len = strnlen(s, room ? room - 1 : 0);
+            arg->str = rec->strs_used;
+            if (room > 0) {
+                memcpy(&rec->strs[rec->strs_used], s, len);
+                rec->strs[rec->strs_used + len] = '\0';
+                rec->strs_used += len + 1;
+            }
+            break;
+        }
+        case ARG_PTR:
+            arg->p = va_arg(aq, void *);
+            break;
+        }
+    }
+    va_end(aq);
+}
+
+/*
+ * Format @rec into @out. Each conversion is formatted with a specification
+ * rebuilt for the type its argument was captured as, which the compiler cannot
+ * check.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static void format_record(const struct log_record *rec, FILE *out)
+{
+    const char *p = rec->fmt;
+    int argi = 0;
+    struct log_conv c;
+
+    for (const char *q; (q = strchr(p, '%')); ) {
+        char spec[64];
+        size_t prefix_len;
+        int width = 0, precision = 0;
+
+        fwrite(p, 1, q - p, out);
+        if (!parse_conv(q, &c)) {
+            /* "%%" or something unsupported */
+            if (c.conv == '%')
+                fputc('%', out);
+            else
+                fwrite(c.start, 1, c.end - c.start, out);
+            p = c.end;
+            continue;
+        }
+        p = c.end;
+
+        if (argi + (int)c.star_width + (int)c.star_precision >= rec->nargs) {
+            fputs("<...>", out);
+            continue;
+        }
+
+        prefix_len = c.prefix_end - c.start;
+        if (prefix_len > sizeof spec - 4)
+            prefix_len = sizeof spec - 4;
+        memcpy(spec, c.start, prefix_len);
+        if (c.type == ARG_INT || c.type == ARG_UINT) {
+            spec[prefix_len++] = 'l';
+            spec[prefix_len++] = 'l';
+        }
+        spec[prefix_len++] = c.conv;
+        spec[prefix_len] = '\0';
+
+        if (c.star_width)
+            width = rec->args[argi++].i;
+        if (c.star_precision)
+            precision = rec->args[argi++].i;
+
+        const union log_arg *arg = &rec->args[argi++];
+
+#define PRINT_ARG(value)                                                \
+        do {                                                            \
+            if (c.star_width && c.star_precision)                       \
+                fprintf(out, spec, width, precision, value);            \
+            else if (c.star_width)                                      \
+                fprintf(out, spec, width, value);                       \
+            else if (c.star_precision)                                  \
+                fprintf(out, spec, precision, value);                   \
+            else                                                        \
+                fprintf(out, spec, value);                              \
+        } while (0)
+
+        switch (c.type) {
+        case ARG_INT:
+            PRINT_ARG(arg->i);
+            break;
+        case ARG_UINT:
+            PRINT_ARG(arg->u);
+            break;
+        case ARG_DOUBLE:
+            PRINT_ARG(arg->d);
+            break;
+        case ARG_CHAR:
+            PRINT_ARG((int)arg->i);
+            break;
+        case ARG_STR:
+            PRINT_ARG(arg->str < LOG_STR_BYTES ? &rec->strs[arg->str] : "");
+            break;
+        case ARG_PTR:
+            PRINT_ARG(arg->p);
+            break;
+        }
+
+#undef PRINT_ARG
+    }
+    fputs(p, out);
+}
+#pragma GCC diagnostic pop
+
+void log_record(enum log_level level, const char *fmt, ...)
+{
+    uint64_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    struct log_slot *slot;
+    va_list ap;
+
+    va_start(ap, fmt);
+
+    if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+        vfprintf(level <= LOG_LEVEL_WARN ? stderr : stdout, fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    for (;;) {
+        int64_t diff;
+
+        slot = &ring[pos & (LOG_RING_SIZE - 1)];
+        diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            /* full */
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            va_end(ap);
+            return;
+        } else
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    }
+
+    slot->rec.fmt = fmt;
+    slot->rec.level = level;
+    capture(&slot->rec, ap);
+    va_end(ap);
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* write out every record that is ready; returns how many there were */
+static int drain(void)
+{
+    int n = 0;
+
+    for (;;) {
+        struct log_slot *slot = &ring[tail & (LOG_RING_SIZE - 1)];
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1)
+            break;
+        format_record(&slot->rec, slot->rec.level <= LOG_LEVEL_WARN ? stderr : log_out);
+        __atomic_store_n(&slot->seq, tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        tail++;
+        n++;
+    }
+
+    if (n > 0)
+        fflush(log_out);
+    return n;
+}
+
+static void *log_main(void *arg)
+{
+    const struct timespec idle = { 0, LOG_IDLE_NS };
+
+    (void) arg;
+    for (;;) {
+        if (drain() > 0)
+            continue;
+        if (__atomic_load_n(&log_stopping, __ATOMIC_ACQUIRE))
+            break;
+        nanosleep(&idle, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+int log_init(FILE *out)
+{
+    if (!(ring = calloc(LOG_RING_SIZE, sizeof *ring)))
+        return -1;
+    for (uint64_t i = 0; i < LOG_RING_SIZE; ++i)
+        ring[i].seq = i;
+    head = tail = 0;
+    log_out = out;
+    log_stopping = false;
+
+    if ((errno = pthread_create(&log_thread, NULL, &log_main, NULL)) != 0) {
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+
+    __atomic_store_n(&log_running, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void log_set_level(enum log_level level)
+{
+    __atomic_store_n(&log_current_level, (int)level, __ATOMIC_RELAXED);
+}
+
+enum log_level log_get_level(void)
+{
+    return (enum log_level)__atomic_load_n(&log_current_level, __ATOMIC_RELAXED);
+}
+
+static const char *log_level_names[N_LOG_LEVELS] = {
+    [LOG_LEVEL_OFF]     = "off",
+    [LOG_LEVEL_ERROR]   = "error",
+    [LOG_LEVEL_WARN]    = "warn",
+    [LOG_LEVEL_INFO]    = "info",
+    [LOG_LEVEL_DEBUG]   = "debug",
+    [LOG_LEVEL_TRACE]   = "trace",
+};
+
+int log_level_from_string(const char *name)
+{
+    for (int i = 0; i < N_LOG_LEVELS; ++i)
+        if (strcmp(name, log_level_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+const char *log_level_name(enum log_level level)
+{
+    return level >= 0 && level < N_LOG_LEVELS ? log_level_names[level] : "?";
+}
+
+uint64_t log_dropped(void)
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+void log_exit(void)
+{
+    if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+        return;
+
+    /* stop queueing, then let the thread write out what was queued */
+    __atomic_store_n(&log_running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&log_stopping, true, __ATOMIC_RELEASE);
+    pthread_join(log_thread, NULL);
+
+    free(ring);
+    ring = NULL;
+}
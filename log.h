@@ -0,0 +1,91 @@
+/**
+ * log.h
+ *
+ * Asynchronous logging for the control loop. A call site only checks the
+ * level and, if it is enabled, copies its format string pointer and its
+ * arguments into a fixed-size record in a lock-free ring. A background thread
+ * does the formatting and the (possibly blocking) writes.
+ */
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum log_level {
+    LOG_LEVEL_OFF,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,     /* per-application details, every window */
+    LOG_LEVEL_TRACE,     /* per-thread details, every window */
+    N_LOG_LEVELS,
+};
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+extern int log_current_level;
+
+static inline bool log_enabled(enum log_level level)
+{
+    return (int)level <= __atomic_load_n(&log_current_level, __ATOMIC_RELAXED);
+}
+
+/**
+ * Queue a message. @fmt must outlive the program (in practice, a string
+ * literal), since only the pointer is queued; %s arguments are copied.
+ *
+ * Messages are dropped, and counted, when the ring is full. Before
+ * log_init() and after log_exit(), messages are written synchronously.
+ */
+__attribute__((format (printf, 2, 3)))
+void log_record(enum log_level level, const char *fmt, ...);
+
+#define log_msg(level, ...)                     \
+    do {                                        \
+        if (log_enabled(level))                 \
+            log_record(level, __VA_ARGS__);     \
+    } while (0)
+
+#define log_error(...)  log_msg(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_warn(...)   log_msg(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_info(...)   log_msg(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...)  log_msg(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_trace(...)  log_msg(LOG_LEVEL_TRACE, __VA_ARGS__)
+
+/**
+ * Start the background thread, which writes to @out.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+int log_init(FILE *out);
+
+void log_set_level(enum log_level level);
+
+enum log_level log_get_level(void);
+
+/**
+ * Returns the level called @name ("off", "error", ..., "trace"), or -1.
+ */
+int log_level_from_string(const char *name);
+
+const char *log_level_name(enum log_level level);
+
+/**
+ * The number of messages dropped because the ring was full.
+ */
+uint64_t log_dropped(void);
+
+/**
+ * Write out every queued message and stop the background thread.
+ */
+void log_exit(void);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* LOG_H */
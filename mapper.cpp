@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/shm.h>
 #include <sys/stat.h>
@@ -19,6 +20,13 @@
 #include <unistd.h>
 #include <math.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
 
 #include <locale.h>
 #include <sched.h>
@@ -27,40 +35,233 @@
 
 #include "config.h"
 #include "budgets.h"
+#include "cgbatch.h"
 #include "cgroup.h"
 #include "cpuinfo.h"
+#include "reconfig.h"
 #include "mapper.h"
 #include "util.h"
 #include "perfio.h"
+#include "perfio_bpf.h"
+#include "wakegraph.h"
+#include "schedext.h"
+#include "log.h"
+#include "control.h"
+#include "metrics.h"
+#include "tunables.h"
+#include "reactor.h"
 
-#ifdef NUPOCO
-#include "schedulers/nupoco.h"
-#else
-#include "schedulers/sam.h"
-#endif
+#include "schedulers/policy.h"
 
-#define PRINT_BOTTLENECK false
 #define HILL_SUSPEND 5 //suspend for these many iterations when local optima found
 #define BIN_INITIAL_RESOURCE 12
-// Will be initialized anyway
-int num_counter_orders = 6;
+/*
+ * An application's cpuset[0] is what was last written to its cgroup, so a
+ * cpuset that has not changed is not written again. Every this many windows
+ * each cgroup is read back, in case it was changed behind our back.
+ */
+#define CPUSET_CHECK_WINDOWS 30
+int num_counter_orders = 0;
 int random_seed = 0xFACE;
 
 const char *cgroot = "/sys/fs/cgroup";
 const char *cntrlr = "cpuset";
 
-int thresh_pt[N_METRICS];
+/* the sampler's thresholds, and the scheduler's order of bottlenecks */
+long thresh_pt[N_METRICS];
 enum metric counter_order[MAX_COUNTERS];
-int ordernum = 0;
 int init_thresholds = 0;
 
-struct timespec start_time, finish_time;
+/*
+ * The configuration file. It is read by the sampler, on SIGHUP, into
+ * staged_tunables, which take effect from the next window: the sampler uses
+ * them from then on, and hands them to the scheduler with that window.
+ */
+const char *config_path = SAM_CONFIG_FILE;
+bool config_path_given = false;
+struct tunables sampler_tunables;
+struct tunables staged_tunables;
+bool tunables_staged = false;
+
+/* the allocation policy, which is changed under apps_lock */
+const struct policy *policy = &policies[0];
+
+/* sampler timings for the current window */
+struct timespec start_time;
+struct timespec discovery_finish;
 struct timespec perf_start, perf_finish,
                 perf_sleep,     /* time spent sleeping */
                 perf_setup,     /* time spent setting up counters */
                 perf_read       /* time spent reading counters */;
-struct timespec sched_start, sched_finish;
-struct timespec cgroups_start, cgroups_finish;
+
+/*
+ * The control loop is split between two threads. The sampler (the main
+ * thread) discovers threads and counts windows back to back, and publishes
+ * each window's counts as it ends. The scheduler thread then derives metrics,
+ * allocates CPUs and applies them while the sampler counts the next window.
+ *
+ * Windows are double-buffered: the sampler fills *pending while the scheduler
+ * works on *current, and they are swapped under window_lock. apps_lock guards
+ * the applications: the scheduler holds it for a whole pass, and the sampler
+ * only takes it to add or remove an application.
+ */
+struct window {
+  struct appsample *apps;
+  int num_apps;
+  int capacity;
+  uint64_t seq;
+  /* sampler timings */
+  struct timespec discovery, perf, sleep, setup, read;
+  /* from the start of this window to the start of the next */
+  struct timespec period;
+  /* the tunables this window was sampled with */
+  struct tunables tunables;
+};
+
+struct window windows[2];
+struct window *pending = &windows[0];
+struct window *current = &windows[1];
+uint64_t window_seq = 0;
+bool window_ready = false;
+bool sampler_done = false;
+pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t window_cond = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t apps_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_t scheduler_thread;
+/* the timings of the last window that was scheduled, under apps_lock */
+struct sam_ctl_timings last_timings;
+/* cpuset writes, and cgroups found changed by someone else, under apps_lock */
+uint64_t cpuset_writes_total = 0;
+uint64_t cpuset_drift_total = 0;
+/*
+ * The writes that gave up CPUs before others took them, and those that took
+ * them; the windows in which applications swapping CPUs overlapped, and for
+ * how long, under apps_lock
+ */
+uint64_t cpuset_shrink_writes_total = 0;
+uint64_t cpuset_grow_writes_total = 0;
+uint64_t cpuset_overlaps_total = 0;
+uint64_t cpuset_overlap_ns_total = 0;
+uint64_t mem_migrations_total = 0;
+uint64_t mem_migrated_bytes_total = 0;
+/*
+ * The bytes of memory that may still be moved between nodes. Every window
+ * adds its share of mem_migrate_mb_per_s, up to a second's worth; one large
+ * application can take it below zero, and the others then wait until it has
+ * been paid back.
+ */
+double mem_migrate_allowance = 0;
+/*
+ * The CPUs that applications may be given: the effective CPUs of the cgroup
+ * that SAM_CGROUP_NAME is in, less housekeeping_cpus. They follow that
+ * cgroup as it grows and shrinks; sam_cpus is what SAM_CGROUP_NAME has on
+ * the way there. Only the scheduler thread uses these, once main() has set
+ * them up.
+ */
+cpu_set_t *allocatable_cpus = NULL;
+int num_allocatable_cpus = 0;
+cpu_set_t *sam_cpus = NULL;
+uint64_t capacity_changes_total = 0;
+
+/**
+ * The phases of a window whose durations are kept in histograms.
+ */
+enum phase {
+  PHASE_DISCOVERY,
+  PHASE_PERF_SETUP,
+  PHASE_PERF_READ,
+  PHASE_SCHEDULER,
+  PHASE_CGROUPS,
+  /* the work done for a window: all of the above, without sleeping */
+  PHASE_TOTAL,
+  N_PHASES,
+};
+
+const char *phase_names[N_PHASES] = {
+  [PHASE_DISCOVERY] = "discovery",
+  [PHASE_PERF_SETUP] = "perf_setup",
+  [PHASE_PERF_READ] = "perf_read",
+  [PHASE_SCHEDULER] = "scheduler",
+  [PHASE_CGROUPS] = "cgroups",
+  [PHASE_TOTAL] = "total",
+};
+
+/* only the scheduler thread uses these */
+struct histogram phase_histograms[N_PHASES];
+const char *metrics_path = SAM_METRICS_FILE;
+
+/**
+ * Where counter values come from.
+ */
+enum collector {
+  /* per-thread counters opened and read by perfio_read_counters() */
+  COLLECTOR_PERF,
+  /* per-application counters accumulated in the kernel by perfio_bpf */
+  COLLECTOR_BPF,
+};
+
+enum collector collector = COLLECTOR_PERF;
+
+/**
+ * How CPU budgets are enforced.
+ */
+enum enforcer {
+  /* by writing each application's cpuset.cpus */
+  ENFORCER_CPUSET,
+  /* by the sched_ext scheduler in schedext */
+  ENFORCER_SCHED_EXT,
+};
+
+enum enforcer enforcer = ENFORCER_CPUSET;
+/* the writes of application cpusets in a window, with ENFORCER_CPUSET */
+struct cg_batch *cpuset_batch = NULL;
+/* whether the cpu controller is there to limit applications that share CPUs */
+bool cpu_controller = false;
+/* the period of the bandwidth limit of applications that share CPUs */
+#define CPU_PERIOD_US 100000
+
+/**
+ * The topology domain that the threads of an application are clustered to
+ * fit, from the wakeups between them.
+ */
+enum wake_domain {
+  /* wakeups are not traced */
+  WAKE_DOMAIN_NONE,
+  WAKE_DOMAIN_CORE,
+  WAKE_DOMAIN_L3,
+  WAKE_DOMAIN_SOCKET,
+};
+
+enum wake_domain wake_domain = WAKE_DOMAIN_NONE;
+int wake_cluster_size = 0;
+
+/**
+ * Where a thread is pinned within its application's CPUs, with -A.
+ */
+enum placement {
+  /* not placed yet */
+  PLACEMENT_NONE = -1,
+  /* anywhere in the application's CPUs */
+  PLACEMENT_FREE,
+  /* with the application's other communicating threads, on the SMT siblings of one core */
+  PLACEMENT_PACK,
+  /* on a core away from the application's other memory-bound threads */
+  PLACEMENT_SPREAD,
+};
+
+bool place_threads_enabled = false;
+uint64_t thread_affinity_sets_total = 0;
+struct wakegraph wake_graph;
+
+/*
+ * Maps a procinfo counter (and an appinfo value) to the event it counts.
+ */
+const int counter_event_pairs[][2] = { { 0, EVENT_UNHALTED_CYCLES },
+                                       { 1, EVENT_INSTRUCTIONS },
+                                       { 7, EVENT_SNP },
+                                       { 8, EVENT_LLC_MISSES },
+                                       { 9, EVENT_REMOTE_HITM } };
+const int num_pairs = sizeof(counter_event_pairs) / sizeof(counter_event_pairs[0]);
 
 struct counter {
   double ratio;
@@ -85,6 +286,14 @@ struct procinfo {
   int bottleneck[MAX_COUNTERS];
   int active;
   double val[MAX_COUNTERS];
+  /**
+   * The thread's cluster within its application (see appinfo::num_clusters),
+   * or -1 if it has none.
+   */
+  int cluster;
+  /* whether the thread's counters have been read, and where it is pinned */
+  bool sampled;
+  enum placement placement;
   struct procinfo *prev, *next;
 };
 
@@ -100,7 +309,7 @@ const char *metric_names[N_METRICS] = {
 };
 
 bool stoprun = false;
-bool print_counters = false;
+enum log_level counters_saved_level = LOG_LEVEL_DEBUG;
 bool print_proc_creation = false;
 struct cpuinfo *cpuinfo;
 
@@ -108,22 +317,232 @@ struct appinfo **apps_array;
 struct appinfo *apps_list;
 int num_apps = 0;
 int num_procs = 0;
+int pid_max = 0;
+
+/*
+ * Per-iteration thread collections. These grow as needed and keep their
+ * storage between iterations.
+ */
+struct pidlist pids_to_monitor;
+struct pidlist frontier;
+struct pidlist app_tids;
+
+/*
+ * Applications registered through the control socket, which are managed
+ * along with those in SAM_RUN_DIR. While one is being registered, manage()
+ * takes the pidfd that came with the request instead of opening its own.
+ */
+struct pidlist registered;
+pid_t registering_pid = 0;
+int registering_pidfd = -1;
+
+/*
+ * The sampler's reactor state. The window timer ticks at the end of each
+ * counter group's share of the window (or of the whole window, with the BPF
+ * collector).
+ */
+int window_timer = -1;
+int signal_fd = -1;
+int run_dir_watch = -1;
+int ctl_socket = -1;
+int current_group = 0;
+struct timespec group_start;
+
+/**
+ * Reactor handler for the signals samd responds to.
+ */
+static void on_signal(int fd, uint32_t events, void *arg)
+{
+  struct signalfd_siginfo si;
+
+  (void) events;
+  (void) arg;
+  while (read(fd, &si, sizeof si) == sizeof si) {
+    if (si.ssi_signo == SIGUSR1) {
+      /* toggle the per-thread counters, which are logged at trace level */
+      if (log_get_level() < LOG_LEVEL_TRACE) {
+        counters_saved_level = log_get_level();
+        log_set_level(LOG_LEVEL_TRACE);
+        log_info("[DEBUG] Received %s. Enabled printing counters.\n", strsignal(si.ssi_signo));
+      } else {
+        log_info("[DEBUG] Received %s. Disabled printing counters.\n", strsignal(si.ssi_signo));
+        log_set_level(counters_saved_level);
+      }
+    } else if (si.ssi_signo == SIGHUP) {
+      if (tunables_load(&staged_tunables, config_path, config_path_given, cpuinfo->total_cores) == 0) {
+        tunables_staged = true;
+        log_info("Reloaded %s; it applies from the next window\n", config_path);
+      } else
+        log_error("Failed to reload %s; keeping the current configuration\n", config_path);
+    } else
+      stoprun = true;
+  }
+}
+
+static void on_app_exit(int fd, uint32_t events, void *arg);
+
+/**
+ * The control file @param of @an's cgroup under @controller, opened with
+ * @flags into *@fdp the first time it is needed and kept open until @an is
+ * unmanaged.
+ *
+ * Returns the file descriptor, or -1 (with errno set) if it cannot be opened.
+ */
+static int app_cgroup_fd(struct appinfo *an, const char *controller, int *fdp, const char *param, int flags)
+{
+  if (*fdp < 0) {
+    char cg_name[256];
+
+    /* the v1 cpu hierarchy is samd's own, named after the application */
+    if (strcmp(controller, cntrlr) == 0)
+      snprintf(cg_name, sizeof cg_name, "%s", an->cg_name);
+    else
+      snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/app-%d", an->pid);
+    *fdp = cg_open(cgroot, controller, cg_name, param, flags);
+  }
+  return *fdp;
+}
+
+/**
+ * Find the cgroup that the launcher put application @app_pid in, into
+ * @an->cg_name. An application that is not under SAM_CGROUP_NAME, because
+ * it was registered by hand, is taken to be in SAM_CGROUP_NAME/app-<pid>.
+ */
+static void find_app_cgroup(struct appinfo *an, pid_t app_pid)
+{
+  if (cg_find(app_pid, cntrlr, an->cg_name, sizeof an->cg_name) != 0 ||
+      strncmp(an->cg_name, SAM_CGROUP_NAME "/", sizeof SAM_CGROUP_NAME) != 0)
+    snprintf(an->cg_name, sizeof an->cg_name, SAM_CGROUP_NAME "/app-%d", app_pid);
+}
 
-void sigterm_handler(int sig)
+/**
+ * Remove the cgroups in the v1 cpu hierarchy of the applications that are no
+ * longer managed, or of all of them if @all. They go once the last threads
+ * of their applications have been reaped, which is often after the
+ * applications are unmanaged, so the leftovers are swept up later.
+ */
+static void remove_cpu_cgroups(bool all)
+{
+  char path[256];
+  struct dirent *ent;
+  DIR *dir;
+
+  snprintf(path, sizeof path, "%s/cpu/" SAM_CGROUP_NAME, cgroot);
+  if (!(dir = opendir(path)))
+    return;
+  while ((ent = readdir(dir))) {
+    char cg_name[sizeof SAM_CGROUP_NAME + sizeof ent->d_name];
+    int app_pid;
+
+    if (sscanf(ent->d_name, "app-%d", &app_pid) != 1 ||
+        (!all && app_pid > 0 && app_pid < pid_max && apps_array[app_pid]))
+      continue;
+    snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/%s", ent->d_name);
+    if (cg_remove_cgroup(cgroot, "cpu", cg_name) != 0 && errno != EBUSY)
+      log_debug("Failed to remove cpu/%s: %s\n", cg_name, strerror(errno));
+  }
+  closedir(dir);
+}
+
+/* the cgroups kept ready for sam-launch, or empty strings, and the number of the next one */
+static char cgroup_pool[SAM_CGROUP_POOL][64];
+static unsigned cgroup_pool_seq;
+
+/**
+ * Keep SAM_CGROUP_POOL cgroups under SAM_CGROUP_NAME with its CPUs and
+ * nodes, for sam-launch to start applications in. A cgroup that has gone,
+ * or has tasks in it, was taken by a launcher and is replaced.
+ */
+static void fill_cgroup_pool(void)
 {
-  (void) sig;
-  stoprun = true;
+  for (int i = 0; i < SAM_CGROUP_POOL; ++i) {
+    char *cg_name = cgroup_pool[i];
+
+    if (cg_name[0] && cg_populated(cgroot, cntrlr, cg_name) == 0)
+      continue;
+    /* those of an earlier samd that are still in use keep their names */
+    int tries = 0, ret;
+    do {
+      snprintf(cg_name, sizeof cgroup_pool[i], SAM_CGROUP_NAME "/" SAM_CGROUP_POOL_PREFIX "%u", cgroup_pool_seq++);
+      ret = cg_create_cgroup(cgroot, cntrlr, cg_name);
+    } while (ret != 0 && errno == EEXIST && ++tries < 16);
+    if (ret != 0 || cg_inherit_cpuset(cgroot, cntrlr, SAM_CGROUP_NAME, cg_name) != 0) {
+      log_warn("Failed to create cgroup %s: %s\n", cg_name, strerror(errno));
+      if (ret == 0)
+        cg_remove_cgroup(cgroot, cntrlr, cg_name);
+      cg_name[0] = '\0';
+    }
+  }
 }
-void siginfo_handler(int sig)
+
+/**
+ * Remove cgroup @cg_name of the pool unless a launcher has taken it. A
+ * launcher locks the cgroup before it starts the application in it, so one
+ * that is locked is taken even while it has no tasks yet.
+ *
+ * Returns 0, or -1 (with errno set, to EBUSY if it is taken).
+ */
+static int remove_pooled_cgroup(const char *cg_name)
 {
-  printf("[DEBUG] Received %s.", strsignal(sig));
-  if ((print_counters = !print_counters))
-    printf(" Enabled printing counters.\n");
+  int fd, err, ret = -1;
+
+  if ((fd = cg_open(cgroot, cntrlr, cg_name, NULL, O_RDONLY | O_DIRECTORY)) < 0)
+    return -1;
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0 || cg_populated(cgroot, cntrlr, cg_name) != 0)
+    errno = EBUSY;
   else
-    printf(" Disabled printing counters.\n");
+    ret = cg_remove_cgroup(cgroot, cntrlr, cg_name);
+  err = errno;
+  close(fd);
+  errno = err;
+  return ret;
+}
+
+/**
+ * Remove the cgroups of the pool that an earlier samd left and no launcher
+ * has taken, which would otherwise keep SAM_CGROUP_NAME from being removed,
+ * and number the new ones after those that are still in use.
+ */
+static void clear_stale_cgroup_pool(void)
+{
+  const int dir_fd = cg_open(cgroot, cntrlr, SAM_CGROUP_NAME, NULL, O_RDONLY | O_DIRECTORY);
+  struct dirent *ent;
+  DIR *dir = NULL;
+
+  if (dir_fd >= 0 && !(dir = fdopendir(dir_fd)))
+    close(dir_fd);
+  if (!dir)
+    return;
+  while ((ent = readdir(dir))) {
+    char cg_name[sizeof SAM_CGROUP_NAME + sizeof ent->d_name];
+    unsigned seq;
+
+    if (sscanf(ent->d_name, SAM_CGROUP_POOL_PREFIX "%u", &seq) != 1)
+      continue;
+    snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/%s", ent->d_name);
+    if (remove_pooled_cgroup(cg_name) != 0)
+      cgroup_pool_seq = MAX(cgroup_pool_seq, seq + 1);
+  }
+  closedir(dir);
+}
+
+/**
+ * Remove the cgroups of the pool that no launcher has taken.
+ */
+static void empty_cgroup_pool(void)
+{
+  for (int i = 0; i < SAM_CGROUP_POOL; ++i) {
+    if (cgroup_pool[i][0] && remove_pooled_cgroup(cgroup_pool[i]) != 0 && errno != EBUSY)
+      log_warn("Failed to remove cgroup %s: %s\n", cgroup_pool[i], strerror(errno));
+    cgroup_pool[i][0] = '\0';
+  }
 }
 
-static void manage(pid_t pid, pid_t app_pid)
+/**
+ * Start managing thread @pid, of process @tgid, as part of application
+ * @app_pid.
+ */
+static void manage(pid_t pid, pid_t tgid, pid_t app_pid)
 {
   assert(procs_array[pid] == NULL);
 
@@ -140,6 +559,8 @@ static void manage(pid_t pid, pid_t app_pid)
   pnode->num_counters = 10;
   pnode->app_pid = app_pid;
   pnode->init = true;
+  pnode->cluster = -1;
+  pnode->placement = PLACEMENT_NONE;
 
   num_procs++;
 
@@ -149,14 +570,38 @@ static void manage(pid_t pid, pid_t app_pid)
     struct appinfo *anode = (struct appinfo *)calloc(1, sizeof *anode);
     size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
 
+    pthread_mutex_lock(&apps_lock);
+
     anode->pid = app_pid;
     anode->refcount = 1;
+    if (app_pid == registering_pid && registering_pidfd >= 0) {
+      anode->pidfd = registering_pidfd;
+      registering_pidfd = -1;
+    } else if ((anode->pidfd = sys_pidfd_open(app_pid, 0)) < 0 && errno != ESRCH)
+      log_warn("Failed to open pidfd for application %d: %s\n", app_pid, strerror(errno));
+    if (anode->pidfd >= 0 && reactor_add(anode->pidfd, EPOLLIN, &on_app_exit, (void *)(intptr_t)app_pid) != 0)
+      log_warn("Failed to watch application %d: %s\n", app_pid, strerror(errno));
+    find_app_cgroup(anode, app_pid);
+    anode->cpus_fd = -1;
+    anode->tasks_fd = -1;
+    anode->cpu_tasks_fd = -1;
     anode->next = apps_list;
     anode->cpuset[0] = CPU_ALLOC(cpuinfo->total_cpus);
     anode->cpuset[1] = CPU_ALLOC(cpuinfo->total_cpus);
+    anode->placed_cpuset = CPU_ALLOC(cpuinfo->total_cpus);
     CPU_ZERO_S(sz, anode->cpuset[0]);
     CPU_ZERO_S(sz, anode->cpuset[1]);
+    CPU_ZERO_S(sz, anode->placed_cpuset);
     anode->perf_history = (uint64_t(*)[2])calloc(cpuinfo->total_cpus + 1, sizeof *anode->perf_history);
+    /* on v1 the cpu controller is a hierarchy of its own, which the launcher does not know of */
+    if (cpu_controller && cg_version() == CG_V1) {
+      char cg_name[256];
+
+      remove_cpu_cgroups(false);
+      snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/app-%d", app_pid);
+      if (cg_create_cgroup(cgroot, "cpu", cg_name) != 0 && errno != EEXIST)
+        log_warn("Failed to create cpu/%s: %s\n", cg_name, strerror(errno));
+    }
     if (apps_list)
       apps_list->prev = anode;
     apps_list = anode;
@@ -171,26 +616,41 @@ static void manage(pid_t pid, pid_t app_pid)
 
     anode->OMPfd = shm_open(anode->OMPname, O_RDWR, 0777);
     if (anode->OMPfd == -1)
-      printf("Error. |%s| shared memory segment does not exist\n", anode->OMPname);
+      log_warn("Error. |%s| shared memory segment does not exist\n", anode->OMPname);
     else {
       anode->OMPptr =
         (struct OMPdata *)mmap(NULL, sizeof(struct OMPdata), PROT_READ | PROT_WRITE, MAP_SHARED, anode->OMPfd, 0);
       if (anode->OMPptr == MAP_FAILED)
-        printf("Mmap failed \n");
+        log_warn("Mmap failed \n");
       else
         anode->OMPvalid = 1;
     }
-    printf("Managing new application %d\n", app_pid);
+    log_info("Managing new application %d\n", app_pid);
+    pthread_mutex_unlock(&apps_lock);
   } else
     apps_array[app_pid]->refcount++;
 
-  /* add this new task to the cgroup */
-  char cg_name[256];
-
-  snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/app-%d", app_pid);
-  if (cg_write_string(cgroot, cntrlr, cg_name, "tasks", "%d", pid) != 0) {
-    fprintf(stderr, "Failed to add task %d to %s: %s\n", pid, cg_name, strerror(errno));
+  if (collector == COLLECTOR_BPF && perfio_bpf_track(pid, app_pid) != 0)
+    log_warn("Failed to track task %d with the BPF collector: %s\n", pid, strerror(errno));
+  if (wake_domain != WAKE_DOMAIN_NONE && wakegraph_track(pid, app_pid) != 0)
+    log_warn("Failed to trace wakeups of task %d: %s\n", pid, strerror(errno));
+  if (enforcer == ENFORCER_SCHED_EXT && schedext_track(pid, app_pid) != 0)
+    log_warn("Failed to schedule task %d with sched_ext: %s\n", pid, strerror(errno));
+
+  /* add this new task to the cgroup; the scheduler thread looks at the files it opens */
+  struct appinfo *an = apps_array[app_pid];
+
+  pthread_mutex_lock(&apps_lock);
+  /* on v2 cgroup.procs moves the whole process, so it is written once, for the main thread */
+  if ((cg_version() != CG_V2 || pid == tgid) &&
+      cg_pwrite_int(app_cgroup_fd(an, cntrlr, &an->tasks_fd, cg_procs_param(), O_WRONLY), pid) != 0) {
+    log_warn("Failed to add task %d to %s: %s\n", pid, an->cg_name, strerror(errno));
+  }
+  if (cpu_controller && cg_version() == CG_V1 &&
+      cg_pwrite_int(app_cgroup_fd(an, "cpu", &an->cpu_tasks_fd, "tasks", O_WRONLY), pid) != 0) {
+    log_warn("Failed to add task %d to cpu/" SAM_CGROUP_NAME "/app-%d: %s\n", pid, app_pid, strerror(errno));
   }
+  pthread_mutex_unlock(&apps_lock);
 }
 
 static void unmanage(pid_t pid, pid_t app_pid)
@@ -202,6 +662,13 @@ static void unmanage(pid_t pid, pid_t app_pid)
 
   procs_array[pid] = NULL;
 
+  if (collector == COLLECTOR_BPF)
+    perfio_bpf_untrack(pid);
+  if (wake_domain != WAKE_DOMAIN_NONE)
+    wakegraph_untrack(pid);
+  if (enforcer == ENFORCER_SCHED_EXT)
+    schedext_untrack(pid);
+
   if (pnode->prev) {
     struct procinfo *prev = pnode->prev;
     prev->next = pnode->next;
@@ -222,11 +689,14 @@ static void unmanage(pid_t pid, pid_t app_pid)
   if (apps_array[app_pid]) {
     assert(apps_array[app_pid]->refcount > 0);
     apps_array[app_pid]->refcount--;
+    apps_array[app_pid]->threads_left = true;
   }
 
   if (apps_array[app_pid] && apps_array[app_pid]->refcount == 0) {
     struct appinfo *anode = apps_array[app_pid];
 
+    pthread_mutex_lock(&apps_lock);
+
     apps_array[app_pid] = NULL;
     num_apps--;
     if (anode->prev) {
@@ -241,6 +711,24 @@ static void unmanage(pid_t pid, pid_t app_pid)
     if (anode == apps_list)
       apps_list = anode->next;
 
+    if (enforcer == ENFORCER_SCHED_EXT)
+      schedext_remove_app(app_pid);
+
+    if (anode->pidfd >= 0) {
+      reactor_del(anode->pidfd);
+      close(anode->pidfd);
+    }
+    anode->pidfd = -1;
+    if (anode->cpus_fd >= 0)
+      close(anode->cpus_fd);
+    if (anode->tasks_fd >= 0)
+      close(anode->tasks_fd);
+    if (anode->cpu_tasks_fd >= 0)
+      close(anode->cpu_tasks_fd);
+    anode->cpus_fd = -1;
+    anode->tasks_fd = -1;
+    anode->cpu_tasks_fd = -1;
+
     if (anode->OMPvalid) {
       shm_unlink(anode->OMPname);
       anode->OMPptr = NULL;
@@ -248,33 +736,95 @@ static void unmanage(pid_t pid, pid_t app_pid)
       anode->OMPfd = 0;
     }
 
-    printf("Unmanaged application %d\n", app_pid);
+    pidlist_remove(&registered, app_pid);
+    log_info("Unmanaged application %d\n", app_pid);
 
-#ifdef NUPOCO
-    nupoco_set_profiling();
-#endif
+    if (policy->reset)
+      policy->reset();
 
     CPU_FREE(anode->cpuset[0]);
     CPU_FREE(anode->cpuset[1]);
+    CPU_FREE(anode->placed_cpuset);
     anode->cpuset[0] = NULL;
     anode->cpuset[1] = NULL;
+    anode->placed_cpuset = NULL;
     free(anode->perf_history);
     anode->perf_history = NULL;
     free(anode);
+    pthread_mutex_unlock(&apps_lock);
+  }
+}
+
+/**
+ * Stop managing every thread of @anode, which frees @anode itself.
+ */
+static void unmanage_app(struct appinfo *anode)
+{
+  pid_t app_pid = anode->pid;
+
+  for (struct procinfo *pd = procs_list; pd && apps_array[app_pid] == anode;) {
+    struct procinfo *next = pd->next;
+    if (pd->app_pid == app_pid)
+      unmanage(pd->pid, app_pid);
+    pd = next;
   }
 }
 
+/**
+ * Whether the process behind @pidfd has exited.
+ */
+static bool pidfd_exited(int pidfd)
+{
+  struct pollfd pfd = { pidfd, POLLIN, 0 };
+
+  return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * Reactor handler for an application's pidfd, which becomes readable when
+ * the application exits. Tearing the application down right away means a
+ * reused PID is always managed as a new application.
+ */
+static void on_app_exit(int fd, uint32_t events, void *arg)
+{
+  pid_t app_pid = (pid_t)(intptr_t)arg;
+  struct appinfo *an = apps_array[app_pid];
+
+  (void) events;
+  if (!an || an->pidfd != fd)
+    return;
+  log_info("Application %d exited\n", app_pid);
+  unmanage_app(an);
+}
+
 /**
  * @app_pid = an app to traverse its tree
  */
 void update_children(pid_t app_pid)
 {
-  pid_t frontier[8192];
-  int frontier_l = 0;
+  if (app_pid <= 0 || app_pid >= pid_max)
+    return;
+
+  /*
+   * An application that exited may linger as a zombie until its launcher
+   * reaps it. Don't start managing it again in the meantime.
+   */
+  if (!apps_array[app_pid]) {
+    int pidfd = sys_pidfd_open(app_pid, 0);
+    bool exited = pidfd < 0 ? errno == ESRCH : pidfd_exited(pidfd);
 
-  frontier[frontier_l++] = app_pid;
-  while (frontier_l > 0) {
-    pid_t cur_pid = frontier[--frontier_l];
+    if (pidfd >= 0)
+      close(pidfd);
+    if (exited)
+      return;
+  }
+
+  pidlist_clear(&frontier);
+  if (pidlist_push(&frontier, app_pid) != 0)
+    err(EXIT_FAILURE, "%s", __func__);
+
+  while (frontier.length > 0) {
+    pid_t cur_pid = frontier.pids[--frontier.length];
     char path[512];
     DIR *dir;
     struct dirent *ent;
@@ -283,7 +833,7 @@ void update_children(pid_t app_pid)
 
     if (!(dir = opendir(path))) {
       if (errno != ENOENT)
-        fprintf(stderr, "%s: could not open %s: %s\n", __func__, path, strerror(errno));
+        log_warn("%s: could not open %s: %s\n", __func__, path, strerror(errno));
       continue;
     }
 
@@ -295,20 +845,22 @@ void update_children(pid_t app_pid)
 
       task = strtol(ent->d_name, &endptr, 0);
 
-      if (endptr == ent->d_name || errno != 0 || task == 0)
+      if (endptr == ent->d_name || errno != 0 || task <= 0 || task >= pid_max)
         continue;
 
       /* this is a valid pid, so add a perfdata for it if there
        * isn't already one */
       if (!procs_array[task]) {
-        manage(task, app_pid);
+        manage(task, cur_pid, app_pid);
       } else if (procs_array[task]->app_pid != app_pid) {
         /* 
-         * this PID was reused under another application
-         * before we could detect the change.
+         * this TID was reused under another application
+         * before we could detect the change. Exited applications
+         * are reaped through their pidfds, so this only happens
+         * for threads of applications that are still alive.
          */
         unmanage(task, procs_array[task]->app_pid);
-        manage(task, app_pid);
+        manage(task, cur_pid, app_pid);
       }
 
       if (procs_array[task])
@@ -318,12 +870,13 @@ void update_children(pid_t app_pid)
 
       if (!(children_f = fopen(path, "r"))) {
         if (errno != ENOENT)
-          fprintf(stderr, "%s: could not open %s: %s\n", __func__, path, strerror(errno));
+          log_warn("%s: could not open %s: %s\n", __func__, path, strerror(errno));
         continue;
       }
 
       while (fscanf(children_f, "%d", &npid) == 1)
-        frontier[frontier_l++] = npid;
+        if (pidlist_push(&frontier, npid) != 0)
+          err(EXIT_FAILURE, "%s", __func__);
 
       fclose(children_f);
     }
@@ -334,13 +887,6 @@ void update_children(pid_t app_pid)
 
 void procinfo::printCounters(int index)
 {
-  const int counter_event_pairs[][2] = { { 0, EVENT_UNHALTED_CYCLES },
-                                         { 1, EVENT_INSTRUCTIONS },
-                                         { 7, EVENT_SNP },
-                                         { 8, EVENT_LLC_MISSES },
-                                         { 9, EVENT_REMOTE_HITM } };
-  const int num_pairs = sizeof(counter_event_pairs) / sizeof(counter_event_pairs[0]);
-
   for (int i = 0; i < num_pairs; ++i) {
     int ctr = counter_event_pairs[i][0];
     int evt = counter_event_pairs[i][1];
@@ -351,24 +897,23 @@ void procinfo::printCounters(int index)
   int i;
   active = 0;
 
-  if (print_counters)
-    printf("%20s: %20d\n", "TID", THREADS.tid[index]);
+  log_trace("%20s: %20d\n", "TID", THREADS.tid[index]);
+  sampled = true;
 
   for (i = 0; i < num_counters; i++) {
     counters[i].val += counters[i].delta;
     bottleneck[i] = 0;
     if (apps_array[app_pid])
-      apps_array[app_pid]->value[i] += counters[i].delta;
+      apps_array[app_pid]->window.value[i] += counters[i].delta;
   }
 
   for (int k = 0; k < num_pairs; ++k) {
     int ctr = counter_event_pairs[k][0];
     int evt = counter_event_pairs[k][1];
 
-    if (print_counters)
-      printf("%20s: %'20" PRIu64 " %'20" PRIu64 " (%.2f%% scaling, ena=%'" PRIu64 ", run=%'" PRIu64 ")\n",
-             event_names[evt], counters[ctr].val, counters[ctr].delta, (1.0 - counters[ctr].ratio) * 100.0,
-             counters[ctr].auxval1, counters[ctr].auxval2);
+    log_trace("%20s: %'20" PRIu64 " %'20" PRIu64 " (%.2f%% scaling, ena=%'" PRIu64 ", run=%'" PRIu64 ")\n",
+              event_names[evt], counters[ctr].val, counters[ctr].delta, (1.0 - counters[ctr].ratio) * 100.0,
+              counters[ctr].auxval1, counters[ctr].auxval2);
   }
 
   i = 0;
@@ -377,7 +922,7 @@ void procinfo::printCounters(int index)
     val[i] = counters[i].delta;
     bottleneck[i] = 1;
     if (apps_array[app_pid])
-      apps_array[app_pid]->bottleneck[i] += 1;
+      apps_array[app_pid]->window.bottleneck[i] += 1;
   }
 
   i = 1;
@@ -385,9 +930,8 @@ void procinfo::printCounters(int index)
     val[i] = (1000 * counters[1].delta) / (counters[0].delta + 1);
     bottleneck[i] = 1;
     if (apps_array[app_pid])
-      apps_array[app_pid]->bottleneck[i] += 1;
-    if (PRINT_BOTTLENECK)
-      printf("[PID %6d] detected counter %s\n", pid, metric_names[i]);
+      apps_array[app_pid]->window.bottleneck[i] += 1;
+    log_trace("[PID %6d] detected counter %s\n", pid, metric_names[i]);
   }
 
   i = 2; // Mem
@@ -396,9 +940,8 @@ void procinfo::printCounters(int index)
     val[i] = tempvar;
     bottleneck[i] = 1;
     if (apps_array[app_pid])
-      apps_array[app_pid]->bottleneck[i] += 1;
-    if (PRINT_BOTTLENECK)
-      printf("[PID %6d] detected counter %s\n", pid, metric_names[i]);
+      apps_array[app_pid]->window.bottleneck[i] += 1;
+    log_trace("[PID %6d] detected counter %s\n", pid, metric_names[i]);
   }
 
   i = 3; // snp
@@ -407,9 +950,8 @@ void procinfo::printCounters(int index)
     val[i] = tempvar;
     bottleneck[i] = 1;
     if (apps_array[app_pid])
-      apps_array[app_pid]->bottleneck[i] += 1;
-    if (PRINT_BOTTLENECK)
-      printf("[PID %6d] detected counter %s\n", pid, metric_names[i]);
+      apps_array[app_pid]->window.bottleneck[i] += 1;
+    log_trace("[PID %6d] detected counter %s\n", pid, metric_names[i]);
   }
 
   i = 4; // cross soc
@@ -418,498 +960,2175 @@ void procinfo::printCounters(int index)
     val[i] = tempvar;
     bottleneck[i] = 1;
     if (apps_array[app_pid])
-      apps_array[app_pid]->bottleneck[i] += 1;
-    if (PRINT_BOTTLENECK)
-      printf("[PID %6d] detected counter %s\n", pid, metric_names[i]);
+      apps_array[app_pid]->window.bottleneck[i] += 1;
+    log_trace("[PID %6d] detected counter %s\n", pid, metric_names[i]);
   }
 }
 void procinfo::readCounters(int index)
 {
-  printf("[APP %6d | TID %5d] readCounters():\n", app_pid, pid);
+  /* liveness is tracked per application with its pidfd */
   if (pid == 0) {
     return;
   }
-  if (kill(pid, 0) < 0)
-    if (errno == ESRCH) {
-      printf("Process %d does not exist \n", pid);
-      return;
-    } else
-      printf("Hmmm what the hell happened??? \n");
-  else
-    printf(" Process exists so just continuing \n");
 
   printCounters(index);
   return;
 }
 
-//File limits for metadata management
-void setup_file_limits()
+/**
+ * Read the counters that the BPF collector accumulated for @an over the last
+ * window, and estimate its per-thread bottlenecks.
+ *
+ * The collector only counts per application, so the application's busy
+ * threads are treated as identical: the number of active threads is the
+ * number of CPUs' worth of cycles it used, and each of them counts towards a
+ * bottleneck when the application as a whole exceeds its threshold.
+ */
+static void read_app_counters_bpf(struct appinfo *an, double window_secs)
 {
-  struct rlimit limit;
-
-  limit.rlim_cur = 65535;
-  limit.rlim_max = 65535;
-  printf("Setting file limits:\n");
-  if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
-    perror("setrlimit");
-    exit(1);
-  }
+  uint64_t val[N_EVENTS];
 
-  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
-    perror("getrlimit");
-    exit(1);
+  if (perfio_bpf_read_app(an->pid, val) != 0) {
+    log_warn("[APP %6d] failed to read BPF counters: %s\n", an->pid, strerror(errno));
+    return;
   }
-  printf("\tThe soft limit is %lu\n", limit.rlim_cur);
-  printf("\tThe hard limit is %lu\n", limit.rlim_max);
-  return;
-}
-
-int main()
-{
-  //Initialization and basic checks
-  int init_error = 0;
 
-  int pids_to_monitor_l = 0;
+  for (int k = 0; k < num_pairs; ++k)
+    an->window.value[counter_event_pairs[k][0]] += val[counter_event_pairs[k][1]];
 
-  setlocale(LC_ALL, "");
+  const uint64_t cycles = an->window.value[0];
+  uint64_t active = ceil(cycles / (cpuinfo->clock_rate * window_secs));
 
-  if (geteuid() != 0) {
-    fprintf(stderr, "I need root access for %s\n", cgroot);
-    return 1;
-  }
+  active = MIN(active, an->refcount);
+  if (active == 0 || cycles / active <= (uint64_t)thresh_pt[METRIC_ACTIVE])
+    return;
 
-  srandom(random_seed);
+  an->window.bottleneck[METRIC_ACTIVE] += active;
+  if ((an->window.value[1] * 1000) / (1 + cycles) > (uint64_t)thresh_pt[METRIC_AVGIPC])
+    an->window.bottleneck[METRIC_AVGIPC] += active;
+  if ((long)(((double)cpuinfo->clock_rate * an->window.value[8]) / (cycles + 1)) > thresh_pt[METRIC_MEM])
+    an->window.bottleneck[METRIC_MEM] += active;
+  if ((long)(((double)cpuinfo->clock_rate * an->window.value[7]) / (cycles + 1)) > thresh_pt[METRIC_INTRA])
+    an->window.bottleneck[METRIC_INTRA] += active;
+  if ((long)(((double)cpuinfo->clock_rate * an->window.value[9]) / (cycles + 1)) > thresh_pt[METRIC_INTER])
+    an->window.bottleneck[METRIC_INTER] += active;
+}
 
-  setup_file_limits();
-  // Initialize what event we want
+/**
+ * Limit @an to its cpu_quota_milli of CPU time every CPU_PERIOD_US, and
+ * weigh it by its cpu_weight against the applications it shares CPUs with;
+ * an application that does not share has neither limit nor weight.
+ *
+ * Returns 0, or -1 (with errno set) if the limit cannot be written.
+ */
+static int enforce_share(struct appinfo *an)
+{
+  const int weight = an->cpu_weight > 0 ? an->cpu_weight : 100;
+  char cg_name[256];
 
-  signal(SIGTERM, &sigterm_handler);
-  signal(SIGQUIT, &sigterm_handler);
-  signal(SIGINT, &sigterm_handler);
-  signal(SIGUSR1, &siginfo_handler);
+  /* on v2 the cpu controller shares the application's cgroup */
+  if (cg_version() == CG_V2)
+    snprintf(cg_name, sizeof cg_name, "%s", an->cg_name);
+  else
+    snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/app-%d", an->pid);
+  if (cg_version() == CG_V2) {
+    if ((an->cpu_quota_milli > 0
+         ? cg_write_string(cgroot, "cpu", cg_name, "cpu.max", "%ld %d",
+                           (long)an->cpu_quota_milli * CPU_PERIOD_US / 1000, CPU_PERIOD_US)
+         : cg_write_string(cgroot, "cpu", cg_name, "cpu.max", "max %d", CPU_PERIOD_US)) != 0)
+      return -1;
+    return cg_write_string(cgroot, "cpu", cg_name, "cpu.weight", "%d", weight);
+  }
 
-  if (init_thresholds == 0) {
-    /* create array */
-    FILE *pid_max_fp;
-    int pid_max = 0;
+  /* the period is the kernel's default, 100ms */
+  if (cg_write_string(cgroot, "cpu", cg_name, "cpu.cfs_quota_us", "%ld",
+                      an->cpu_quota_milli > 0 ? (long)an->cpu_quota_milli * CPU_PERIOD_US / 1000 : -1L) != 0)
+    return -1;
+  return cg_write_string(cgroot, "cpu", cg_name, "cpu.shares", "%d", weight * 1024 / 100);
+}
 
-    if (!(pid_max_fp = fopen("/proc/sys/kernel/pid_max", "r")) || fscanf(pid_max_fp, "%d", &pid_max) != 1) {
-      perror("Could not get pid_max");
-      return 1;
-    }
-    printf("pid_max = %d\n", pid_max);
-    apps_array = (struct appinfo **)calloc(pid_max, sizeof *apps_array);
-    procs_array = (struct procinfo **)calloc(pid_max, sizeof *procs_array);
-    fclose(pid_max_fp);
+/**
+ * Submit the cpuset writes queued for steps [@first, @end) of @plan, whose
+ * indices in the batch are in @writes, and set @errors[j] to why the first
+ * of application j's writes that failed did.
+ */
+static void submit_cpusets(const struct reconfig_plan *plan, int first, int end, const int writes[], int errors[])
+{
+  if (enforcer != ENFORCER_CPUSET)
+    return;
+  if (cg_batch_submit(cpuset_batch) != 0)
+    log_warn("Failed to write cpusets through io_uring (%s); writing them one at a time from now on\n",
+             strerror(errno));
+  for (int s = first; s < end; ++s) {
+    const int app = plan->steps[s].app;
+
+    if (writes[s] >= 0 && errors[app] == 0)
+      errors[app] = cg_batch_result(cpuset_batch, writes[s]);
+  }
+  cg_batch_reset(cpuset_batch);
+}
 
-    /* get CPU topology */
-    if ((cpuinfo = get_cpuinfo())) {
-      printf("CPU Info\n========\n");
-      printf("Max clock rate: %'lu Hz\n", cpuinfo->clock_rate);
-      printf("Topology: %d threads across %d sockets:\n", cpuinfo->total_cpus, cpuinfo->num_sockets);
-      for (int i = 0; i < cpuinfo->num_sockets; ++i) {
-        printf(" socket %d has threads:", i);
-        for (int j = 0; j < cpuinfo->sockets[i].num_cpus; ++j)
-          printf(" %d", cpuinfo->sockets[i].cpus[j].tnumber);
-        printf("\n");
+/**
+ * Restrict each of the @num_apps applications in @apps whose CPUs @changed to
+ * its CPUs in @sets, and set @errors[j] to 0, or to why application j could
+ * not be restricted. The cpusets are written as one transaction, planned by
+ * reconfig_plan(): the CPUs that applications give up are freed before
+ * others take them, so that no two hold the same CPUs in between. Where
+ * applications swap CPUs, the writes from the first overlap until it ends
+ * are submitted on their own, and how long that takes is counted.
+ */
+static void enforce_budgets(int num_apps, struct appinfo *apps[], cpu_set_t *sets[], const bool changed[],
+                            int errors[])
+{
+  const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  cpu_set_t **from = (cpu_set_t **)malloc(num_apps * sizeof *from);
+  struct reconfig_plan plan;
+  struct timespec overlap_start;
+  bool overlapping = false;
+  int first = 0;
+  int *writes;
+
+  for (int j = 0; j < num_apps; ++j) {
+    from[j] = apps[j]->cpuset[0];
+    errors[j] = 0;
+  }
+  if (reconfig_plan(&plan, num_apps, from, sets, changed, cpuinfo->total_cpus) != 0) {
+    for (int j = 0; j < num_apps; ++j)
+      if (changed[j])
+        errors[j] = errno;
+    free(from);
+    return;
+  }
+  writes = (int *)malloc(plan.num_steps * sizeof *writes);
+
+  if (enforcer == ENFORCER_CPUSET)
+    cg_batch_reset(cpuset_batch);
+  for (int r = 0; r < plan.num_rounds; ++r) {
+    const int start = r > 0 ? plan.rounds[r - 1].end : 0;
+
+    for (int s = start; s < plan.rounds[r].end; ++s) {
+      const struct reconfig_step *step = &plan.steps[s];
+      struct appinfo *an = apps[step->app];
+      int fd;
+
+      writes[s] = -1;
+      if (enforcer == ENFORCER_SCHED_EXT) {
+        if (schedext_set_cpus(an->pid, step->set, sz) != 0 && errors[step->app] == 0)
+          errors[step->app] = errno;
+      } else if ((fd = app_cgroup_fd(an, cntrlr, &an->cpus_fd, "cpuset.cpus", O_RDWR)) < 0 ||
+                 (writes[s] = cg_batch_write_cpus(cpuset_batch, fd, step->set, cpuinfo->total_cpus,
+                                                  s == start && s > first)) < 0) {
+        if (errors[step->app] == 0)
+          errors[step->app] = errno;
       }
-    } else {
-      fprintf(stderr, "Failed to get CPU topology.\n");
-      init_error = -1;
-      goto END;
-    }
-    mode_t oldmask = umask(0);
-
-    /* initialize thresholds */
-    thresh_pt[METRIC_ACTIVE] = 1000000; // cycles
-    thresh_pt[METRIC_AVGIPC] = 70; // instructions scaled to 100
-    thresh_pt[METRIC_MEM] = SHAR_MEM_THRESH / cpuinfo->total_cores; // Mem
-    thresh_pt[METRIC_INTRA] = SHAR_COHERENCE_THRESH;
-    thresh_pt[METRIC_INTER] = SHAR_COHERENCE_THRESH;
-    // thresh_pt[METRIC_REMOTE] = SHAR_REMOTE_THRESH;
-
-    ordernum = 0;
-    counter_order[ordernum++] = METRIC_INTER;
-    counter_order[ordernum++] = METRIC_INTRA;
-    counter_order[ordernum++] = METRIC_MEM;
-    counter_order[ordernum++] = METRIC_AVGIPC;
-    num_counter_orders = ordernum;
-
-    /* create run directory */
-    if (mkdir(SAM_RUN_DIR, 01777) < 0 && errno != EEXIST) {
-      fprintf(stderr, "Failed to create %s: %s\n", SAM_RUN_DIR, strerror(errno));
-      exit(EXIT_FAILURE);
     }
 
-    /* create cgroup */
-    char *mems_string = NULL;
-    char *cpus_string = NULL;
-    if (cg_create_cgroup(cgroot, cntrlr, SAM_CGROUP_NAME) < 0 && errno != EEXIST) {
-      perror("Failed to create cgroup");
-      init_error = -1;
-      goto END;
+    if (plan.rounds[r].overlaps != overlapping) {
+      struct timespec now;
+
+      submit_cpusets(&plan, first, plan.rounds[r].end, writes, errors);
+      first = plan.rounds[r].end;
+      clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+      if (overlapping)
+        cpuset_overlap_ns_total += timespec_to_ns(timespec_sub(now, overlap_start));
+      else {
+        overlap_start = now;
+        cpuset_overlaps_total++;
+      }
+      overlapping = plan.rounds[r].overlaps;
     }
+  }
+  if (first < plan.num_steps)
+    submit_cpusets(&plan, first, plan.num_steps, writes, errors);
+
+  cpuset_shrink_writes_total += plan.num_shrinks;
+  cpuset_grow_writes_total += plan.num_grows;
+  if (plan.num_rounds > 1)
+    log_debug("Wrote %d cpusets in %d rounds, %d of them giving up CPUs first\n", plan.num_steps, plan.num_rounds,
+              plan.num_shrinks);
+  reconfig_plan_free(&plan);
+  free(from);
+  free(writes);
+
+  if (!cpu_controller)
+    return;
+  for (int j = 0; j < num_apps; ++j) {
+    struct appinfo *an = apps[j];
 
-    if (cg_read_string(cgroot, cntrlr, ".", "cpuset.mems", &mems_string) < 0 ||
-        cg_write_string(cgroot, cntrlr, SAM_CGROUP_NAME, "cpuset.mems", "%s", mems_string) < 0 ||
-        cg_read_string(cgroot, cntrlr, ".", "cpuset.cpus", &cpus_string) < 0 ||
-        cg_write_string(cgroot, cntrlr, SAM_CGROUP_NAME, "cpuset.cpus", "%s", cpus_string) < 0) {
-      perror("Failed to create cgroup");
-      free(mems_string);
-      free(cpus_string);
-      init_error = -1;
-      goto END;
+    /* on v1 the application has a cgroup in the cpu hierarchy once its first thread joins it */
+    if ((an->cpu_quota_milli == an->applied_quota_milli && an->cpu_weight == an->applied_weight) ||
+        (cg_version() == CG_V1 && an->cpu_tasks_fd < 0))
+      continue;
+    if (enforce_share(an) != 0) {
+      log_warn("[APP %6d] Failed to set its share of the CPUs: %s\n", an->pid, strerror(errno));
+      continue;
     }
-    umask(oldmask);
-    free(mems_string);
-    free(cpus_string);
-    init_thresholds = 1;
+    an->applied_quota_milli = an->cpu_quota_milli;
+    an->applied_weight = an->cpu_weight;
   }
-  if (init_error == -1)
-    goto END;
+}
 
-  while (!stoprun) {
-    pid_t pids_to_monitor[8192];
+/**
+ * The NUMA nodes, a bit each, of the CPUs in @set.
+ */
+static uint64_t cpuset_nodes(const cpu_set_t *set)
+{
+  const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  uint64_t nodes = 0;
+
+  for (int s = 0; s < cpuinfo->num_sockets; ++s)
+    for (int j = 0; j < cpuinfo->sockets[s].num_cpus; ++j)
+      if (CPU_ISSET_S(cpuinfo->sockets[s].cpus[j].tnumber, sz, set))
+        nodes |= UINT64_C(1) << cpuinfo->sockets[s].cpus[j].node_id;
+  return nodes;
+}
 
-    /* get iteration start time */
-    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+/**
+ * The resident memory of process @pid, in bytes, or 0 if it cannot be read.
+ */
+static uint64_t resident_bytes(pid_t pid)
+{
+  char path[64];
+  unsigned long size, resident = 0;
+  FILE *fp;
+
+  snprintf(path, sizeof path, "/proc/%d/statm", pid);
+  if (!(fp = fopen(path, "r")))
+    return 0;
+  if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  fclose(fp);
+  return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
 
-    /* check for new applications / threads */
-    {
-      DIR *dr;
-      struct dirent *de;
-      dr = opendir(SAM_RUN_DIR);
+/**
+ * Move @an's memory to the NUMA nodes of @set, the CPUs it has been given,
+ * once they have stayed on those nodes for mem_follow_windows windows, so
+ * that a brief move does not drag its pages back and forth. The kernel moves
+ * the pages before the write of cpuset.mems returns, which is what the
+ * migration allowance bounds.
+ */
+static void follow_memory(struct appinfo *an, const cpu_set_t *set)
+{
+  const uint64_t all_nodes = cpuinfo->num_nodes >= 64 ? ~UINT64_C(0) : (UINT64_C(1) << cpuinfo->num_nodes) - 1;
+  const uint64_t nodes = cpuset_nodes(set);
+  char buf[1024];
+  int node_list[64], n = 0;
+  uint64_t bytes;
 
-      if (dr == NULL) {
-        perror("Could not open " SAM_RUN_DIR);
-        return 0;
-      }
+  if (tunables.mem_follow_windows == 0 || cpuinfo->num_nodes < 2 || cpuinfo->num_nodes > 64)
+    return;
 
-      for (struct procinfo *pd = procs_list; pd; pd = pd->next)
-        pd->touched = false;
+  if (nodes != an->mem_nodes_want) {
+    an->mem_nodes_want = nodes;
+    an->mem_nodes_stable = 0;
+  }
+  if (an->mem_nodes_stable < tunables.mem_follow_windows)
+    an->mem_nodes_stable++;
+  if (an->mem_nodes_stable < tunables.mem_follow_windows || nodes == (an->mem_nodes ? an->mem_nodes : all_nodes) ||
+      mem_migrate_allowance < 0)
+    return;
 
-      while ((de = readdir(dr)) != NULL) {
-        if (!((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))) {
-          int app_pid = atoi(de->d_name);
-          update_children(app_pid);
-        }
-      }
+  for (int node = 0; node < 64; ++node)
+    if (nodes & (UINT64_C(1) << node))
+      node_list[n++] = node;
+  intlist_to_string(node_list, n, buf, sizeof buf, ",");
+  bytes = resident_bytes(an->pid);
+
+  /* on v1, changing cpuset.mems only moves pages that are allocated later unless asked to */
+  if ((cg_version() == CG_V1 && an->mem_nodes == 0 &&
+       cg_write_bool(cgroot, cntrlr, an->cg_name, "cpuset.memory_migrate", true) != 0) ||
+      cg_write_string(cgroot, cntrlr, an->cg_name, "cpuset.mems", "%s", buf) != 0) {
+    log_warn("[APP %6d] failed to move memory to nodes %s: %s\n", an->pid, buf, strerror(errno));
+    an->mem_nodes_stable = 0;
+    return;
+  }
 
-      /* remove all untouched children */
-      for (struct procinfo *pd = procs_list; pd;) {
-        struct procinfo *next = pd->next;
-        if (!pd->touched)
-          unmanage(pd->pid, pd->app_pid);
-        pd = next;
-      }
+  log_info("[APP %6d] moved %" PRIu64 " MiB of memory to nodes %s\n", an->pid, bytes >> 20, buf);
+  an->mem_nodes = nodes;
+  mem_migrate_allowance -= bytes;
+  mem_migrations_total++;
+  mem_migrated_bytes_total += bytes;
+}
+
+/**
+ * Read the CPUs that applications may be given now into @set: the effective
+ * CPUs of the cgroup that SAM_CGROUP_NAME is in, less the housekeeping_cpus
+ * of @t. Should that leave none, the housekeeping CPUs are not held back.
+ *
+ * Returns the number of CPUs in @set, or -1 (with errno set) if they cannot
+ * be read.
+ */
+static int read_allocatable_cpus(const struct tunables *t, cpu_set_t *set)
+{
+  const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  char *parent = NULL;
+  int n, kept;
+
+  if (cg_read_string(cgroot, cntrlr, ".", cg_effective_param("cpuset.cpus"), &parent) < 0)
+    return -1;
+  n = string_to_cpuset(parent, set, cpuinfo->total_cpus);
+  free(parent);
+  if (n < 0)
+    return -1;
+
+  kept = n;
+  for (int c = 0; c < MIN(cpuinfo->total_cpus, CPU_SETSIZE); ++c)
+    if (CPU_ISSET_S(c, sz, set) && CPU_ISSET(c, &t->housekeeping_cpus))
+      kept--;
+  if (kept == 0)
+    return n;
+  for (int c = 0; c < MIN(cpuinfo->total_cpus, CPU_SETSIZE); ++c)
+    if (CPU_ISSET(c, &t->housekeeping_cpus))
+      CPU_CLR_S(c, sz, set);
+  return kept;
+}
+
+static int write_cpus(const char *cg_name, const cpu_set_t *set)
+{
+  char buf[CG_CPUS_BUFLEN];
+
+  if (cpuset_to_string(set, cpuinfo->total_cpus, buf, sizeof buf) < 0)
+    return -1;
+  return cg_write_string(cgroot, cntrlr, cg_name, "cpuset.cpus", "%s", buf);
+}
+
+/**
+ * Take in the CPUs that applications may be given now, before they are
+ * allocated. The CPUs that were added go to SAM_CGROUP_NAME at once, so
+ * that its applications can be given them; those that were taken away stay
+ * until the applications have left them, in settle_capacity().
+ *
+ * Returns whether the CPUs changed.
+ */
+static bool update_capacity(void)
+{
+  const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  cpu_set_t *next = CPU_ALLOC(cpuinfo->total_cpus);
+  char buf[CG_CPUS_BUFLEN];
+  bool changed = false;
+  int n;
+
+  if ((n = read_allocatable_cpus(&tunables, next)) < 0)
+    log_warn("Failed to read the CPUs of the parent cgroup: %s\n", strerror(errno));
+  else if (n > 0 && !CPU_EQUAL_S(sz, next, allocatable_cpus)) {
+    cpuset_to_string(next, cpuinfo->total_cpus, buf, sizeof buf);
+    log_info("Applications may now be given CPUs %s (%d, was %d)\n", buf, n, num_allocatable_cpus);
+    memcpy(allocatable_cpus, next, sz);
+    num_allocatable_cpus = n;
+    capacity_changes_total++;
+    changed = true;
+  }
+
+  /* CPUs that went offline are gone from SAM_CGROUP_NAME already, and cannot be written back */
+  CPU_OR_S(sz, next, sam_cpus, allocatable_cpus);
+  if (!CPU_EQUAL_S(sz, next, sam_cpus)) {
+    if (write_cpus(SAM_CGROUP_NAME, next) == 0)
+      memcpy(sam_cpus, next, sz);
+    else if (write_cpus(SAM_CGROUP_NAME, allocatable_cpus) == 0)
+      memcpy(sam_cpus, allocatable_cpus, sz);
+    else
+      log_warn("Failed to give " SAM_CGROUP_NAME " more CPUs: %s\n", strerror(errno));
+  }
+  CPU_FREE(next);
+  return changed;
+}
+
+/**
+ * Once the applications have been allocated the CPUs that may be given now,
+ * give the same to every cgroup under SAM_CGROUP_NAME that samd did not
+ * allocate CPUs to (those of the pool, and of applications not allocated
+ * yet), and then take the CPUs that are gone away from SAM_CGROUP_NAME. On
+ * v1 a cgroup cannot have CPUs that its children keep, so this is retried
+ * every window until it succeeds.
+ */
+static void settle_capacity(void)
+{
+  const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  cpu_set_t *kept = CPU_ALLOC(cpuinfo->total_cpus);
+  const int dir_fd = cg_open(cgroot, cntrlr, SAM_CGROUP_NAME, NULL, O_RDONLY | O_DIRECTORY);
+  struct dirent *ent;
+  DIR *dir = NULL;
+
+  if (dir_fd >= 0 && !(dir = fdopendir(dir_fd)))
+    close(dir_fd);
+  if (dir) {
+    while ((ent = readdir(dir))) {
+      char cg_name[sizeof SAM_CGROUP_NAME + sizeof ent->d_name];
+      struct appinfo *owner = NULL;
+
+      if (ent->d_type != DT_DIR || ent->d_name[0] == '.')
+        continue;
+      snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/%s", ent->d_name);
+      for (struct appinfo *an = apps_list; an && !owner; an = an->next)
+        if (strcmp(an->cg_name, cg_name) == 0 && CPU_COUNT_S(sz, an->cpuset[0]) > 0)
+          owner = an;
+
+      /* an application that was not given CPUs this window keeps those it has that are left */
+      if (owner) {
+        CPU_AND_S(sz, kept, owner->cpuset[0], allocatable_cpus);
+        if (CPU_EQUAL_S(sz, kept, owner->cpuset[0]))
+          continue;
+        if (CPU_COUNT_S(sz, kept) == 0)
+          memcpy(kept, allocatable_cpus, sz);
+        if (cg_pwrite_cpus(app_cgroup_fd(owner, cntrlr, &owner->cpus_fd, "cpuset.cpus", O_RDWR), kept,
+                           cpuinfo->total_cpus) == 0)
+          memcpy(owner->cpuset[0], kept, sz);
+        else
+          log_warn("[APP %6d] failed to leave CPUs that are gone: %s\n", owner->pid, strerror(errno));
+      } else if (write_cpus(cg_name, allocatable_cpus) != 0 && errno != ENOENT)
+        log_warn("Failed to set the CPUs of %s: %s\n", cg_name, strerror(errno));
+    }
+    closedir(dir);
+  }
+
+  if (write_cpus(SAM_CGROUP_NAME, allocatable_cpus) == 0)
+    memcpy(sam_cpus, allocatable_cpus, sz);
+  else
+    log_warn("Failed to take CPUs that are gone from " SAM_CGROUP_NAME ": %s\n", strerror(errno));
+  CPU_FREE(kept);
+}
+
+/**
+ * Make SAM_CGROUP_NAME the cpuset partition that the tunables ask for, once
+ * they ask for a different one. As a "root" or "isolated" partition it has
+ * the CPUs it is given to itself, so applications are given CPUs that no
+ * task outside SAM_CGROUP_NAME runs on; the housekeeping_cpus are what the
+ * rest of the system keeps.
+ */
+static void update_partition(void)
+{
+  static char applied[sizeof tunables.cpuset_partition];
+  const bool first = applied[0] == '\0';
+  const bool member = strcmp(tunables.cpuset_partition, "member") == 0;
+  char state[128];
+
+  if (strcmp(applied, tunables.cpuset_partition) == 0)
+    return;
+  snprintf(applied, sizeof applied, "%s", tunables.cpuset_partition);
+  /* a cgroup starts as a member, but an earlier samd may have left SAM_CGROUP_NAME a partition */
+  if (first && member && cg_version() != CG_V2)
+    return;
+  if (cg_set_partition(cgroot, cntrlr, SAM_CGROUP_NAME, applied, state, sizeof state) != 0)
+    log_warn("Failed to set the cpuset partition of " SAM_CGROUP_NAME " to %s: %s\n", applied,
+             state[0] ? state : strerror(errno));
+  else if (!first || !member)
+    log_info("The cpuset partition of " SAM_CGROUP_NAME " is now %s\n", applied);
+}
+
+static int compare_procs_by_app(const void *a_ptr, const void *b_ptr)
+{
+  const struct procinfo *a = *(struct procinfo *const *)a_ptr;
+  const struct procinfo *b = *(struct procinfo *const *)b_ptr;
+
+  return (a->app_pid > b->app_pid) - (a->app_pid < b->app_pid);
+}
+
+/**
+ * Partition the threads of each application into clusters of up to
+ * wake_cluster_size threads, from the wakeups traced over the last window.
+ */
+static void update_thread_clusters(void)
+{
+  static struct procinfo **procs_by_app;
+  static int *cluster_of;
+  static int capacity;
+  int n = 0;
+  size_t e = 0;
+
+  if (wakegraph_read(&wake_graph) != 0) {
+    log_warn("Failed to read thread wakeups: %s\n", strerror(errno));
+    return;
+  }
+
+  if (num_procs > capacity) {
+    procs_by_app = (struct procinfo **)realloc(procs_by_app, num_procs * sizeof *procs_by_app);
+    cluster_of = (int *)realloc(cluster_of, num_procs * sizeof *cluster_of);
+    if (!procs_by_app || !cluster_of)
+      err(EXIT_FAILURE, "thread clusters");
+    capacity = num_procs;
+  }
 
-      closedir(dr);
+  for (struct procinfo *pd = procs_list; pd; pd = pd->next)
+    procs_by_app[n++] = pd;
+  qsort(procs_by_app, n, sizeof *procs_by_app, &compare_procs_by_app);
+
+  /* both the threads and the edges are sorted by application */
+  for (int i = 0, j; i < n; i = j) {
+    const pid_t app_pid = procs_by_app[i]->app_pid;
+    size_t first_edge;
+    int num_clusters;
+
+    pidlist_clear(&app_tids);
+    for (j = i; j < n && procs_by_app[j]->app_pid == app_pid; ++j)
+      if (pidlist_push(&app_tids, procs_by_app[j]->pid) != 0)
+        err(EXIT_FAILURE, "app_tids");
+
+    while (e < wake_graph.num_edges && wake_graph.edges[e].app_pid < app_pid)
+      ++e;
+    for (first_edge = e; e < wake_graph.num_edges && wake_graph.edges[e].app_pid == app_pid; ++e)
+      ;
+
+    num_clusters = wakegraph_partition(&wake_graph.edges[first_edge], e - first_edge, app_tids.pids, app_tids.length,
+                                       wake_cluster_size, cluster_of);
+    if (num_clusters < 0) {
+      log_warn("[APP %6d] failed to cluster threads: %s\n", app_pid, strerror(errno));
+      num_clusters = 0;
     }
 
-    // printf("PIDs tracked:\n");
-    pids_to_monitor_l = 0;
-    for (struct procinfo *pd = procs_list; pd; pd = pd->next) {
-      pids_to_monitor[pids_to_monitor_l++] = pd->pid;
-      //printf("%d\n", pd->pid);
+    for (int k = i; k < j; ++k)
+      procs_by_app[k]->cluster = num_clusters > 0 ? cluster_of[k - i] : -1;
+    if (apps_array[app_pid]) {
+      apps_array[app_pid]->window.num_clusters = num_clusters;
+      log_debug("[APP %6d] %d threads in %d clusters from %zu wakeup edges\n", app_pid, j - i, num_clusters,
+             e - first_edge);
     }
+  }
+}
+
+/**
+ * A core that an application has CPUs on: those of them that are SMT
+ * siblings.
+ */
+struct app_core {
+  int sock_id;
+  int core_id;
+  cpu_set_t *cpus;
+};
+
+/* by wakeup cluster, so that threads of a cluster are packed together */
+static int compare_procs_by_cluster(const void *a_ptr, const void *b_ptr)
+{
+  const struct procinfo *a = *(struct procinfo *const *)a_ptr;
+  const struct procinfo *b = *(struct procinfo *const *)b_ptr;
 
-    clock_gettime(CLOCK_MONOTONIC_RAW, &perf_start);
-    perfio_read_counters(pids_to_monitor, pids_to_monitor_l, &perf_sleep, &perf_setup, &perf_read);
+  if (a->cluster != b->cluster)
+    return (a->cluster > b->cluster) - (a->cluster < b->cluster);
+  return (a->pid > b->pid) - (a->pid < b->pid);
+}
 
-    // count for all tids for a particular interval of time
-    displayTIDEvents(pids_to_monitor, pids_to_monitor_l); // required to copy values to my data structures
+/**
+ * Pin the @n threads of application @an within its CPUs @set, by what their
+ * counters showed: threads that snoop are packed onto the SMT siblings of as
+ * few cores as take them, neighbouring cores sharing a last-level cache;
+ * memory-bound threads get cores of their own, taken from each socket in
+ * turn; and the rest may run anywhere in @set.
+ *
+ * Returns the number of threads pinned.
+ */
+static int place_app_threads(struct appinfo *an, const cpu_set_t *set, struct procinfo *threads[], int n)
+{
+  const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  struct app_core *cores = (struct app_core *)calloc(cpuinfo->total_cpus, sizeof *cores);
+  int *spread = (int *)calloc(cpuinfo->total_cpus, sizeof *spread);
+  bool *packed = (bool *)calloc(cpuinfo->total_cpus, sizeof *packed);
+  int num_cores = 0, num_spread = 0, num_unpacked = 0;
+  int num_pack_threads = 0, num_spread_threads = 0, next_spread = 0;
+
+  if (!cores || !spread || !packed)
+    err(EXIT_FAILURE, "%s", __func__);
+
+  /* Linux numbers the first sibling of every core of a socket before the second */
+  for (int s = 0; s < cpuinfo->num_sockets; ++s) {
+    const int first = num_cores;
 
-    /* read counters */
-    for (struct procinfo *pd = procs_list; pd; pd = pd->next) {
-      int my_index = searchTID(pd->pid);
-      if (my_index != -1)
-        pd->printCounters(my_index);
+    for (int j = 0; j < cpuinfo->sockets[s].num_cpus; ++j) {
+      const struct cpu *cpu = &cpuinfo->sockets[s].cpus[j];
+      int c = first;
+
+      if (!CPU_ISSET_S(cpu->tnumber, sz, set))
+        continue;
+      while (c < num_cores && cores[c].core_id != cpu->core_id)
+        ++c;
+      if (c == num_cores) {
+        cores[c].sock_id = s;
+        cores[c].core_id = cpu->core_id;
+        cores[c].cpus = CPU_ALLOC(cpuinfo->total_cpus);
+        CPU_ZERO_S(sz, cores[c].cpus);
+        num_cores++;
+      }
+      CPU_SET_S(cpu->tnumber, sz, cores[c].cpus);
     }
+  }
 
-    /* derive app statistics */
-    for (struct appinfo *an = apps_list; an; an = an->next) {
-      if (an == apps_list)
-        an->appno = num_apps - 1;
-      else
-        an->appno = an->prev->appno - 1;
-
-      if (an->OMPvalid) {
-        if (an->OMPptr) {
-          if (an->OMPptr->valid_progress)
-            printf("[APP %6d] has valid progress of %f \n", an->pid, an->OMPptr->progress);
-          else
-            printf("[APP %6d] has no valid progress \n", an->pid);
-        }
-      } else {
-        an->OMPfd = shm_open(an->OMPname, O_RDWR, 0777);
-        if (an->OMPfd == -1)
-          printf("Error. |%s| shared memory segment does not exist\n", an->OMPname);
-        else {
-          an->OMPptr =
-            (struct OMPdata *)mmap(NULL, sizeof(struct OMPdata), PROT_READ | PROT_WRITE, MAP_SHARED, an->OMPfd, 0);
-          if (an->OMPptr == MAP_FAILED)
-            printf("Mmap failed \n");
-          else
-            an->OMPvalid = 1;
+  /* the cores, taking one from each socket in turn */
+  for (int round = 0; num_spread < num_cores; ++round) {
+    for (int s = 0; s < cpuinfo->num_sockets; ++s) {
+      for (int c = 0, k = 0; c < num_cores; ++c) {
+        if (cores[c].sock_id == s && k++ == round) {
+          spread[num_spread++] = c;
+          break;
         }
       }
+    }
+  }
 
-      an->metric[METRIC_ACTIVE] = an->value[0];
-      an->metric[METRIC_AVGIPC] = (an->value[1] * 1000) / (1 + an->value[0]);
-      an->metric[METRIC_MEM] = an->value[8];
-      an->metric[METRIC_INTRA] = an->value[7] - (an->value[5] + an->value[6]);
-      an->metric[METRIC_INTER] = an->value[9];
-      if (an->times_allocated > 0)
-        an->extra_metric[EXTRA_METRIC_IpCOREpS] =
-          an->value[1] / CPU_COUNT_S(CPU_ALLOC_SIZE(cpuinfo->total_cpus), an->cpuset[0]);
-      an->extra_metric[EXTRA_METRIC_DRAM_REQUESTS] = 0;     // TODO
-      an->extra_metric[EXTRA_METRIC_LLC_MISSES] = an->value[8];
-
-      printf("[APP %6d] Bottlenecks: ", an->pid);
-      for (int i = 0; i < N_METRICS; ++i)
-        printf(" %lu", an->bottleneck[i]);
-      printf("\n");
-      if (!(an->ts.tv_sec == 0 && an->ts.tv_nsec == 0)) {
-        struct timespec diff_ts;
-        clock_gettime(CLOCK_MONOTONIC_RAW, &diff_ts);
-
-        if (diff_ts.tv_nsec < an->ts.tv_nsec) {
-          diff_ts.tv_sec = diff_ts.tv_sec - an->ts.tv_sec - 1;
-          diff_ts.tv_nsec = 1000000000 - (an->ts.tv_nsec - diff_ts.tv_nsec);
-        } else {
-          diff_ts.tv_sec -= an->ts.tv_sec;
-          diff_ts.tv_nsec -= an->ts.tv_nsec;
-        }
-        printf("[APP %6d] perf metric %lu \n", an->pid, an->metric[EXTRA_METRIC_IPS]);
-        /*
-               * Compute instructions / second
-               */
-        an->extra_metric[EXTRA_METRIC_IPS] =
-          an->value[EVENT_INSTRUCTIONS] / (diff_ts.tv_sec + (double)diff_ts.tv_nsec / 1000000000);
-      } else
-        clock_gettime(CLOCK_MONOTONIC_RAW, &an->ts);
-
-      //Added for Hill climbing, initialize
-      an->hill_direction =
-        1; /* 1 means positive direction, -1 means negative direction, store direction in order to resume*/
-      an->suspend_iter = 0; /*count the number of iterations suspended*/
-      an->hill_resume = false;
-
-      an->bin_search_resource = BIN_INITIAL_RESOURCE;
-      an->bin_direction = 1;
-    }
-    clock_gettime(CLOCK_MONOTONIC_RAW, &perf_finish);
-
-#if !defined(JUST_PERFMON)
-    if (num_apps > 0) {
-      clock_gettime(CLOCK_MONOTONIC_RAW, &sched_start);
-
-      /* map applications */
-      cpu_set_t *remaining_cpus = CPU_ALLOC(cpuinfo->total_cpus);
-      size_t rem_cpus_sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
-
-      CPU_ZERO_S(rem_cpus_sz, remaining_cpus);
-      for (int i = 0; i < cpuinfo->total_cpus; ++i)
-        CPU_SET_S(i, rem_cpus_sz, remaining_cpus);
-
-      const float budget_f = cpuinfo->total_cpus / (float)num_apps;
-      const int fair_share = MAX(floorf(budget_f), SAM_MIN_CONTEXTS);
-      struct appinfo **apps_unsorted = (struct appinfo **)calloc(num_apps, sizeof *apps_unsorted);
-      struct appinfo **apps_sorted = (struct appinfo **)calloc(num_apps, sizeof *apps_sorted);
-      cpu_set_t **new_cpusets = (cpu_set_t **)calloc(num_apps, sizeof *new_cpusets);
-      int initial_remaining_cpus = cpuinfo->total_cpus;
-      int **per_app_socket_orders = (int **)calloc(num_apps, sizeof *per_app_socket_orders);
-      char buf[256];
-
-      int range_ends[N_METRICS + 1] = { 0 };
-
-      {
-        int i = 0;
-        for (struct appinfo *an = apps_list; an; an = an->next) {
-          apps_unsorted[i] = an;
-          per_app_socket_orders[i] = (int *)calloc(cpuinfo->num_sockets, sizeof *per_app_socket_orders[i]);
-          initial_remaining_cpus -= CPU_COUNT_S(rem_cpus_sz, an->cpuset[0]);
-          i++;
-        }
+  qsort(threads, n, sizeof *threads, &compare_procs_by_cluster);
+  for (int k = 0; k < n; ++k) {
+    struct procinfo *pd = threads[k];
+
+    if (pd->bottleneck[METRIC_INTRA] || pd->bottleneck[METRIC_INTER]) {
+      const int c = (num_pack_threads++ / cpuinfo->cpus_per_core) % num_cores;
+
+      packed[c] = true;
+      pd->placement = PLACEMENT_PACK;
+    } else if (pd->bottleneck[METRIC_MEM]) {
+      num_spread_threads++;
+      pd->placement = PLACEMENT_SPREAD;
+    } else
+      pd->placement = PLACEMENT_FREE;
+  }
+  for (int c = 0; c < num_cores; ++c)
+    num_unpacked += !packed[c];
+
+  num_pack_threads = 0;
+  for (int k = 0; k < n; ++k) {
+    struct procinfo *pd = threads[k];
+    const cpu_set_t *mask = set;
+    int c;
+
+    if (pd->placement == PLACEMENT_PACK) {
+      mask = cores[(num_pack_threads++ / cpuinfo->cpus_per_core) % num_cores].cpus;
+    } else if (pd->placement == PLACEMENT_SPREAD) {
+      /* away from the communicating threads, while there are cores they left */
+      do
+        c = spread[next_spread++ % num_spread];
+      while (num_unpacked > 0 && packed[c]);
+      mask = cores[c].cpus;
+    }
+    if (sched_setaffinity(pd->pid, sz, mask) != 0 && errno != ESRCH)
+      log_warn("[APP %6d] failed to pin thread %d: %s\n", an->pid, pd->pid, strerror(errno));
+  }
+
+  log_debug("[APP %6d] packed %d communicating threads, spread %d memory-bound threads over %d cores\n", an->pid,
+            num_pack_threads, num_spread_threads, num_cores);
+
+  for (int c = 0; c < num_cores; ++c)
+    CPU_FREE(cores[c].cpus);
+  free(cores);
+  free(spread);
+  free(packed);
+  return n;
+}
+
+/**
+ * Pin the threads of every application whose CPUs or threads changed since
+ * they were last placed (see place_app_threads()). The kernel resets their
+ * affinity whenever the application's cpuset is written.
+ */
+static void place_threads(void)
+{
+  static struct procinfo **procs_by_app;
+  static int capacity;
+  const size_t sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  cpu_set_t *set = CPU_ALLOC(cpuinfo->total_cpus);
+  uint64_t pinned = 0;
+  int n = 0;
+
+  if (num_procs > capacity) {
+    procs_by_app = (struct procinfo **)realloc(procs_by_app, num_procs * sizeof *procs_by_app);
+    if (!procs_by_app)
+      err(EXIT_FAILURE, "%s", __func__);
+    capacity = num_procs;
+  }
+
+  for (struct procinfo *pd = procs_list; pd; pd = pd->next)
+    procs_by_app[n++] = pd;
+  qsort(procs_by_app, n, sizeof *procs_by_app, &compare_procs_by_app);
+
+  for (int i = 0, j; i < n; i = j) {
+    struct appinfo *an = apps_array[procs_by_app[i]->app_pid];
+    bool stale;
+
+    for (j = i; j < n && procs_by_app[j]->app_pid == procs_by_app[i]->app_pid; ++j)
+      ;
+    if (!an)
+      continue;
+
+    /* the scheduler changes the cpuset */
+    pthread_mutex_lock(&apps_lock);
+    memcpy(set, an->cpuset[0], sz);
+    pthread_mutex_unlock(&apps_lock);
+    if (CPU_COUNT_S(sz, set) == 0)
+      continue;
+
+    stale = an->threads_left || !CPU_EQUAL_S(sz, set, an->placed_cpuset);
+    for (int k = i; k < j && !stale; ++k)
+      stale = procs_by_app[k]->sampled && procs_by_app[k]->placement == PLACEMENT_NONE;
+    if (!stale)
+      continue;
+
+    pinned += place_app_threads(an, set, &procs_by_app[i], j - i);
+    memcpy(an->placed_cpuset, set, sz);
+    an->threads_left = false;
+  }
+
+  pthread_mutex_lock(&apps_lock);
+  thread_affinity_sets_total += pinned;
+  pthread_mutex_unlock(&apps_lock);
+  CPU_FREE(set);
+}
+
+/**
+ * Write every metric in the Prometheus text format: the phase histograms,
+ * and a gauge per application for what the last window measured. This runs
+ * with apps_lock held, before the applications' values are reset.
+ */
+static void write_metrics(FILE *out, const struct window *w)
+{
+  const char *bottleneck_labels[N_METRICS] = {
+    [METRIC_ACTIVE] = "active",
+    [METRIC_AVGIPC] = "ipc",
+    [METRIC_MEM] = "memory",
+    [METRIC_INTRA] = "intra_socket",
+    [METRIC_INTER] = "inter_socket",
+  };
+  const double period = timespec_to_secs(w->period);
+  const size_t cpus_sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+  char labels[64];
+
+  metrics_write_header(out, "sam_phase_duration_seconds", "histogram", "Time spent in each phase of a window.");
+  for (int i = 0; i < N_PHASES; ++i) {
+    snprintf(labels, sizeof labels, "phase=\"%s\"", phase_names[i]);
+    /* from 1us to 17s */
+    metrics_write_histogram(out, "sam_phase_duration_seconds", labels, &phase_histograms[i], 1e-9, 10, 34);
+  }
+
+  metrics_write_header(out, "sam_phase_duration_quantile_seconds", "gauge",
+                       "Quantiles of the time spent in each phase of a window, to within 12.5%.");
+  for (int i = 0; i < N_PHASES; ++i) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1 };
+
+    for (size_t q = 0; q < sizeof quantiles / sizeof quantiles[0]; ++q)
+      fprintf(out, "sam_phase_duration_quantile_seconds{phase=\"%s\",quantile=\"%g\"} %.9g\n", phase_names[i],
+              quantiles[q], histogram_quantile(&phase_histograms[i], quantiles[q]) * 1e-9);
+  }
+
+  metrics_write_header(out, "sam_windows_total", "counter", "Windows scheduled.");
+  fprintf(out, "sam_windows_total %" PRIu64 "\n", phase_histograms[PHASE_TOTAL].count);
+  metrics_write_header(out, "sam_apps", "gauge", "Applications managed.");
+  fprintf(out, "sam_apps %d\n", num_apps);
+  metrics_write_header(out, "sam_allocatable_cpus", "gauge",
+                       "CPUs that applications may be given: those of the parent cgroup, less housekeeping.");
+  fprintf(out, "sam_allocatable_cpus %d\n", num_allocatable_cpus);
+  metrics_write_header(out, "sam_capacity_changes_total", "counter",
+                       "Times the CPUs that applications may be given changed.");
+  fprintf(out, "sam_capacity_changes_total %" PRIu64 "\n", capacity_changes_total);
+  metrics_write_header(out, "sam_log_dropped_total", "counter", "Log messages dropped because the queue was full.");
+  fprintf(out, "sam_log_dropped_total %" PRIu64 "\n", log_dropped());
+  metrics_write_header(out, "sam_cpuset_writes_total", "counter", "Application cpusets written.");
+  fprintf(out, "sam_cpuset_writes_total %" PRIu64 "\n", cpuset_writes_total);
+  metrics_write_header(out, "sam_cpuset_drift_total", "counter",
+                       "Application cpusets found changed outside samd by the periodic check.");
+  fprintf(out, "sam_cpuset_drift_total %" PRIu64 "\n", cpuset_drift_total);
+  metrics_write_header(out, "sam_cpuset_step_writes_total", "counter",
+                       "Writes of application cpusets, by whether they gave up CPUs or took them.");
+  fprintf(out, "sam_cpuset_step_writes_total{step=\"shrink\"} %" PRIu64 "\n", cpuset_shrink_writes_total);
+  fprintf(out, "sam_cpuset_step_writes_total{step=\"grow\"} %" PRIu64 "\n", cpuset_grow_writes_total);
+  metrics_write_header(out, "sam_cpuset_overlaps_total", "counter",
+                       "Windows in which applications that swapped CPUs briefly held the same ones.");
+  fprintf(out, "sam_cpuset_overlaps_total %" PRIu64 "\n", cpuset_overlaps_total);
+  metrics_write_header(out, "sam_cpuset_overlap_seconds_total", "counter",
+                       "Time applications that swapped CPUs held the same ones.");
+  fprintf(out, "sam_cpuset_overlap_seconds_total %.9f\n", cpuset_overlap_ns_total * 1e-9);
+  metrics_write_header(out, "sam_mem_migrations_total", "counter",
+                       "Applications whose memory was moved to the NUMA nodes of their CPUs.");
+  fprintf(out, "sam_mem_migrations_total %" PRIu64 "\n", mem_migrations_total);
+  metrics_write_header(out, "sam_mem_migrated_bytes_total", "counter",
+                       "Resident memory of the applications whose memory was moved, in bytes.");
+  fprintf(out, "sam_mem_migrated_bytes_total %" PRIu64 "\n", mem_migrated_bytes_total);
+  metrics_write_header(out, "sam_thread_affinity_sets_total", "counter",
+                       "Threads pinned within their application's CPUs (-A).");
+  fprintf(out, "sam_thread_affinity_sets_total %" PRIu64 "\n", thread_affinity_sets_total);
+
+  metrics_write_header(out, "sam_app_ips", "gauge", "Instructions per second over the last window.");
+  for (struct appinfo *an = apps_list; an; an = an->next)
+    fprintf(out, "sam_app_ips{app=\"%d\"} %" PRIu64 "\n", an->pid, an->extra_metric[EXTRA_METRIC_IPS]);
+  metrics_write_header(out, "sam_app_ipc", "gauge", "Instructions per cycle over the last window.");
+  for (struct appinfo *an = apps_list; an; an = an->next)
+    fprintf(out, "sam_app_ipc{app=\"%d\"} %.3f\n", an->pid, an->metric[METRIC_AVGIPC] / 1000.0);
+  metrics_write_header(out, "sam_app_llc_misses_per_second", "gauge", "Last-level cache misses per second over the last window.");
+  for (struct appinfo *an = apps_list; an; an = an->next)
+    fprintf(out, "sam_app_llc_misses_per_second{app=\"%d\"} %.0f\n", an->pid,
+            period > 0 ? an->extra_metric[EXTRA_METRIC_LLC_MISSES] / period : 0.0);
+  metrics_write_header(out, "sam_app_cpus", "gauge", "CPUs allocated.");
+  for (struct appinfo *an = apps_list; an; an = an->next)
+    fprintf(out, "sam_app_cpus{app=\"%d\"} %d\n", an->pid, CPU_COUNT_S(cpus_sz, an->cpuset[0]));
+  metrics_write_header(out, "sam_app_bottleneck", "gauge", "1 for the bottleneck the application was last allocated for.");
+  for (struct appinfo *an = apps_list; an; an = an->next)
+    for (int i = 0; i < N_METRICS; ++i)
+      fprintf(out, "sam_app_bottleneck{app=\"%d\",bottleneck=\"%s\"} %d\n", an->pid, bottleneck_labels[i],
+              an->curr_bottleneck == i);
+}
+
+/**
+ * Schedule the applications from the counts in @w. This runs on the scheduler
+ * thread while the sampler counts the next window.
+ */
+static void schedule_window(const struct window *w)
+{
+  struct timespec sched_start = { 0, 0 }, sched_finish = { 0, 0 };
+  struct timespec cgroups_start = { 0, 0 }, cgroups_finish = { 0, 0 };
+  int cpuset_writes = 0;
+
+  pthread_mutex_lock(&apps_lock);
+
+  tunables = w->tunables;
+  num_counter_orders = tunables.num_counter_orders;
+  memcpy(counter_order, tunables.counter_order, num_counter_orders * sizeof *counter_order);
+  const bool capacity_changed = update_capacity();
+  update_partition();
+
+  /* take over the window's counts, unless the application has since exited */
+  for (int i = 0; i < w->num_apps; ++i) {
+    const struct appsample *sample = &w->apps[i];
+    struct appinfo *an = apps_array[sample->pid];
+
+    if (!an)
+      continue;
+    memcpy(an->value, sample->value, sizeof an->value);
+    memcpy(an->bottleneck, sample->bottleneck, sizeof an->bottleneck);
+    an->num_clusters = sample->num_clusters;
+  }
+
+  /* derive app statistics */
+  for (struct appinfo *an = apps_list; an; an = an->next) {
+    if (an == apps_list)
+      an->appno = num_apps - 1;
+    else
+      an->appno = an->prev->appno - 1;
+
+    if (an->OMPvalid) {
+      if (an->OMPptr) {
+        if (an->OMPptr->valid_progress)
+          log_debug("[APP %6d] has valid progress of %f \n", an->pid, an->OMPptr->progress);
+        else
+          log_debug("[APP %6d] has no valid progress \n", an->pid);
       }
+    } else {
+      an->OMPfd = shm_open(an->OMPname, O_RDWR, 0777);
+      if (an->OMPfd == -1)
+        log_warn("Error. |%s| shared memory segment does not exist\n", an->OMPname);
+      else {
+        an->OMPptr =
+          (struct OMPdata *)mmap(NULL, sizeof(struct OMPdata), PROT_READ | PROT_WRITE, MAP_SHARED, an->OMPfd, 0);
+        if (an->OMPptr == MAP_FAILED)
+          log_warn("Mmap failed \n");
+        else
+          an->OMPvalid = 1;
+      }
+    }
+
+    an->metric[METRIC_ACTIVE] = an->value[0];
+    an->metric[METRIC_AVGIPC] = (an->value[1] * 1000) / (1 + an->value[0]);
+    an->metric[METRIC_MEM] = an->value[8];
+    an->metric[METRIC_INTRA] = an->value[7] - (an->value[5] + an->value[6]);
+    an->metric[METRIC_INTER] = an->value[9];
+    if (an->times_allocated > 0)
+      an->extra_metric[EXTRA_METRIC_IpCOREpS] =
+        an->value[1] / CPU_COUNT_S(CPU_ALLOC_SIZE(cpuinfo->total_cpus), an->cpuset[0]);
+    an->extra_metric[EXTRA_METRIC_DRAM_REQUESTS] = 0;     // TODO
+    an->extra_metric[EXTRA_METRIC_LLC_MISSES] = an->value[8];
+    {
+      /* the perf collector counts cycles in the first of its groups only */
+      const double counted = timespec_to_secs(w->sleep) / (collector == COLLECTOR_PERF ? perfio_num_groups() : 1);
+
+      an->extra_metric[EXTRA_METRIC_CPU_MILLI] =
+        counted > 0 ? an->value[0] * 1000.0 / (cpuinfo->clock_rate * counted) : 0;
+    }
+
+    if (log_enabled(LOG_LEVEL_DEBUG)) {
+      char bottlenecks[N_METRICS * 21 + 1];
+      int len = 0;
 
-      /* this really shouldn't be necessary */
-      initial_remaining_cpus = MIN(MAX(initial_remaining_cpus, 0), cpuinfo->total_cpus);
+      for (int i = 0; i < N_METRICS; ++i)
+        len += snprintf(bottlenecks + len, sizeof bottlenecks - len, " %lu", an->bottleneck[i]);
+      log_debug("[APP %6d] Bottlenecks: %s\n", an->pid, bottlenecks);
+    }
+    if (!(an->ts.tv_sec == 0 && an->ts.tv_nsec == 0)) {
+      struct timespec diff_ts;
+      clock_gettime(CLOCK_MONOTONIC_RAW, &diff_ts);
 
+      if (diff_ts.tv_nsec < an->ts.tv_nsec) {
+        diff_ts.tv_sec = diff_ts.tv_sec - an->ts.tv_sec - 1;
+        diff_ts.tv_nsec = 1000000000 - (an->ts.tv_nsec - diff_ts.tv_nsec);
+      } else {
+        diff_ts.tv_sec -= an->ts.tv_sec;
+        diff_ts.tv_nsec -= an->ts.tv_nsec;
+      }
+      log_debug("[APP %6d] perf metric %lu \n", an->pid, an->metric[EXTRA_METRIC_IPS]);
       /*
-       * apps_sorted[] will look like:
-       * [ apps sorted by bottleneck 1 | apps sorted by bottleneck 2 | ... |
-       * remaining ]
-       */
-      for (int i = 0; i < N_METRICS; ++i) {
-        range_ends[i + 1] = range_ends[i];
-        for (int j = 0; j < num_apps; ++j) {
-          if (apps_unsorted[j]
-#if !(defined(FAIR) || defined(HILL_CLIMBING))
-              && (i >= num_counter_orders || apps_unsorted[j]->bottleneck[counter_order[i]] > SAM_MIN_THREADS)) {
-#else
-              && counter_order[i] == METRIC_AVGIPC) {
-#endif
-            apps_sorted[range_ends[i + 1]++] = apps_unsorted[j];
-            apps_unsorted[j] = NULL;
-          }
-        }
+             * Compute instructions / second
+             */
+      an->extra_metric[EXTRA_METRIC_IPS] =
+        an->value[EVENT_INSTRUCTIONS] / (diff_ts.tv_sec + (double)diff_ts.tv_nsec / 1000000000);
+    } else
+      clock_gettime(CLOCK_MONOTONIC_RAW, &an->ts);
 
-        /*
-         * We sort the apps that have bottlenecks. For the remaining apps
-         * (i >= num_counter_orders), we do not sort them.
-         */
-        if (i < num_counter_orders) {
-          int met = counter_order[i];
-          qsort_r(&apps_sorted[range_ends[i]], range_ends[i + 1] - range_ends[i], sizeof *apps_sorted,
-                  &compare_apps_by_metric_desc, (void *)&met);
-        }
+    //Added for Hill climbing, initialize
+    an->hill_direction =
+      1; /* 1 means positive direction, -1 means negative direction, store direction in order to resume*/
+    an->suspend_iter = 0; /*count the number of iterations suspended*/
+    an->hill_resume = false;
+
+    an->bin_search_resource = BIN_INITIAL_RESOURCE;
+    an->bin_direction = 1;
+  }
+
+  if (num_apps > 0 && policy->allocate) {
+    clock_gettime(CLOCK_MONOTONIC_RAW, &sched_start);
+
+    /* map applications */
+    cpu_set_t *remaining_cpus = CPU_ALLOC(cpuinfo->total_cpus);
+    size_t rem_cpus_sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+
+    memcpy(remaining_cpus, allocatable_cpus, rem_cpus_sz);
+
+    /* a second's worth of migration at most can be saved up */
+    const double migrate_rate = (double)tunables.mem_migrate_mb_per_s * (1 << 20);
+
+    mem_migrate_allowance = MIN(mem_migrate_allowance + migrate_rate * tunables.window_ms / 1000, migrate_rate);
+
+    const float budget_f = num_allocatable_cpus / (float)num_apps;
+    const int fair_share = MAX(floorf(budget_f), tunables.sam_min_contexts);
+    struct appinfo **apps_unsorted = (struct appinfo **)calloc(num_apps, sizeof *apps_unsorted);
+    struct appinfo **apps_sorted = (struct appinfo **)calloc(num_apps, sizeof *apps_sorted);
+    cpu_set_t **new_cpusets = (cpu_set_t **)calloc(num_apps, sizeof *new_cpusets);
+    int initial_remaining_cpus = num_allocatable_cpus;
+    int **per_app_socket_orders = (int **)calloc(num_apps, sizeof *per_app_socket_orders);
+    cpu_set_t *scratch = CPU_ALLOC(cpuinfo->total_cpus);
+    char buf[4096];
+
+    int range_ends[N_METRICS + 1] = { 0 };
+
+    {
+      int i = 0;
+      for (struct appinfo *an = apps_list; an; an = an->next) {
+        apps_unsorted[i] = an;
+        per_app_socket_orders[i] = (int *)calloc(cpuinfo->num_sockets, sizeof *per_app_socket_orders[i]);
+        CPU_AND_S(rem_cpus_sz, scratch, an->cpuset[0], allocatable_cpus);
+        initial_remaining_cpus -= CPU_COUNT_S(rem_cpus_sz, scratch);
+        i++;
       }
+    }
 
-#ifdef NUPOCO
-        nupoco_allocate(num_apps, apps_sorted, cpuinfo, rem_cpus_sz, per_app_socket_orders, new_cpusets, remaining_cpus);
-#else
-        sam_allocate(num_apps, apps_sorted, range_ends, cpuinfo, rem_cpus_sz,
-                initial_remaining_cpus, fair_share, num_counter_orders,
-                counter_order, per_app_socket_orders, new_cpusets,
-                remaining_cpus);
-#endif
+    /* this really shouldn't be necessary */
+    initial_remaining_cpus = MIN(MAX(initial_remaining_cpus, 0), num_allocatable_cpus);
 
-      clock_gettime(CLOCK_MONOTONIC_RAW, &cgroups_start);
-      /*
-       * Iterate again. This time, apply the budgets.
-       */
-      for (int i = 0; i < N_METRICS; ++i) {
-        if (i < num_counter_orders) {
-          int met = counter_order[i];
-          printf("%d apps sorted by %s:\n", range_ends[i + 1] - range_ends[i], metric_names[met]);
-        } else {
-          printf("%d apps unsorted:\n", range_ends[i + 1] - range_ends[i]);
-        }
+    policy_group_apps(policy, apps_unsorted, num_apps, num_counter_orders, counter_order, apps_sorted, range_ends);
 
-        for (int j = range_ends[i]; j < range_ends[i + 1]; ++j) {
-          int *mybudget = NULL;
-          size_t mybudget_l = 0;
-          int *intlist = NULL;
-          size_t intlist_l = 0;
-          char cg_name[256];
-
-          snprintf(cg_name, sizeof cg_name, SAM_CGROUP_NAME "/app-%d", apps_sorted[j]->pid);
-          if (cg_read_intlist(cgroot, cntrlr, cg_name, "cpuset.cpus", &intlist, &intlist_l) != 0) {
-            fprintf(stderr, "Failed to read APP %6d's cpuset.cpus: %s\n", apps_sorted[j]->pid, strerror(errno));
-            goto final_stage_failed;
-          }
+    /* only the policies that share CPUs set these */
+    for (int j = 0; j < num_apps; ++j) {
+      apps_sorted[j]->cpu_quota_milli = 0;
+      apps_sorted[j]->cpu_weight = 0;
+    }
+
+    policy->allocate(num_apps, apps_sorted, range_ends, cpuinfo, rem_cpus_sz,
+                     initial_remaining_cpus, fair_share, num_counter_orders,
+                     counter_order, per_app_socket_orders, new_cpusets,
+                     remaining_cpus);
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &cgroups_start);
+    bool *changed = (bool *)calloc(num_apps, sizeof *changed);
+    int *enforce_errors = (int *)calloc(num_apps, sizeof *enforce_errors);
+
+    for (int j = 0; j < num_apps; ++j) {
+      struct appinfo *an = apps_sorted[j];
+
+      changed[j] = !CPU_EQUAL_S(rem_cpus_sz, an->cpuset[0], new_cpusets[j]);
+
+      /* the applications take turns to be checked, a few each window */
+      if (enforcer == ENFORCER_CPUSET && !changed[j] && CPU_COUNT_S(rem_cpus_sz, an->cpuset[0]) > 0 &&
+          (w->seq + an->pid) % CPUSET_CHECK_WINDOWS == 0) {
+        int fd = app_cgroup_fd(an, cntrlr, &an->cpus_fd, "cpuset.cpus", O_RDWR);
+
+        if (fd < 0 || cg_pread_cpus(fd, scratch, cpuinfo->total_cpus) < 0 ||
+            !CPU_EQUAL_S(rem_cpus_sz, scratch, an->cpuset[0])) {
+          log_warn("[APP %6d] cpuset.cpus is not what samd wrote; writing it again\n", an->pid);
+          cpuset_drift_total++;
+          changed[j] = true;
+        }
+      }
+    }
+    enforce_budgets(num_apps, apps_sorted, new_cpusets, changed, enforce_errors);
+
+    /*
+     * Iterate again. This time, record the budgets.
+     */
+    for (int i = 0; i < N_METRICS; ++i) {
+      if (i < num_counter_orders) {
+        int met = counter_order[i];
+        log_debug("%d apps sorted by %s:\n", range_ends[i + 1] - range_ends[i], metric_names[met]);
+      } else {
+        log_debug("%d apps unsorted:\n", range_ends[i + 1] - range_ends[i]);
+      }
 
-          cpuset_to_intlist(new_cpusets[j], cpuinfo->total_cpus, &mybudget, &mybudget_l);
-          intlist_to_string(mybudget, mybudget_l, buf, sizeof buf, ",");
+      for (int j = range_ends[i]; j < range_ends[i + 1]; ++j) {
+        struct appinfo *an = apps_sorted[j];
+        const int budget = CPU_COUNT_S(rem_cpus_sz, new_cpusets[j]);
 
+        if (log_enabled(LOG_LEVEL_DEBUG)) {
+          cpuset_to_string(an->cpuset[0], cpuinfo->total_cpus, buf, sizeof buf);
           if (i < num_counter_orders) {
             int met = counter_order[i];
-            printf("\t[APP %6d] = %'" PRIu64 " (cpuset = %s)\n", apps_sorted[j]->pid, apps_sorted[j]->metric[met],
-                   intlist_to_string(intlist, intlist_l, buf, sizeof buf, ","));
+            log_debug("\t[APP %6d] = %'" PRIu64 " (cpuset = %s)\n", an->pid, an->metric[met], buf);
           } else {
-            printf("\t[APP %6d] (cpuset = %s)\n", apps_sorted[j]->pid,
-                   intlist_to_string(intlist, intlist_l, buf, sizeof buf, ","));
+            log_debug("\t[APP %6d] (cpuset = %s)\n", an->pid, buf);
           }
+        }
 
-          /* set the cpuset */
-          if (mybudget_l > 0) {
-            intlist_to_string(mybudget, mybudget_l, buf, sizeof buf, ",");
-            if (cg_write_intlist(cgroot, cntrlr, cg_name, "cpuset.cpus", mybudget, mybudget_l) != 0) {
-              fprintf(stderr, "\t\tfailed to set CPU budget to %s: %s\n", buf, strerror(errno));
-            } else {
-              /* save history */
-              if (!CPU_EQUAL_S(rem_cpus_sz, apps_sorted[j]->cpuset[0], new_cpusets[j]) ||
-                  (enum metric)i != apps_sorted[j]->curr_bottleneck) {
-                memcpy(apps_sorted[j]->cpuset[1], apps_sorted[j]->cpuset[0], rem_cpus_sz);
-                memcpy(apps_sorted[j]->cpuset[0], new_cpusets[j], rem_cpus_sz);
-                apps_sorted[j]->prev_bottleneck = apps_sorted[j]->curr_bottleneck;
-                apps_sorted[j]->curr_bottleneck = (enum metric)i;
-              }
+        /* the cpuset was set above, if it changed */
+        if (budget > 0) {
+          cpuset_to_string(new_cpusets[j], cpuinfo->total_cpus, buf, sizeof buf);
+          if (changed[j] && enforce_errors[j] != 0) {
+            log_warn("[APP %6d] failed to set CPU budget to %s: %s\n", an->pid, buf, strerror(enforce_errors[j]));
+          } else {
+            if (changed[j]) {
+              cpuset_writes++;
+              log_debug("\t\tset CPU budget to %s\n", buf);
+            } else
+              log_debug("\t\tkept CPU budget %s\n", buf);
+
+            /* save history */
+            if (!CPU_EQUAL_S(rem_cpus_sz, apps_sorted[j]->cpuset[0], new_cpusets[j]) ||
+                (enum metric)i != apps_sorted[j]->curr_bottleneck) {
+              memcpy(apps_sorted[j]->cpuset[1], apps_sorted[j]->cpuset[0], rem_cpus_sz);
+              memcpy(apps_sorted[j]->cpuset[0], new_cpusets[j], rem_cpus_sz);
+              apps_sorted[j]->prev_bottleneck = apps_sorted[j]->curr_bottleneck;
+              apps_sorted[j]->curr_bottleneck = (enum metric)i;
+            }
 
-              apps_sorted[j]->times_allocated++;
-              if ((int)mybudget_l == fair_share)
-                apps_sorted[j]->curr_fair_share = mybudget_l;
-              printf("\t\tset CPU budget to %s\n", buf);
-
-              if (apps_sorted[j]->OMPvalid) {
-                if (apps_sorted[j]->OMPptr) {
-                  apps_sorted[j]->OMPptr->numthreads = CPU_COUNT_S(rem_cpus_sz, apps_sorted[j]->cpuset[0]);
-                  apps_sorted[j]->OMPptr->valid_threads = 1;
-                  printf("[App %6d]: Updated the shared memory with %d CPUs \n", apps_sorted[j]->pid,
-                         apps_sorted[j]->OMPptr->numthreads);
-                }
+            follow_memory(apps_sorted[j], apps_sorted[j]->cpuset[0]);
+
+            apps_sorted[j]->times_allocated++;
+            if (budget == fair_share)
+              apps_sorted[j]->curr_fair_share = budget;
+
+            if (apps_sorted[j]->OMPvalid) {
+              if (apps_sorted[j]->OMPptr) {
+                apps_sorted[j]->OMPptr->numthreads = CPU_COUNT_S(rem_cpus_sz, apps_sorted[j]->cpuset[0]);
+                apps_sorted[j]->OMPptr->valid_threads = 1;
+                log_debug("[App %6d]: Updated the shared memory with %d CPUs \n", apps_sorted[j]->pid,
+                          apps_sorted[j]->OMPptr->numthreads);
               }
             }
           }
-
-        final_stage_failed:
-          CPU_FREE(new_cpusets[j]);
-          free(mybudget);
-          free(intlist);
-          free(per_app_socket_orders[j]);
         }
+
+        CPU_FREE(new_cpusets[j]);
+        free(per_app_socket_orders[j]);
       }
+    }
 
-      clock_gettime(CLOCK_MONOTONIC_RAW, &cgroups_finish);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &cgroups_finish);
 
-      free(new_cpusets);
-      free(apps_unsorted);
-      free(apps_sorted);
-      free(per_app_socket_orders);
-      CPU_FREE(remaining_cpus);
+    free(changed);
+    free(enforce_errors);
+    free(new_cpusets);
+    free(apps_unsorted);
+    free(apps_sorted);
+    free(per_app_socket_orders);
+    CPU_FREE(scratch);
+    CPU_FREE(remaining_cpus);
 
-      clock_gettime(CLOCK_MONOTONIC_RAW, &sched_finish);
-    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &sched_finish);
+  }
+
+  if (capacity_changed || !CPU_EQUAL_S(CPU_ALLOC_SIZE(cpuinfo->total_cpus), sam_cpus, allocatable_cpus))
+    settle_capacity();
+
+  last_timings.window = w->seq;
+  last_timings.sleep = timespec_to_ns(w->sleep);
+  last_timings.discovery = timespec_to_ns(w->discovery);
+  last_timings.perf = timespec_to_ns(timespec_sub(w->perf, w->sleep));
+  last_timings.setup = timespec_to_ns(w->setup);
+  last_timings.read = timespec_to_ns(w->read);
+  last_timings.cgroups = timespec_to_ns(timespec_sub(cgroups_finish, cgroups_start));
+  last_timings.cpuset_writes = cpuset_writes;
+  cpuset_writes_total += cpuset_writes;
+  last_timings.scheduler = timespec_to_ns(timespec_sub(sched_finish, sched_start)) - last_timings.cgroups;
+  last_timings.total = timespec_to_ns(w->period);
+
+  histogram_record(&phase_histograms[PHASE_DISCOVERY], last_timings.discovery);
+  histogram_record(&phase_histograms[PHASE_PERF_SETUP], last_timings.setup);
+  histogram_record(&phase_histograms[PHASE_PERF_READ], last_timings.read);
+  histogram_record(&phase_histograms[PHASE_SCHEDULER], last_timings.scheduler);
+  histogram_record(&phase_histograms[PHASE_CGROUPS], last_timings.cgroups);
+  histogram_record(&phase_histograms[PHASE_TOTAL], last_timings.discovery + last_timings.perf +
+                   last_timings.scheduler + last_timings.cgroups);
+
+  /* render the metrics now, and write them out once the lock is released */
+  char *metrics_text = NULL;
+  size_t metrics_len = 0;
+  FILE *metrics_out = metrics_path ? open_memstream(&metrics_text, &metrics_len) : NULL;
+
+  if (metrics_out) {
+    write_metrics(metrics_out, w);
+    fclose(metrics_out);
+  }
 
-#endif  /* !defined(JUST_PERFMON) */
+  /* reset app metrics and values */
+  for (struct appinfo *an = apps_list; an; an = an->next) {
+    memcpy(an->last_bottleneck, an->bottleneck, sizeof an->last_bottleneck);
+    an->last_ips = an->extra_metric[EXTRA_METRIC_IPS];
+    memset(an->metric, 0, sizeof an->metric);
+    memset(an->extra_metric, 0, sizeof an->extra_metric);
+    memset(an->bottleneck, 0, sizeof an->bottleneck);
+    memset(an->value, 0, sizeof an->value);
+  }
 
-    /* reset app metrics and values */
-    for (struct appinfo *an = apps_list; an; an = an->next) {
-      memset(an->metric, 0, sizeof an->metric);
-      memset(an->extra_metric, 0, sizeof an->extra_metric);
-      memset(an->bottleneck, 0, sizeof an->bottleneck);
-      memset(an->value, 0, sizeof an->value);
-    }
+  pthread_mutex_unlock(&apps_lock);
 
-    /* get iteration finish time */
-    clock_gettime(CLOCK_MONOTONIC_RAW, &finish_time);
+  if (metrics_text && metrics_publish(metrics_path, metrics_text, metrics_len) != 0)
+    log_warn("Failed to write %s: %s\n", metrics_path, strerror(errno));
+  free(metrics_text);
 
-    double cgroups_time = timespec_to_secs(timespec_sub(cgroups_finish, cgroups_start));
-    printf("Elapsed time (seconds):\n"
+  double cgroups_time = timespec_to_secs(timespec_sub(cgroups_finish, cgroups_start));
+  log_info("Elapsed time (seconds):\n"
            "  sleep     %.7f\n"
+           "  discovery %.7f\n"
            "  perf      %.7f\n"
            "    setup   %.7f\n"
            "    read    %.7f\n"
            "  scheduler %.7f\n"
-           "  cgroups   %.7f\n"
-           "  total     %.7f\n",
-           timespec_to_secs(perf_sleep),
-           timespec_to_secs(timespec_sub(timespec_sub(perf_finish, perf_start), perf_sleep)),
-           timespec_to_secs(perf_setup),
-           timespec_to_secs(perf_read),
+           "  cgroups   %.7f (%d cpusets written)\n"
+           "  total     %.7f\n"
+           "  duty      %.7f\n",
+           timespec_to_secs(w->sleep),
+           timespec_to_secs(w->discovery),
+           timespec_to_secs(timespec_sub(w->perf, w->sleep)),
+           timespec_to_secs(w->setup),
+           timespec_to_secs(w->read),
            timespec_to_secs(timespec_sub(sched_finish, sched_start)) - cgroups_time,
-           cgroups_time,
-           timespec_to_secs(timespec_sub(finish_time, start_time)));
+           cgroups_time, cpuset_writes,
+           timespec_to_secs(w->period),
+           timespec_to_secs(w->sleep) / timespec_to_secs(w->period));
+}
+
+/**
+ * The scheduler thread. It schedules each window as soon as the sampler
+ * publishes it, and returns once the sampler has stopped.
+ */
+static void *scheduler_main(void *arg)
+{
+  (void) arg;
 
-    /* reset timespecs */
-    memset(&perf_start, 0, sizeof perf_start);
-    memset(&perf_finish, 0, sizeof perf_finish);
-    memset(&perf_sleep, 0, sizeof perf_sleep);
-    memset(&perf_setup, 0, sizeof perf_setup);
-    memset(&perf_read, 0, sizeof perf_read);
-    memset(&sched_start, 0, sizeof sched_finish);
-    memset(&sched_finish, 0, sizeof sched_finish);
-    memset(&cgroups_start, 0, sizeof cgroups_start);
-    memset(&cgroups_finish, 0, sizeof cgroups_finish);
-    memset(&start_time, 0, sizeof start_time);
+  for (;;) {
+    struct window *w;
+
+    pthread_mutex_lock(&window_lock);
+    while (!window_ready && !sampler_done)
+      pthread_cond_wait(&window_cond, &window_lock);
+    if (!window_ready) {
+      pthread_mutex_unlock(&window_lock);
+      break;
+    }
+    w = pending;
+    pending = current;
+    current = w;
+    window_ready = false;
+    pthread_mutex_unlock(&window_lock);
+
+    schedule_window(current);
   }
 
-  printf("Stopping...\n");
+  return NULL;
+}
 
-  if (cg_remove_cgroup(cgroot, cntrlr, SAM_CGROUP_NAME) != 0)
-    perror("Failed to remove cgroup");
+/**
+ * Hand the counts of the window that just ended to the scheduler thread, and
+ * start counting the next window from zero. If the scheduler has not taken
+ * the previous window yet, this one replaces it.
+ */
+static void publish_window(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+  pthread_mutex_lock(&window_lock);
+
+  if (window_ready)
+    log_warn("Scheduler fell behind; dropped window %" PRIu64 "\n", pending->seq);
+
+  if (num_apps > pending->capacity) {
+    pending->apps = (struct appsample *)realloc(pending->apps, num_apps * sizeof *pending->apps);
+    if (!pending->apps)
+      err(EXIT_FAILURE, "window");
+    pending->capacity = num_apps;
+  }
+
+  pending->num_apps = 0;
+  for (struct appinfo *an = apps_list; an; an = an->next) {
+    an->window.pid = an->pid;
+    pending->apps[pending->num_apps++] = an->window;
+    memset(&an->window, 0, sizeof an->window);
+  }
+
+  pending->seq = ++window_seq;
+  pending->discovery = timespec_sub(discovery_finish, start_time);
+  pending->perf = timespec_sub(perf_finish, perf_start);
+  pending->sleep = perf_sleep;
+  pending->setup = perf_setup;
+  pending->read = perf_read;
+  pending->period = timespec_sub(now, start_time);
+  pending->tunables = sampler_tunables;
+  window_ready = true;
+
+  pthread_cond_signal(&window_cond);
+  pthread_mutex_unlock(&window_lock);
+}
+
+/**
+ * Find new applications and threads, and stop managing threads that are
+ * gone.
+ *
+ * Returns 0 on success, or -1 if the run directory could not be read.
+ */
+static int discover(void)
+{
+  DIR *dr;
+  struct dirent *de;
+
+  if (!(dr = opendir(SAM_RUN_DIR))) {
+    log_error("Could not open " SAM_RUN_DIR ": %s\n", strerror(errno));
+    return -1;
+  }
+
+  for (struct procinfo *pd = procs_list; pd; pd = pd->next)
+    pd->touched = false;
+
+  while ((de = readdir(dr)) != NULL) {
+    if (!((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))) {
+      int app_pid = atoi(de->d_name);
+      update_children(app_pid);
+    }
+  }
+
+  /*
+   * Backwards, since an application that is torn down meanwhile is removed
+   * by moving the last one into its place.
+   */
+  for (size_t i = registered.length; i-- > 0;)
+    if (i < registered.length)
+      update_children(registered.pids[i]);
+
+  /* remove all untouched children */
+  for (struct procinfo *pd = procs_list; pd;) {
+    struct procinfo *next = pd->next;
+    if (!pd->touched)
+      unmanage(pd->pid, pd->app_pid);
+    pd = next;
+  }
+
+  closedir(dr);
+  return 0;
+}
+
+/**
+ * (Re)start the window timer, which ticks at the end of each counter group's
+ * share of the window (or of the whole window, with the BPF collector).
+ */
+static int arm_window_timer(void)
+{
+  const int window_ms = sampler_tunables.window_ms;
+  const int tick_ms = collector == COLLECTOR_BPF ? window_ms : window_ms / perfio_num_groups();
+  struct itimerspec its;
+
+  its.it_interval.tv_sec = tick_ms / 1000;
+  its.it_interval.tv_nsec = (tick_ms % 1000) * 1000000L;
+  its.it_value = its.it_interval;
+  return timerfd_settime(window_timer, 0, &its, NULL);
+}
+
+/**
+ * Make @t the sampler's tunables.
+ */
+static void apply_tunables(const struct tunables *t)
+{
+  sampler_tunables = *t;
+  memcpy(thresh_pt, t->thresh_pt, sizeof thresh_pt);
+}
+
+/**
+ * Start a new window: discover threads and, with the perf collector, open
+ * their counters and start counting the first group.
+ */
+static void begin_window(void)
+{
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+  if (tunables_staged) {
+    bool window_changed = staged_tunables.window_ms != sampler_tunables.window_ms;
+
+    apply_tunables(&staged_tunables);
+    tunables_staged = false;
+    if (window_changed && arm_window_timer() != 0)
+      log_error("Failed to change the window: %s\n", strerror(errno));
+  }
+
+  if (discover() != 0) {
+    stoprun = true;
+    return;
+  }
+
+  pidlist_clear(&pids_to_monitor);
+  for (struct procinfo *pd = procs_list; pd; pd = pd->next) {
+    if (pidlist_push(&pids_to_monitor, pd->pid) != 0)
+      err(EXIT_FAILURE, "pids_to_monitor");
+  }
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &discovery_finish);
+  clock_gettime(CLOCK_MONOTONIC_RAW, &perf_start);
+
+  if (collector == COLLECTOR_PERF) {
+    perfio_open_counters(pids_to_monitor.pids, pids_to_monitor.length, &perf_setup);
+    current_group = 0;
+    perfio_start_group(current_group, &perf_setup);
+  }
+  clock_gettime(CLOCK_MONOTONIC_RAW, &group_start);
+}
+
+/**
+ * End the current window: collect its counts and hand them to the scheduler.
+ */
+static void end_window(void)
+{
+  if (collector == COLLECTOR_BPF) {
+    struct timespec read_start, read_finish;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &read_start);
+    for (struct appinfo *an = apps_list; an; an = an->next)
+      read_app_counters_bpf(an, timespec_to_secs(perf_sleep));
+    clock_gettime(CLOCK_MONOTONIC_RAW, &read_finish);
+    perf_read = timespec_sub(read_finish, read_start);
+  } else {
+    // count for all tids for a particular interval of time
+    displayTIDEvents(pids_to_monitor.pids, pids_to_monitor.length); // required to copy values to my data structures
+
+    /*
+     * read counters
+     * Threads that arrived or left during the window are not in THREADS, or
+     * no longer have a procinfo.
+     */
+    for (int index = 0; index < THREADS.index_tid; ++index) {
+      struct procinfo *pd = procs_array[THREADS.tid[index]];
+      if (pd)
+        pd->printCounters(index);
+    }
+  }
+
+  if (wake_domain != WAKE_DOMAIN_NONE)
+    update_thread_clusters();
+  if (place_threads_enabled)
+    place_threads();
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &perf_finish);
+
+  publish_window();
+  fill_cgroup_pool();
+
+  /* reset timespecs */
+  memset(&discovery_finish, 0, sizeof discovery_finish);
+  memset(&perf_start, 0, sizeof perf_start);
+  memset(&perf_finish, 0, sizeof perf_finish);
+  memset(&perf_sleep, 0, sizeof perf_sleep);
+  memset(&perf_setup, 0, sizeof perf_setup);
+  memset(&perf_read, 0, sizeof perf_read);
+  memset(&start_time, 0, sizeof start_time);
+}
+
+/**
+ * Reactor handler for the window timer. The sampler moves on to the next
+ * counter group, or ends the window and immediately starts the next one, so
+ * windows follow each other without gaps.
+ */
+static void on_window_tick(int fd, uint32_t events, void *arg)
+{
+  uint64_t expirations = 0;
+  struct timespec now;
+
+  (void) events;
+  (void) arg;
+  if (read(fd, &expirations, sizeof expirations) != sizeof expirations)
+    return;
+  if (expirations > 1)
+    log_warn("Sampler fell behind the window timer by %" PRIu64 " ticks\n", expirations - 1);
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+  perf_sleep = timespec_add(perf_sleep, timespec_sub(now, group_start));
+
+  if (collector == COLLECTOR_PERF) {
+    perfio_stop_group(current_group, &perf_read);
+    if (++current_group < perfio_num_groups()) {
+      perfio_start_group(current_group, &perf_setup);
+      clock_gettime(CLOCK_MONOTONIC_RAW, &group_start);
+      return;
+    }
+  }
+
+  end_window();
+  begin_window();
+}
+
+/**
+ * Reactor handler for the run directory. New applications are managed as
+ * soon as they register instead of at the next window.
+ */
+static void on_run_dir_event(int fd, uint32_t events, void *arg)
+{
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+
+  (void) events;
+  (void) arg;
+  while ((len = read(fd, buf, sizeof buf)) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+
+      if (ev->len > 0) {
+        int app_pid = atoi(ev->name);
+
+        if (app_pid > 0 && app_pid < pid_max && !apps_array[app_pid])
+          update_children(app_pid);
+      }
+      p += sizeof *ev + ev->len;
+    }
+  }
+}
+
+static_assert(SAM_CTL_N_METRICS == N_METRICS, "the control protocol reports every metric");
+
+/**
+ * A connection to the control socket.
+ */
+struct ctl_client {
+  int fd;
+  uid_t uid;
+};
+
+static void close_ctl_client(struct ctl_client *client)
+{
+  reactor_del(client->fd);
+  close(client->fd);
+  free(client);
+}
+
+/**
+ * Register application @pid, which @pidfd (owned by the caller) refers to.
+ */
+static int ctl_register(pid_t pid, int pidfd)
+{
+  if (pidfd_exited(pidfd))
+    return -ESRCH;
+
+  if (!apps_array[pid]) {
+    registering_pid = pid;
+    registering_pidfd = dup(pidfd);
+    update_children(pid);
+    if (registering_pidfd >= 0)
+      close(registering_pidfd);
+    registering_pid = 0;
+    registering_pidfd = -1;
+  }
+  if (!apps_array[pid])
+    return -ESRCH;
+
+  for (size_t i = 0; i < registered.length; ++i)
+    if (registered.pids[i] == pid)
+      return 0;
+  if (pidlist_push(&registered, pid) != 0)
+    return -errno;
+  return 0;
+}
+
+/**
+ * Fill in @app and, in @cpus, the CPUs of the application that @pid is, or
+ * that thread @pid belongs to.
+ */
+static int ctl_get_app(pid_t pid, struct sam_ctl_app *app, char *cpus, size_t cpus_len)
+{
+  struct appinfo *an = apps_array[pid];
+  int *intlist = NULL;
+  size_t intlist_l = 0;
+
+  if (!an && procs_array[pid])
+    an = apps_array[procs_array[pid]->app_pid];
+  if (!an)
+    return -ESRCH;
+
+  pthread_mutex_lock(&apps_lock);
+  app->pid = an->pid;
+  app->num_threads = an->refcount;
+  app->bottleneck = an->curr_bottleneck;
+  for (int i = 0; i < N_METRICS; ++i)
+    app->bottlenecks[i] = an->last_bottleneck[i];
+  app->ips = an->last_ips;
+  cpuset_to_intlist(an->cpuset[0], cpuinfo->total_cpus, &intlist, &intlist_l);
+  pthread_mutex_unlock(&apps_lock);
+
+  if (intlist_l > 0) {
+    app->num_cpus = intlist_l;
+    intlist_to_string(intlist, intlist_l, cpus, cpus_len, ",");
+    free(intlist);
+    return 0;
+  }
+  free(intlist);
+  intlist = NULL;
+
+  /* nothing was allocated yet (or ever, for perfmon), so ask the cgroup */
+  if (cg_read_intlist(cgroot, cntrlr, an->cg_name, "cpuset.cpus", &intlist, &intlist_l) != 0) {
+    cpus[0] = '\0';
+    app->num_cpus = 0;
+    return 0;
+  }
+  app->num_cpus = intlist_l;
+  intlist_to_string(intlist, intlist_l, cpus, cpus_len, ",");
+  free(intlist);
+  return 0;
+}
+
+/**
+ * Switch to @next from the next window. The applications keep their state.
+ */
+static void set_policy(const struct policy *next)
+{
+  pthread_mutex_lock(&apps_lock);
+  if (next != policy) {
+    policy = next;
+    if (policy->reset)
+      policy->reset();
+  }
+  pthread_mutex_unlock(&apps_lock);
+  log_info("Policy set to %s\n", next->name);
+}
+
+/**
+ * Whether @client may register or unregister process @pid: root may, and so
+ * may the user that owns it, as with the entries of SAM_RUN_DIR.
+ *
+ * Returns 0, or -EPERM, or -ESRCH if @pid is gone.
+ */
+static int ctl_check_owner(const struct ctl_client *client, pid_t pid)
+{
+  char path[32];
+  struct stat st;
+
+  if (client->uid == 0)
+    return 0;
+  snprintf(path, sizeof path, "/proc/%d", pid);
+  if (stat(path, &st) != 0)
+    return -ESRCH;
+  return st.st_uid == client->uid ? 0 : -EPERM;
+}
+
+/**
+ * Carry out @req, which came with @pass_fd (or -1).
+ *
+ * Returns the response's status, having filled in the rest of @resp and
+ * @payload.
+ */
+static int handle_ctl_request(const struct ctl_client *client,
+                              const struct sam_ctl_request *req,
+                              int pass_fd,
+                              struct sam_ctl_response *resp,
+                              char *payload,
+                              size_t payload_len)
+{
+  bool needs_pid = req->op == SAM_CTL_REGISTER || req->op == SAM_CTL_UNREGISTER || req->op == SAM_CTL_GET_APP;
+  int pidfd = pass_fd;
+  int ret = 0;
+
+  if (needs_pid && (req->pid <= 0 || req->pid >= pid_max))
+    return -EINVAL;
+
+  switch (req->op) {
+  case SAM_CTL_REGISTER:
+    if (pidfd >= 0 && pidfd_to_pid(pidfd) != req->pid)
+      return -EINVAL;
+    if ((ret = ctl_check_owner(client, req->pid)) != 0)
+      return ret;
+    if (pidfd < 0 && (pidfd = sys_pidfd_open(req->pid, 0)) < 0)
+      return -errno;
+    ret = ctl_register(req->pid, pidfd);
+    if (pidfd != pass_fd)
+      close(pidfd);
+    return ret;
+
+  case SAM_CTL_UNREGISTER: {
+    char path[64];
+    bool was_registered, was_listed;
+
+    if ((ret = ctl_check_owner(client, req->pid)) != 0)
+      return ret;
+    was_registered = pidlist_remove(&registered, req->pid);
+    /* or discover() manages it again in the next window */
+    snprintf(path, sizeof path, SAM_RUN_DIR "/%d", req->pid);
+    was_listed = rmdir(path) == 0;
+
+    if (apps_array[req->pid]) {
+      unmanage_app(apps_array[req->pid]);
+      return 0;
+    }
+    return was_registered || was_listed ? 0 : -ENOENT;
+  }
+
+  case SAM_CTL_GET_APP:
+    if ((ret = ctl_get_app(req->pid, &resp->app, payload, payload_len)) == 0)
+      resp->length = strlen(payload) + 1;
+    return ret;
+
+  case SAM_CTL_GET_TIMINGS:
+    pthread_mutex_lock(&apps_lock);
+    resp->timings = last_timings;
+    pthread_mutex_unlock(&apps_lock);
+    return 0;
+
+  case SAM_CTL_GET_LOG_LEVEL:
+    resp->level = log_get_level();
+    return 0;
+
+  case SAM_CTL_SET_LOG_LEVEL:
+    if (client->uid != 0)
+      return -EPERM;
+    if (req->arg < LOG_LEVEL_OFF || req->arg >= N_LOG_LEVELS)
+      return -EINVAL;
+    log_set_level((enum log_level)req->arg);
+    log_info("Log level set to %s\n", log_level_name((enum log_level)req->arg));
+    return 0;
+
+  case SAM_CTL_GET_POLICY:
+    pthread_mutex_lock(&apps_lock);
+    resp->policy = policy - policies;
+    pthread_mutex_unlock(&apps_lock);
+    for (int i = 0; i < num_policies && resp->length + strlen(policies[i].name) < payload_len; ++i) {
+      strcpy(payload + resp->length, policies[i].name);
+      resp->length += strlen(policies[i].name) + 1;
+    }
+    return 0;
+
+  case SAM_CTL_SET_POLICY:
+    if (client->uid != 0)
+      return -EPERM;
+    if (req->arg < 0 || req->arg >= num_policies)
+      return -EINVAL;
+    set_policy(&policies[req->arg]);
+    return 0;
+
+  default:
+    return -EOPNOTSUPP;
+  }
+}
+
+/**
+ * Reactor handler for a control connection: answer each request.
+ */
+static void on_ctl_request(int fd, uint32_t events, void *arg)
+{
+  struct ctl_client *client = (struct ctl_client *)arg;
+
+  (void) events;
+  for (;;) {
+    struct sam_ctl_request req;
+    union {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+    } control;
+    struct iovec iov = { &req, sizeof req };
+    struct msghdr msg;
+    char out[SAM_CTL_MAX_MESSAGE];
+    struct sam_ctl_response *resp = (struct sam_ctl_response *)out;
+    int pass_fd = -1;
+    ssize_t len;
+
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+
+    if ((len = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      break;
+    }
+    if (len == 0)
+      break;
+
+    /* keep the first fd that was passed, if any */
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        continue;
+      for (size_t off = 0; off + sizeof(int) <= cmsg->cmsg_len - CMSG_LEN(0); off += sizeof(int)) {
+        int passed;
+
+        memcpy(&passed, CMSG_DATA(cmsg) + off, sizeof passed);
+        if (pass_fd < 0)
+          pass_fd = passed;
+        else
+          close(passed);
+      }
+    }
+
+    memset(resp, 0, sizeof *resp);
+    if ((size_t)len != sizeof req || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+      resp->status = -EPROTO;
+    else
+      resp->status = handle_ctl_request(client, &req, pass_fd, resp, out + sizeof *resp, sizeof out - sizeof *resp);
+    if (pass_fd >= 0)
+      close(pass_fd);
+    if (resp->status != 0)
+      resp->length = 0;
+
+    if (send(fd, out, sizeof *resp + resp->length, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+      break;
+  }
+
+  close_ctl_client(client);
+}
+
+/**
+ * Reactor handler for the control socket: accept new connections.
+ */
+static void on_ctl_connect(int fd, uint32_t events, void *arg)
+{
+  int conn;
+
+  (void) events;
+  (void) arg;
+  while ((conn = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof cred;
+    struct ctl_client *client = (struct ctl_client *)malloc(sizeof *client);
+
+    if (!client || getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+      free(client);
+      close(conn);
+      continue;
+    }
+    client->fd = conn;
+    client->uid = cred.uid;
+    if (reactor_add(conn, EPOLLIN, &on_ctl_request, client) != 0) {
+      log_warn("Failed to watch a control connection: %s\n", strerror(errno));
+      free(client);
+      close(conn);
+    }
+  }
+}
+
+/**
+ * Listen on SAM_CTL_SOCKET.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+static int open_ctl_socket(void)
+{
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, SAM_CTL_SOCKET, sizeof addr.sun_path - 1);
+
+  if ((ctl_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+    return -1;
+
+  /* a previous instance may have left its socket behind */
+  if (unlink(SAM_CTL_SOCKET) != 0 && errno != ENOENT)
+    return -1;
+
+  /* anyone may register applications, as with SAM_RUN_DIR */
+  if (bind(ctl_socket, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+      chmod(SAM_CTL_SOCKET, 0666) != 0 ||
+      listen(ctl_socket, SOMAXCONN) != 0)
+    return -1;
+
+  return reactor_add(ctl_socket, EPOLLIN, &on_ctl_connect, NULL);
+}
+
+/**
+ * Set up the sampler's reactor: signals, the run directory, the window timer
+ * and, through manage(), each application's pidfd.
+ *
+ * Returns 0 on success, or -1 with an error printed.
+ */
+static int start_reactor(void)
+{
+  sigset_t sigs;
+
+  if (reactor_init() != 0) {
+    perror("Failed to create the reactor");
+    return -1;
+  }
+
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGTERM);
+  sigaddset(&sigs, SIGQUIT);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGUSR1);
+  sigaddset(&sigs, SIGHUP);
+  if ((signal_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+      reactor_add(signal_fd, EPOLLIN, &on_signal, NULL) != 0) {
+    perror("Failed to watch signals");
+    return -1;
+  }
+
+  if ((run_dir_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+      inotify_add_watch(run_dir_watch, SAM_RUN_DIR, IN_CREATE | IN_MOVED_TO) < 0 ||
+      reactor_add(run_dir_watch, EPOLLIN, &on_run_dir_event, NULL) != 0) {
+    perror("Failed to watch " SAM_RUN_DIR);
+    return -1;
+  }
+
+  if (open_ctl_socket() != 0) {
+    perror("Failed to open " SAM_CTL_SOCKET);
+    return -1;
+  }
+
+  if ((window_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+      arm_window_timer() != 0 ||
+      reactor_add(window_timer, EPOLLIN, &on_window_tick, NULL) != 0) {
+    perror("Failed to create the window timer");
+    return -1;
+  }
+
+  return 0;
+}
+
+//File limits for metadata management
+void setup_file_limits()
+{
+  struct rlimit limit;
+  FILE *nr_open_fp;
+  rlim_t nr_open = 65535;
+
+  /*
+   * Every monitored thread holds one perf fd per event, so allow as many
+   * files as the kernel does.
+   */
+  if ((nr_open_fp = fopen("/proc/sys/fs/nr_open", "r"))) {
+    unsigned long val;
+    if (fscanf(nr_open_fp, "%lu", &val) == 1 && val > nr_open)
+      nr_open = val;
+    fclose(nr_open_fp);
+  }
+
+  limit.rlim_cur = nr_open;
+  limit.rlim_max = nr_open;
+  printf("Setting file limits:\n");
+  if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    /* we may not be allowed to raise the hard limit, so settle for it */
+    perror("setrlimit");
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || (limit.rlim_cur = limit.rlim_max, setrlimit(RLIMIT_NOFILE, &limit)) != 0) {
+      perror("setrlimit");
+      exit(1);
+    }
+  }
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    perror("getrlimit");
+    exit(1);
+  }
+  printf("\tThe soft limit is %lu\n", limit.rlim_cur);
+  printf("\tThe hard limit is %lu\n", limit.rlim_max);
+  return;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-A] [-C perf|bpf] [-E cpuset|sched_ext] [-W core|l3|socket] [-l off|error|warn|info|debug|trace] [-M metrics-file|none] [-c config-file] [-P default|fair|hillclimb|nupoco|perfmon]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+  //Initialization and basic checks
+  int init_error = 0;
+  int opt;
+
+  setlocale(LC_ALL, "");
+
+  while ((opt = getopt(argc, argv, "AC:E:W:l:M:c:P:h")) != -1) {
+    switch (opt) {
+    case 'A':
+      place_threads_enabled = true;
+      break;
+    case 'C':
+      if (strcmp(optarg, "perf") == 0)
+        collector = COLLECTOR_PERF;
+      else if (strcmp(optarg, "bpf") == 0)
+        collector = COLLECTOR_BPF;
+      else {
+        fprintf(stderr, "Unknown collector '%s'\n", optarg);
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'E':
+      if (strcmp(optarg, "cpuset") == 0)
+        enforcer = ENFORCER_CPUSET;
+      else if (strcmp(optarg, "sched_ext") == 0)
+        enforcer = ENFORCER_SCHED_EXT;
+      else {
+        fprintf(stderr, "Unknown enforcer '%s'\n", optarg);
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'W':
+      if (strcmp(optarg, "core") == 0)
+        wake_domain = WAKE_DOMAIN_CORE;
+      else if (strcmp(optarg, "l3") == 0)
+        wake_domain = WAKE_DOMAIN_L3;
+      else if (strcmp(optarg, "socket") == 0)
+        wake_domain = WAKE_DOMAIN_SOCKET;
+      else {
+        fprintf(stderr, "Unknown wakeup clustering domain '%s'\n", optarg);
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'P':
+      if (!(policy = policy_find(optarg))) {
+        fprintf(stderr, "Unknown policy '%s'\n", optarg);
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'c':
+      config_path = optarg;
+      config_path_given = true;
+      break;
+    case 'M':
+      metrics_path = strcmp(optarg, "none") == 0 ? NULL : optarg;
+      break;
+    case 'l': {
+      int level = log_level_from_string(optarg);
+
+      if (level < 0) {
+        fprintf(stderr, "Unknown log level '%s'\n", optarg);
+        usage(argv[0]);
+        return 1;
+      }
+      log_set_level((enum log_level)level);
+      break;
+    }
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (place_threads_enabled && (collector != COLLECTOR_PERF || enforcer != ENFORCER_CPUSET)) {
+    fprintf(stderr, "-A needs per-thread counters and cpusets (-C perf -E cpuset)\n");
+    return 1;
+  }
+
+  if (geteuid() != 0) {
+    fprintf(stderr, "I need root access for %s\n", cgroot);
+    return 1;
+  }
+  if (cg_detect(cgroot, cntrlr) < 0) {
+    fprintf(stderr, "There is no %s controller under %s\n", cntrlr, cgroot);
+    return 1;
+  }
+
+  srandom(random_seed);
+
+  setup_file_limits();
+  // Initialize what event we want
+
+  /* signals are handled through the reactor, in the sampler */
+  {
+    sigset_t sigs;
+
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGQUIT);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGUSR1);
+    sigaddset(&sigs, SIGHUP);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+  }
+
+  if (init_thresholds == 0) {
+    /* create array */
+    FILE *pid_max_fp;
+
+    if (!(pid_max_fp = fopen("/proc/sys/kernel/pid_max", "r")) || fscanf(pid_max_fp, "%d", &pid_max) != 1) {
+      perror("Could not get pid_max");
+      return 1;
+    }
+    printf("pid_max = %d\n", pid_max);
+    apps_array = (struct appinfo **)calloc(pid_max, sizeof *apps_array);
+    procs_array = (struct procinfo **)calloc(pid_max, sizeof *procs_array);
+    fclose(pid_max_fp);
+
+    /* get CPU topology */
+    if ((cpuinfo = get_cpuinfo())) {
+      printf("CPU Info\n========\n");
+      printf("Max clock rate: %'lu Hz\n", cpuinfo->clock_rate);
+      printf("Topology: %d threads across %d sockets:\n", cpuinfo->total_cpus, cpuinfo->num_sockets);
+      for (int i = 0; i < cpuinfo->num_sockets; ++i) {
+        printf(" socket %d has threads:", i);
+        for (int j = 0; j < cpuinfo->sockets[i].num_cpus; ++j)
+          printf(" %d", cpuinfo->sockets[i].cpus[j].tnumber);
+        printf("\n");
+      }
+    } else {
+      fprintf(stderr, "Failed to get CPU topology.\n");
+      init_error = -1;
+      goto END;
+    }
+    if (collector == COLLECTOR_BPF) {
+      if (perfio_bpf_init(cpuinfo->total_cpus) != 0) {
+        fprintf(stderr, "Failed to load the BPF collector: %s\n", strerror(errno));
+        init_error = -1;
+        goto END;
+      }
+      printf("Using the BPF collector\n");
+    }
+    if (wake_domain != WAKE_DOMAIN_NONE) {
+      if (wake_domain == WAKE_DOMAIN_CORE)
+        wake_cluster_size = cpuinfo->cpus_per_core;
+      else if (wake_domain == WAKE_DOMAIN_L3)
+        wake_cluster_size = cpuinfo->cpus_per_l3;
+      else
+        wake_cluster_size = cpuinfo->sockets[0].num_cpus;
+
+      if (wakegraph_init() != 0) {
+        fprintf(stderr, "Failed to load the wakeup tracer: %s\n", strerror(errno));
+        init_error = -1;
+        goto END;
+      }
+      printf("Clustering threads by wakeups into groups of %d\n", wake_cluster_size);
+    }
+    if (enforcer == ENFORCER_SCHED_EXT) {
+      if (schedext_init(cpuinfo->total_cpus) != 0) {
+        fprintf(stderr, "Failed to enable the sched_ext scheduler: %s\n", strerror(errno));
+        init_error = -1;
+        goto END;
+      }
+      printf("Enforcing budgets with sched_ext\n");
+    } else {
+      if (!(cpuset_batch = cg_batch_create())) {
+        perror("Failed to set up cpuset writes");
+        init_error = -1;
+        goto END;
+      }
+      printf("Writing cpusets %s\n", cg_batch_uses_uring(cpuset_batch) ? "through io_uring" : "with pwrite()");
+    }
+    printf("Allocating with the %s policy\n", policy->name);
+
+    mode_t oldmask = umask(0);
+
+    /* initialize thresholds */
+    if (tunables_load(&sampler_tunables, config_path, config_path_given, cpuinfo->total_cores) != 0) {
+      init_error = -1;
+      goto END;
+    }
+    apply_tunables(&sampler_tunables);
+
+    /* create run directory */
+    if (mkdir(SAM_RUN_DIR, 01777) < 0 && errno != EEXIST) {
+      fprintf(stderr, "Failed to create %s: %s\n", SAM_RUN_DIR, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    /* create cgroup */
+    char *mems_string = NULL;
+    printf("Using cgroup v%d\n", (int)cg_version());
+    if (cg_enable_controller(cgroot, cntrlr, ".") < 0 ||
+        (cg_create_cgroup(cgroot, cntrlr, SAM_CGROUP_NAME) < 0 && errno != EEXIST) ||
+        cg_enable_controller(cgroot, cntrlr, SAM_CGROUP_NAME) < 0) {
+      perror("Failed to create cgroup");
+      init_error = -1;
+      goto END;
+    }
+
+    allocatable_cpus = CPU_ALLOC(cpuinfo->total_cpus);
+    sam_cpus = CPU_ALLOC(cpuinfo->total_cpus);
+    if (cg_read_string(cgroot, cntrlr, ".", cg_effective_param("cpuset.mems"), &mems_string) < 0 ||
+        cg_write_string(cgroot, cntrlr, SAM_CGROUP_NAME, "cpuset.mems", "%s", mems_string) < 0 ||
+        (num_allocatable_cpus = read_allocatable_cpus(&sampler_tunables, allocatable_cpus)) <= 0 ||
+        write_cpus(SAM_CGROUP_NAME, allocatable_cpus) < 0) {
+      perror("Failed to create cgroup");
+      free(mems_string);
+      init_error = -1;
+      goto END;
+    }
+    memcpy(sam_cpus, allocatable_cpus, CPU_ALLOC_SIZE(cpuinfo->total_cpus));
+    umask(oldmask);
+    free(mems_string);
+    clear_stale_cgroup_pool();
+    fill_cgroup_pool();
+
+    /* applications that share CPUs are limited by the cpu controller, if there is one */
+    if (enforcer == ENFORCER_CPUSET) {
+      if (cg_version() == CG_V2)
+        cpu_controller = cg_enable_controller(cgroot, "cpu", ".") == 0 &&
+                         cg_enable_controller(cgroot, "cpu", SAM_CGROUP_NAME) == 0;
+      else
+        cpu_controller = cg_create_cgroup(cgroot, "cpu", SAM_CGROUP_NAME) == 0 || errno == EEXIST;
+      if (!cpu_controller)
+        fprintf(stderr, "Applications that share CPUs will not be limited: no cpu controller (%s)\n",
+                strerror(errno));
+    }
+    init_thresholds = 1;
+  }
+  if (init_error == -1)
+    goto END;
+
+  /* from here on, the control loop only logs asynchronously */
+  fflush(stdout);
+  if (log_init(stdout) != 0) {
+    perror("Failed to start the logging thread");
+    goto END;
+  }
+
+  if ((errno = pthread_create(&scheduler_thread, NULL, &scheduler_main, NULL)) != 0) {
+    perror("Failed to start the scheduler thread");
+    goto END;
+  }
+
+  if (start_reactor() != 0)
+    goto END;
+
+  begin_window();
+  while (!stoprun) {
+    if (reactor_run_once(-1) < 0) {
+      log_error("Failed to wait for events: %s\n", strerror(errno));
+      break;
+    }
+  }
+
+  log_info("Stopping...\n");
+
+  pthread_mutex_lock(&window_lock);
+  sampler_done = true;
+  pthread_cond_signal(&window_cond);
+  pthread_mutex_unlock(&window_lock);
+  pthread_join(scheduler_thread, NULL);
+
+  if (ctl_socket >= 0)
+    unlink(SAM_CTL_SOCKET);
+  if (metrics_path)
+    unlink(metrics_path);
+
+  empty_cgroup_pool();
+  if (cg_remove_cgroup(cgroot, cntrlr, SAM_CGROUP_NAME) != 0)
+    perror("Failed to remove cgroup");
+  if (cpu_controller && cg_version() == CG_V1) {
+    remove_cpu_cgroups(true);
+    if (cg_remove_cgroup(cgroot, "cpu", SAM_CGROUP_NAME) != 0)
+      perror("Failed to remove cpu cgroup");
+  }
 END:
+  perfio_bpf_exit();
+  wakegraph_exit();
+  schedext_exit();
+  cg_batch_destroy(cpuset_batch);
+  reactor_exit();
+  log_exit();
+  if (log_dropped() > 0)
+    printf("Dropped %" PRIu64 " log messages\n", log_dropped());
   printf("Exiting.\n");
 
   return 0;
@@ -29,6 +29,8 @@ enum extra_metric {
     EXTRA_METRIC_IPS,
     EXTRA_METRIC_DRAM_REQUESTS,
     EXTRA_METRIC_LLC_MISSES,
+    /* the CPUs the application ran on over the window, in thousandths */
+    EXTRA_METRIC_CPU_MILLI,
     N_EXTRA_METRICS,
 };
 
@@ -50,6 +52,11 @@ enum extra_metric {
 #define SAM_DISTURB_PROB 0.3 /* probability of a disturbance */
 #define SAM_INITIAL_ALLOCS 4 /* number of initial allocations before exploring */
 #define SAM_MIN_THREADS 4
+#define SAM_SHARE_HEADROOM 1.25 /* the quota of an application that shares CPUs, over what it used */
+#define SAM_SHARE_MIN_QUOTA 0.05 /* the smallest quota, in CPUs */
+#define SAM_MEM_FOLLOW_WINDOWS 5 /* windows on the same nodes before memory follows */
+#define SAM_MEM_MIGRATE_MB_PER_S 512 /* memory moved between nodes, at most */
+#define SAM_CGROUP_POOL 4 /* cgroups kept ready for the launcher */
 
 struct OMPdata {
   double progress;
@@ -58,15 +65,69 @@ struct OMPdata {
   int valid_threads;
 };
 
+/**
+ * What was counted for an application over one window.
+ */
+struct appsample {
+  pid_t pid;
+  uint64_t value[MAX_COUNTERS];
+  uint64_t bottleneck[N_METRICS];
+  int num_clusters;
+};
+
 struct appinfo {
   /**
    * application PID
    */
   pid_t pid;
+  /**
+   * pidfd for the application's root process, or -1 if it could not be
+   * opened. It becomes readable when the application exits.
+   */
+  int pidfd;
+  /**
+   * The application's cgroup under the cpuset controller's root, which the
+   * launcher created or took from the pool, e.g. "sam/pool-3".
+   */
+  char cg_name[64];
+  /**
+   * The application's cgroup's cpuset.cpus and tasks files, kept open while
+   * it is managed, or -1 if they are not open (yet). They are opened and
+   * closed under apps_lock.
+   */
+  int cpus_fd;
+  int tasks_fd;
+  /**
+   * On cgroup v1, the tasks file of the application's cgroup in the cpu
+   * hierarchy, which its threads join as well, or -1 if it is not open.
+   * Likewise opened and closed under apps_lock.
+   */
+  int cpu_tasks_fd;
+  /**
+   * The NUMA nodes, a bit each, in the application's cpuset.mems, or 0
+   * while it still has the nodes that the launcher gave it. Its CPUs have
+   * been on mem_nodes_want for mem_nodes_stable windows in a row; once they
+   * settle there its memory follows them.
+   */
+  uint64_t mem_nodes;
+  uint64_t mem_nodes_want;
+  int mem_nodes_stable;
+  /**
+   * The CPUs the application's threads were last pinned within, and whether
+   * any of its threads has left since. Only the sampler uses these, with -A.
+   */
+  cpu_set_t *placed_cpuset;
+  bool threads_left;
   uint64_t metric[N_METRICS];
   uint64_t extra_metric[N_EXTRA_METRICS];
   uint64_t bottleneck[N_METRICS];
   uint64_t value[MAX_COUNTERS];
+  /**
+   * The counts for the window being sampled. Only the sampler uses this; at
+   * the end of each window it hands a copy to the scheduler, which moves it
+   * into value[], bottleneck[] and num_clusters.
+   */
+  struct appsample window;
 
   /**
    * The number of PerfData's that refer to this application.
@@ -99,6 +160,19 @@ struct appinfo {
    * changes.
    */
   int curr_fair_share;
+  /**
+   * Set by the policy when the application shares its CPUs with others
+   * rather than having them to itself: the most of them it may use, in
+   * thousandths of a CPU (0 for no limit), and its weight against the others
+   * (1 to 10000, 100 by default). Both are 0 when it does not share.
+   */
+  int cpu_quota_milli;
+  int cpu_weight;
+  /**
+   * The quota and weight last written to the application's cgroup.
+   */
+  int applied_quota_milli;
+  int applied_weight;
   /**
    * Number of times the application has been given an allocation.
    */
@@ -144,6 +218,20 @@ struct appinfo {
 
   // NuPoCo:
   bool needs_profiling;
+
+  /**
+   * The number of clusters that the application's threads were partitioned
+   * into from their wakeups, or 0 if wakeups are not traced. Each thread's
+   * cluster is in its procinfo.
+   */
+  int num_clusters;
+  /**
+   * What the last window measured, kept for the control socket after the
+   * per-window values are reset: how many threads hit each bottleneck, and
+   * the instructions per second.
+   */
+  uint64_t last_bottleneck[N_METRICS];
+  uint64_t last_ips;
 };
 
 /**
@@ -0,0 +1,123 @@
+/*
+ * Latency histograms and the Prometheus text format; see metrics.h.
+ */
+#define _GNU_SOURCE
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int bucket_of(uint64_t value)
+{
+    int msb, idx;
+
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    msb = 63 - __builtin_clzll(value);
+    idx = (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS
+        + (int)(value >> (msb - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB_BUCKETS;
+    return idx < HISTOGRAM_BUCKETS ? idx : HISTOGRAM_BUCKETS - 1;
+}
+
+/* the largest value that counts in bucket @idx */
+static uint64_t bucket_max(int idx)
+{
+    int msb;
+    uint64_t sub;
+
+    if (idx < HISTOGRAM_SUB_BUCKETS)
+        return idx;
+
+    msb = idx / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    sub = HISTOGRAM_SUB_BUCKETS + idx % HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << (msb - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void histogram_record(struct histogram *h, uint64_t value)
+{
+    h->counts[bucket_of(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max)
+        h->max = value;
+}
+
+uint64_t histogram_quantile(const struct histogram *h, double q)
+{
+    uint64_t rank, seen = 0;
+
+    if (h->count == 0)
+        return 0;
+
+    rank = q * h->count;
+    if (rank < 1)
+        rank = 1;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += h->counts[i];
+        if (seen >= rank)
+            return bucket_max(i) < h->max ? bucket_max(i) : h->max;
+    }
+    return h->max;
+}
+
+void metrics_write_header(FILE *out, const char *name, const char *type, const char *help)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_write_histogram(FILE *out, const char *name, const char *labels, const struct histogram *h,
+                             double scale, int min_bits, int max_bits)
+{
+    const char *sep = labels[0] ? "," : "";
+    uint64_t cumulative = 0;
+    int idx = 0;
+
+    /* powers of 2 are bucket boundaries, so no bucket straddles an "le" */
+    for (int bits = min_bits; bits <= max_bits; ++bits) {
+        uint64_t bound = (uint64_t)1 << bits;
+
+        for (; idx < HISTOGRAM_BUCKETS && bucket_max(idx) < bound; ++idx)
+            cumulative += h->counts[idx];
+        fprintf(out, "%s_bucket{%s%sle=\"%.9g\"} %" PRIu64 "\n", name, labels, sep, bound * scale, cumulative);
+    }
+    fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n", name, labels, sep, h->count);
+    fprintf(out, "%s_sum{%s} %.9g\n", name, labels, h->sum * scale);
+    fprintf(out, "%s_count{%s} %" PRIu64 "\n", name, labels, h->count);
+}
+
+int metrics_publish(const char *path, const char *text, size_t len)
+{
+    char tmp[4096];
+    int fd;
+
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+        return -1;
+
+    for (size_t done = 0; done < len;) {
+        ssize_t n = write(fd, text + done, len - done);
+
+        if (n < 0) {
+            int saved_errno = errno;
+
+            close(fd);
+            unlink(tmp);
+            errno = saved_errno;
+            return -1;
+        }
+        done += n;
+    }
+
+    if (close(fd) != 0 || rename(tmp, path) != 0) {
+        int saved_errno = errno;
+
+        unlink(tmp);
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
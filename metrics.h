@@ -0,0 +1,69 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Histograms keep HISTOGRAM_SUB_BUCKETS buckets per power of 2, so any value
+ * is known to within 1/HISTOGRAM_SUB_BUCKETS (12.5%), in constant space and
+ * without allocating, as in HdrHistogram.
+ */
+#define HISTOGRAM_SUB_BITS      3
+#define HISTOGRAM_SUB_BUCKETS   (1 << HISTOGRAM_SUB_BITS)
+/* values up to 2^40 (about 18 minutes, in nanoseconds) */
+#define HISTOGRAM_MAX_BITS      40
+#define HISTOGRAM_BUCKETS       ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/**
+ * Count @value. Values too large for the histogram count in the last bucket.
+ */
+void histogram_record(struct histogram *h, uint64_t value);
+
+/**
+ * Returns the smallest value that at least a fraction @q of the recorded
+ * values are less than or equal to, to within the histogram's precision, or
+ * 0 if nothing was recorded.
+ */
+uint64_t histogram_quantile(const struct histogram *h, double q);
+
+/**
+ * Write the HELP and TYPE lines of metric family @name in the Prometheus text
+ * format.
+ */
+void metrics_write_header(FILE *out, const char *name, const char *type, const char *help);
+
+/**
+ * Write @h as the series of Prometheus histogram @name with @labels (e.g.
+ * "phase=\"read\"", or ""). Values are multiplied by @scale, e.g. 1e-9 to
+ * report nanoseconds in seconds. There is a bucket for every power of 2
+ * between 2^@min_bits and 2^@max_bits.
+ */
+void metrics_write_histogram(FILE *out, const char *name, const char *labels, const struct histogram *h,
+                             double scale, int min_bits, int max_bits);
+
+/**
+ * Replace the file at @path with @len bytes of @text, atomically, so that
+ * a scraper never sees half of it.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+int metrics_publish(const char *path, const char *text, size_t len);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* METRICS_H */
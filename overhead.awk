@@ -6,15 +6,17 @@ BEGIN {
     FS="\n"
 }
 
-# only process records when scheduler was active and sleep was uninterrupted
-$5 > 0 && $1 == 1 {
+# only process records when scheduler was active and the window was not cut short
+$6 > 0 && $1 >= 0.9 {
     sums["sleep"     ]+=log($1)
-    sums["perf"      ]+=log($2)
-    sums["perf setup"]+=log($3)
-    sums["perf read" ]+=log($4)
-    sums["scheduler" ]+=log($5)
-    sums["cgroups"   ]+=log($6)
-    sums["total"     ]+=log($7)
+    sums["discovery" ]+=log($2)
+    sums["perf"      ]+=log($3)
+    sums["perf setup"]+=log($4)
+    sums["perf read" ]+=log($5)
+    sums["scheduler" ]+=log($6)
+    sums["cgroups"   ]+=log($7)
+    sums["total"     ]+=log($8)
+    sums["duty"      ]+=log($9)
     processed++
 }
 
@@ -22,12 +24,14 @@ END {
     if (processed > 0) {
         print "Elapsed time (geomean seconds):"
         print "  sleep     " exp(sums["sleep"]/processed)
+        print "  discovery " exp(sums["discovery"]/processed)
         print "  perf      " exp(sums["perf"]/processed)
         print "    setup   " exp(sums["perf setup"]/processed)
         print "    read    " exp(sums["perf read"]/processed)
         print "  scheduler " exp(sums["scheduler"]/processed)
         print "  cgroups   " exp(sums["cgroups"]/processed)
         print "  total     " exp(sums["total"]/processed)
+        print "  duty      " exp(sums["duty"]/processed)
     } else if (NR > 0) {
         print "Scheduler was not running at any time."
     }
@@ -37,9 +37,35 @@ struct perf_group event_groups[] = {
 };
 
 #define N_GROUPS (sizeof(event_groups) / sizeof(event_groups[0]))
-#define SLEEP_TIME_MS 1000 / N_GROUPS
+#define SLEEP_TIME_MS PERFIO_WINDOW_MS / N_GROUPS
 
 struct perf_stat *threads = NULL;
+
+/**
+ * Make sure THREADS can hold at least @n threads.
+ */
+static int reserve_threads(int n)
+{
+    if (n <= THREADS.capacity)
+        return 0;
+
+    int capacity = THREADS.capacity ? THREADS.capacity : 1024;
+    while (capacity < n)
+        capacity *= 2;
+
+    pid_t *tid = realloc(THREADS.tid, capacity * sizeof *tid);
+    if (!tid)
+        return -1;
+    THREADS.tid = tid;
+
+    uint64_t (*event)[N_EVENTS] = realloc(THREADS.event, capacity * sizeof *event);
+    if (!event)
+        return -1;
+    THREADS.event = event;
+
+    THREADS.capacity = capacity;
+    return 0;
+}
 //perf event open function calls
 static int perf_event_open(struct perf_event_attr *hw_event, pid_t pid, int cpu, int group_fd,
                             unsigned long flags)
@@ -123,29 +149,27 @@ void stop_read_counters(const int fds[], size_t num_fds, const uint64_t ids[], u
         close(fds[i]);
 }
 
-//master function that orchestrates the entire performance monitoring for threads
-void perfio_read_counters(pid_t            tid[],
-                          int              index_tid,
-                          struct timespec *slept_time,
-                          struct timespec *setup_time,
-                          struct timespec *read_time)
+static int num_threads = 0;
+
+int perfio_num_groups(void)
 {
-    // Initialize time interval to count
-    struct timespec sleep_ts = { SLEEP_TIME_MS / 1000, (SLEEP_TIME_MS % 1000) * 1000000 };
-    struct timespec slept_ts = { 0 };
-    struct timespec setup_start,
-                    setup_end,
-                    setup_ts = { 0 };
-    struct timespec read_start,
-                    read_end,
-                    read_ts = { 0 };
+    return N_GROUPS;
+}
+
+void perfio_open_counters(const pid_t tid[], int index_tid, struct timespec *setup_time)
+{
+    struct timespec setup_start, setup_end;
 
     threads = calloc(index_tid, sizeof *threads);
+    if (index_tid > 0 && !threads) {
+        perror("perfio_open_counters: calloc");
+        index_tid = 0;
+    }
+    num_threads = index_tid;
 
     // iterate through all threads
     clock_gettime(CLOCK_MONOTONIC_RAW, &setup_start);
-    int i;
-    for (i = 0; i < index_tid; i++) {
+    for (int i = 0; i < index_tid; i++) {
         // set up performance counters
         for (size_t grp = 0; grp < N_GROUPS; grp++) {
             for (int k = 0; k < event_groups[grp].size; ++k) {
@@ -156,48 +180,72 @@ void perfio_read_counters(pid_t            tid[],
         }
     }
     clock_gettime(CLOCK_MONOTONIC_RAW, &setup_end);
-    setup_ts = timespec_add(setup_ts, timespec_sub(setup_end, setup_start));
-    //start counters
+    if (setup_time)
+        *setup_time = timespec_add(*setup_time, timespec_sub(setup_end, setup_start));
+}
+
+void perfio_start_group(int grp, struct timespec *setup_time)
+{
+    struct timespec setup_start, setup_end;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &setup_start);
+    for (int i = 0; i < num_threads; i++)
+        start_event(threads[i].fd[event_groups[grp].items[0]]);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &setup_end);
+    if (setup_time)
+        *setup_time = timespec_add(*setup_time, timespec_sub(setup_end, setup_start));
+}
+
+void perfio_stop_group(int grp, struct timespec *read_time)
+{
+    struct timespec read_start, read_end;
+
+    // stop counters and read counter values
+    clock_gettime(CLOCK_MONOTONIC_RAW, &read_start);
+    for (int i = 0; i < num_threads; i++) {
+        int fds[MAX_EVENT_GROUP_SZ];
+        uint64_t ids[MAX_EVENT_GROUP_SZ];
+        uint64_t *vps[MAX_EVENT_GROUP_SZ];
+
+        for (int k = 0; k < event_groups[grp].size; ++k) {
+            int evt = event_groups[grp].items[k];
+            fds[k] = threads[i].fd[evt];
+            ids[k] = threads[i].id[evt];
+            vps[k] = &threads[i].val[evt];
+        }
+
+        stop_read_counters(fds, event_groups[grp].size, ids, vps);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &read_end);
+    if (read_time)
+        *read_time = timespec_add(*read_time, timespec_sub(read_end, read_start));
+}
+
+//master function that orchestrates the entire performance monitoring for threads
+void perfio_read_counters(const pid_t      tid[],
+                          int              index_tid,
+                          struct timespec *slept_time,
+                          struct timespec *setup_time,
+                          struct timespec *read_time)
+{
+    // Initialize time interval to count
+    struct timespec sleep_ts = { SLEEP_TIME_MS / 1000, (SLEEP_TIME_MS % 1000) * 1000000 };
+    struct timespec slept_ts = { 0 };
+    struct timespec setup_ts = { 0 };
+    struct timespec read_ts = { 0 };
 
-    // duration of count
-    //  nanosleep(&tim, NULL);
+    perfio_open_counters(tid, index_tid, &setup_ts);
 
     //Read two buffers
-    size_t grp;
-    for (grp = 0; grp < N_GROUPS; grp++) {
-        int i; 
-
-        setup_start = (struct timespec) { 0 };
-        setup_end = (struct timespec) { 0 };
-        clock_gettime(CLOCK_MONOTONIC_RAW, &setup_start);
-        for (i = 0; i < index_tid; i++)
-            start_event(threads[i].fd[event_groups[grp].items[0]]);
-        clock_gettime(CLOCK_MONOTONIC_RAW, &setup_end);
-        setup_ts = timespec_add(setup_ts, timespec_sub(setup_end, setup_start));
+    for (size_t grp = 0; grp < N_GROUPS; grp++) {
+        perfio_start_group(grp, &setup_ts);
 
         // duration of count
         struct timespec rem_group = { 0 };
         nanosleep(&sleep_ts, &rem_group);
         slept_ts = timespec_add(slept_ts, timespec_sub(sleep_ts, rem_group));
 
-        // stop counters and read counter values
-        clock_gettime(CLOCK_MONOTONIC_RAW, &read_start);
-        for (i = 0; i < index_tid; i++) {
-            int fds[MAX_EVENT_GROUP_SZ];
-            uint64_t ids[MAX_EVENT_GROUP_SZ];
-            uint64_t *vps[MAX_EVENT_GROUP_SZ];
-
-            for (int k = 0; k < event_groups[grp].size; ++k) {
-                int evt = event_groups[grp].items[k];
-                fds[k] = threads[i].fd[evt];
-                ids[k] = threads[i].id[evt];
-                vps[k] = &threads[i].val[evt];
-            }
-
-            stop_read_counters(fds, event_groups[grp].size, ids, vps);
-        }
-        clock_gettime(CLOCK_MONOTONIC_RAW, &read_end);
-        read_ts = timespec_add(read_ts, timespec_sub(read_end, read_start));
+        perfio_stop_group(grp, &read_ts);
     }
 
     if (slept_time)
@@ -208,14 +256,21 @@ void perfio_read_counters(pid_t            tid[],
         *read_time = read_ts;
 }
 
-void displayTIDEvents(pid_t tid[], int index_tid)
+void displayTIDEvents(const pid_t tid[], int index_tid)
 {
     // printf("CountEvents Index:%d\n", index_tid);
 
+    if (!threads || reserve_threads(index_tid) != 0) {
+        THREADS.index_tid = 0;
+        free(threads);
+        threads = NULL;
+        return;
+    }
+
     int i;
+    THREADS.index_tid = index_tid;
     for (i = 0; i < index_tid; i++) {
         THREADS.tid[i] = tid[i];
-        THREADS.index_tid = index_tid;
 
         int j;
         for (j = 0; j < N_EVENTS; j++)
@@ -251,11 +306,13 @@ int searchTID(int tid)
 
 void copyValues(pid_t tid[], int index_tid)
 {
+    if (!threads || reserve_threads(index_tid) != 0)
+        return;
 
     int i;
+    THREADS.index_tid = index_tid;
     for (i = 0; i < index_tid; i++) {
         THREADS.tid[i] = tid[i];
-        THREADS.index_tid = index_tid;
 
         int j;
         for (j = 0; j < N_EVENTS; j++)
@@ -47,14 +47,16 @@ enum perf_event {
     N_EVENTS,
 };
 
-#define NUM_THREAD 500000 // Total Threads being monitored
 #define ITER 1         // Number of iterations
+#define PERFIO_WINDOW_MS 1000 // Length of one counting window
 
 // Data structure to collect information per TID performance counters
+// The arrays grow to fit the number of threads being monitored.
 struct perfThread {
-    pid_t tid[NUM_THREAD];
+    pid_t *tid;
     int index_tid;
-    uint64_t event[NUM_THREAD][N_EVENTS];
+    int capacity;
+    uint64_t (*event)[N_EVENTS];
 };
 extern struct perfThread THREADS;
 
@@ -92,6 +94,7 @@ extern "C" {
 #endif
 
 extern const char *event_names[];
+extern uint64_t event_codes[];
 
 /**
  * Read performance counters.
@@ -101,13 +104,28 @@ extern const char *event_names[];
  * @param setup_time        (optional) if non-NULL, is filled with the time it takes to setup counters
  * @param read_time         (optional) if non-NULL, is filled with the time it takes to read counters
  */
-void perfio_read_counters(pid_t            tid[],
+void perfio_read_counters(const pid_t      tid[],
                           int              index_tid,
                           struct timespec *slept_time,
                           struct timespec *setup_time,
                           struct timespec *read_time);
 
-void displayTIDEvents(pid_t tid[], int index_tid);
+/*
+ * The steps of perfio_read_counters(), for callers that keep their own time.
+ * Counters are opened for all threads, then each group is counted in turn
+ * between perfio_start_group() and perfio_stop_group(), and finally the
+ * values are collected with displayTIDEvents(). The optional timespecs are
+ * added to.
+ */
+int perfio_num_groups(void);
+
+void perfio_open_counters(const pid_t tid[], int index_tid, struct timespec *setup_time);
+
+void perfio_start_group(int grp, struct timespec *setup_time);
+
+void perfio_stop_group(int grp, struct timespec *read_time);
+
+void displayTIDEvents(const pid_t tid[], int index_tid);
 
 int searchTID(int tid);
 
@@ -0,0 +1,180 @@
+/*
+ * BPF counter collector. This is an alternative to perfio_read_counters()
+ * that keeps the per-thread work in the kernel; see bpf/samcollect.bpf.c.
+ */
+#include "perfio_bpf.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_BPF
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <linux/types.h>
+
+#include "bpf/samcollect.h"
+#include "samcollect.skel.h"
+
+_Static_assert(SAMCOLLECT_NR_EVENTS == N_EVENTS, "samcollect.h and perfio.h disagree on the number of events");
+
+static struct samcollect_bpf *skel;
+static int *event_fds;
+static int num_event_fds;
+static int num_possible_cpus;
+static struct samcollect_counts *percpu_counts;
+
+int perfio_bpf_init(int num_cpus)
+{
+    int err;
+
+    if (!(skel = samcollect_bpf__open()))
+        return -1;
+
+    num_event_fds = num_cpus * N_EVENTS;
+    if ((err = bpf_map__set_max_entries(skel->maps.events, num_event_fds)) != 0 ||
+        (err = samcollect_bpf__load(skel)) != 0)
+        goto error;
+
+    if (!(event_fds = malloc(num_event_fds * sizeof *event_fds))) {
+        err = -errno;
+        goto error;
+    }
+    for (int i = 0; i < num_event_fds; ++i)
+        event_fds[i] = -1;
+
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+        for (int evt = 0; evt < N_EVENTS; ++evt) {
+            struct perf_event_attr pea;
+            int key = cpu * N_EVENTS + evt;
+
+            memset(&pea, 0, sizeof pea);
+            pea.type = PERF_TYPE_RAW;
+            pea.size = sizeof pea;
+            pea.config = event_codes[evt];
+
+            event_fds[key] = syscall(__NR_perf_event_open, &pea, -1, cpu, -1, 0);
+            if (event_fds[key] < 0) {
+                /* the collector reads zeros for this event on this CPU */
+                fprintf(stderr, "perfio_bpf: could not count %s on CPU %d: %s\n",
+                        event_names[evt], cpu, strerror(errno));
+                continue;
+            }
+
+            if ((err = bpf_map_update_elem(bpf_map__fd(skel->maps.events), &key, &event_fds[key], BPF_ANY)) != 0)
+                goto error;
+        }
+    }
+
+    if ((num_possible_cpus = libbpf_num_possible_cpus()) < 0) {
+        err = num_possible_cpus;
+        goto error;
+    }
+    if (!(percpu_counts = calloc(num_possible_cpus, sizeof *percpu_counts))) {
+        err = -errno;
+        goto error;
+    }
+
+    if ((err = samcollect_bpf__attach(skel)) != 0)
+        goto error;
+
+    return 0;
+
+error:
+    perfio_bpf_exit();
+    errno = -err;
+    return -1;
+}
+
+int perfio_bpf_track(pid_t tid, pid_t app_pid)
+{
+    __u32 key = tid, value = app_pid;
+
+    return bpf_map_update_elem(bpf_map__fd(skel->maps.tasks), &key, &value, BPF_ANY);
+}
+
+int perfio_bpf_untrack(pid_t tid)
+{
+    __u32 key = tid;
+
+    if (bpf_map_delete_elem(bpf_map__fd(skel->maps.tasks), &key) != 0 && errno != ENOENT)
+        return -1;
+    return 0;
+}
+
+int perfio_bpf_read_app(pid_t app_pid, uint64_t val[N_EVENTS])
+{
+    __u32 key = app_pid;
+
+    memset(val, 0, N_EVENTS * sizeof val[0]);
+    if (bpf_map_lookup_and_delete_elem(bpf_map__fd(skel->maps.app_counts), &key, percpu_counts) != 0)
+        return errno == ENOENT ? 0 : -1;
+
+    for (int evt = 0; evt < N_EVENTS; ++evt) {
+        uint64_t counter = 0, enabled = 0, running = 0;
+
+        for (int cpu = 0; cpu < num_possible_cpus; ++cpu) {
+            counter += percpu_counts[cpu].counter[evt];
+            enabled += percpu_counts[cpu].enabled[evt];
+            running += percpu_counts[cpu].running[evt];
+        }
+
+        val[evt] = running ? (uint64_t)((double)counter * enabled / running) : counter;
+    }
+
+    return 0;
+}
+
+void perfio_bpf_exit(void)
+{
+    samcollect_bpf__destroy(skel);
+    skel = NULL;
+
+    for (int i = 0; event_fds && i < num_event_fds; ++i)
+        if (event_fds[i] >= 0)
+            close(event_fds[i]);
+    free(event_fds);
+    event_fds = NULL;
+    num_event_fds = 0;
+
+    free(percpu_counts);
+    percpu_counts = NULL;
+}
+
+#else   /* !HAVE_BPF */
+
+int perfio_bpf_init(int num_cpus)
+{
+    (void) num_cpus;
+    errno = ENOSYS;
+    return -1;
+}
+
+int perfio_bpf_track(pid_t tid, pid_t app_pid)
+{
+    (void) tid;
+    (void) app_pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+int perfio_bpf_untrack(pid_t tid)
+{
+    (void) tid;
+    errno = ENOSYS;
+    return -1;
+}
+
+int perfio_bpf_read_app(pid_t app_pid, uint64_t val[N_EVENTS])
+{
+    (void) app_pid;
+    (void) val;
+    errno = ENOSYS;
+    return -1;
+}
+
+void perfio_bpf_exit(void)
+{
+}
+
+#endif  /* HAVE_BPF */
@@ -0,0 +1,53 @@
+#ifndef PERFIO_BPF_H
+#define PERFIO_BPF_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "perfio.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Load the BPF collector and open the counters on each of @num_cpus CPUs.
+ *
+ * The collector follows the threads of managed applications through fork
+ * and exit in the kernel and accumulates their counters per application on
+ * every context switch, so reading an application's counters is a single
+ * map lookup.
+ *
+ * Returns 0 on success, or -1 with errno set. errno is ENOSYS if this
+ * program was built without BPF support (make BPF=1).
+ */
+int perfio_bpf_init(int num_cpus);
+
+/**
+ * Attribute thread @tid, and any thread it creates from now on, to the
+ * application @app_pid.
+ */
+int perfio_bpf_track(pid_t tid, pid_t app_pid);
+
+/**
+ * Stop attributing thread @tid to any application.
+ */
+int perfio_bpf_untrack(pid_t tid);
+
+/**
+ * Read and reset the counters accumulated for @app_pid since the last call.
+ *
+ * @val is indexed by enum perf_event and scaled for multiplexing.
+ */
+int perfio_bpf_read_app(pid_t app_pid, uint64_t val[N_EVENTS]);
+
+/**
+ * Detach the collector and close its counters.
+ */
+void perfio_bpf_exit(void);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* PERFIO_BPF_H */
@@ -0,0 +1,104 @@
+/*
+ * A minimal epoll reactor. samd's sampler is driven entirely by it: window
+ * timers, signals, application arrival and exit, and control requests.
+ */
+#include "reactor.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define REACTOR_MAX_EVENTS 64
+
+struct reactor_source {
+    reactor_fn fn;
+    void *arg;
+};
+
+static int epfd = -1;
+/* indexed by fd */
+static struct reactor_source *sources;
+static int num_sources;
+
+int reactor_init(void)
+{
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return -1;
+    return 0;
+}
+
+int reactor_add(int fd, uint32_t events, reactor_fn fn, void *arg)
+{
+    struct epoll_event ev;
+
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (fd >= num_sources) {
+        int n = num_sources ? num_sources : 64;
+        struct reactor_source *grown;
+
+        while (n <= fd)
+            n *= 2;
+        if (!(grown = realloc(sources, n * sizeof *sources)))
+            return -1;
+        memset(&grown[num_sources], 0, (n - num_sources) * sizeof *grown);
+        sources = grown;
+        num_sources = n;
+    }
+
+    memset(&ev, 0, sizeof ev);
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        return -1;
+
+    sources[fd].fn = fn;
+    sources[fd].arg = arg;
+    return 0;
+}
+
+int reactor_del(int fd)
+{
+    if (fd < 0 || fd >= num_sources || !sources[fd].fn) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    sources[fd].fn = NULL;
+    sources[fd].arg = NULL;
+    return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int reactor_run_once(int timeout_ms)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int n, ran = 0;
+
+    if ((n = epoll_wait(epfd, events, REACTOR_MAX_EVENTS, timeout_ms)) < 0)
+        return errno == EINTR ? 0 : -1;
+
+    for (int i = 0; i < n; ++i) {
+        int fd = events[i].data.fd;
+
+        /* an earlier handler may have removed this one */
+        if (fd >= num_sources || !sources[fd].fn)
+            continue;
+        sources[fd].fn(fd, events[i].events, sources[fd].arg);
+        ran++;
+    }
+
+    return ran;
+}
+
+void reactor_exit(void)
+{
+    if (epfd >= 0)
+        close(epfd);
+    epfd = -1;
+    free(sources);
+    sources = NULL;
+    num_sources = 0;
+}
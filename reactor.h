@@ -0,0 +1,50 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Called when @fd is ready, with the epoll events that are pending on it.
+ */
+typedef void (*reactor_fn)(int fd, uint32_t events, void *arg);
+
+/**
+ * Create the reactor's epoll instance.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+int reactor_init(void);
+
+/**
+ * Call @fn(@fd, events, @arg) whenever @fd is ready for any of @events
+ * (EPOLLIN, EPOLLOUT, ...). Each fd can have one handler.
+ */
+int reactor_add(int fd, uint32_t events, reactor_fn fn, void *arg);
+
+/**
+ * Stop watching @fd. This must be done before closing it, and may be done
+ * from within a handler.
+ */
+int reactor_del(int fd);
+
+/**
+ * Wait up to @timeout_ms (or forever, if negative) for fds to become ready
+ * and run their handlers.
+ *
+ * Returns the number of handlers run, or -1 with errno set. A wait that is
+ * interrupted by a signal returns 0.
+ */
+int reactor_run_once(int timeout_ms);
+
+void reactor_exit(void);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* REACTOR_H */
@@ -0,0 +1,219 @@
+#include "reconfig.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* what is known of the applications while their steps are planned */
+struct planner {
+    int num_apps;
+    int num_cpus;
+    size_t sz;
+    cpu_set_t *const *from;
+    /* the CPUs each application ends up with */
+    const cpu_set_t **target;
+    /* and those it holds after the steps planned so far */
+    const cpu_set_t **cur;
+    /* whether its cpuset has been written, ever */
+    bool *confined;
+    /* whether it still has a step to make */
+    bool *pending;
+    /* the applications holding a CPU, for overlaps() */
+    int *holders;
+};
+
+/* whether applications @a and @b may both hold CPU @c */
+static bool allowed(const struct planner *p, int a, int b, int c)
+{
+    return (CPU_ISSET_S(c, p->sz, p->target[a]) && CPU_ISSET_S(c, p->sz, p->target[b])) ||
+           (CPU_ISSET_S(c, p->sz, p->from[a]) && CPU_ISSET_S(c, p->sz, p->from[b]));
+}
+
+/* the CPUs of @set that application @j would take from another */
+static int conflicts(const struct planner *p, int j, const cpu_set_t *set)
+{
+    int n = 0;
+
+    for (int c = 0; c < p->num_cpus; ++c) {
+        if (!CPU_ISSET_S(c, p->sz, set))
+            continue;
+        for (int k = 0; k < p->num_apps; ++k) {
+            if (k != j && p->confined[k] && CPU_ISSET_S(c, p->sz, p->cur[k]) && !allowed(p, j, k, c)) {
+                n++;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+/* whether two applications hold a CPU that they should not share */
+static bool overlaps(const struct planner *p)
+{
+    for (int c = 0; c < p->num_cpus; ++c) {
+        int n = 0;
+
+        for (int k = 0; k < p->num_apps; ++k)
+            if (p->confined[k] && CPU_ISSET_S(c, p->sz, p->cur[k]))
+                p->holders[n++] = k;
+        for (int a = 0; a < n; ++a)
+            for (int b = a + 1; b < n; ++b)
+                if (!allowed(p, p->holders[a], p->holders[b], c))
+                    return true;
+    }
+    return false;
+}
+
+static void add_step(struct reconfig_plan *plan, int app, cpu_set_t *set, bool shrink)
+{
+    struct reconfig_step *step = &plan->steps[plan->num_steps++];
+
+    step->app = app;
+    step->set = set;
+    step->shrink = shrink;
+    if (shrink)
+        plan->num_shrinks++;
+    else
+        plan->num_grows++;
+}
+
+static void end_round(struct reconfig_plan *plan, const struct planner *p)
+{
+    const int start = plan->num_rounds > 0 ? plan->rounds[plan->num_rounds - 1].end : 0;
+
+    if (plan->num_steps == start)
+        return;
+    plan->rounds[plan->num_rounds].end = plan->num_steps;
+    plan->rounds[plan->num_rounds].overlaps = overlaps(p);
+    plan->num_rounds++;
+}
+
+int reconfig_plan(struct reconfig_plan *plan,
+                  int                   num_apps,
+                  cpu_set_t *const      from[],
+                  cpu_set_t *const      to[],
+                  const bool            changed[],
+                  int                   num_cpus)
+{
+    struct planner p;
+    int num_pending = 0;
+    int *ready;
+
+    memset(plan, 0, sizeof *plan);
+    p.num_apps = num_apps;
+    p.num_cpus = num_cpus;
+    p.sz = CPU_ALLOC_SIZE(num_cpus);
+    p.from = from;
+    p.target = calloc(num_apps, sizeof *p.target);
+    p.cur = calloc(num_apps, sizeof *p.cur);
+    p.confined = calloc(num_apps, sizeof *p.confined);
+    p.pending = calloc(num_apps, sizeof *p.pending);
+    p.holders = calloc(num_apps, sizeof *p.holders);
+    ready = calloc(num_apps, sizeof *ready);
+    /* at most one step each way per application, and a round each at worst */
+    plan->steps = calloc(2 * num_apps, sizeof *plan->steps);
+    plan->rounds = calloc(num_apps + 1, sizeof *plan->rounds);
+    if (num_apps > 0 && (!p.target || !p.cur || !p.confined || !p.pending || !p.holders || !ready ||
+                         !plan->steps || !plan->rounds)) {
+        errno = ENOMEM;
+        goto fail;
+    }
+
+    for (int j = 0; j < num_apps; ++j) {
+        p.pending[j] = changed[j] && CPU_COUNT_S(p.sz, to[j]) > 0;
+        p.target[j] = p.pending[j] ? to[j] : from[j];
+        p.cur[j] = from[j];
+        p.confined[j] = CPU_COUNT_S(p.sz, from[j]) > 0;
+        num_pending += p.pending[j];
+    }
+
+    /* first, whoever loses CPUs gives them up, keeping those it will still have */
+    for (int j = 0; j < num_apps; ++j) {
+        cpu_set_t *kept;
+
+        if (!p.pending[j] || !p.confined[j])
+            continue;
+        if (!(kept = CPU_ALLOC(num_cpus))) {
+            errno = ENOMEM;
+            goto fail;
+        }
+        CPU_AND_S(p.sz, kept, from[j], to[j]);
+        /* an application that moves altogether waits for its new CPUs instead */
+        if (CPU_COUNT_S(p.sz, kept) == 0 || CPU_EQUAL_S(p.sz, kept, from[j])) {
+            CPU_FREE(kept);
+            continue;
+        }
+        add_step(plan, j, kept, true);
+        p.cur[j] = kept;
+        if (CPU_EQUAL_S(p.sz, kept, to[j])) {
+            p.pending[j] = false;
+            num_pending--;
+        }
+    }
+    end_round(plan, &p);
+
+    /* then the others take their CPUs, as soon as nobody holds them */
+    while (num_pending > 0) {
+        int num_ready = 0;
+
+        for (int j = 0; j < num_apps; ++j)
+            if (p.pending[j] && conflicts(&p, j, to[j]) == 0)
+                ready[num_ready++] = j;
+
+        /* applications that swap CPUs wait on each other, so one goes first, taking as few as it can */
+        if (num_ready == 0) {
+            int fewest = -1, least = 0;
+
+            for (int j = 0; j < num_apps; ++j) {
+                int n;
+
+                if (!p.pending[j])
+                    continue;
+                n = conflicts(&p, j, to[j]);
+                if (fewest < 0 || n < least) {
+                    fewest = j;
+                    least = n;
+                }
+            }
+            ready[num_ready++] = fewest;
+        }
+
+        for (int i = 0; i < num_ready; ++i) {
+            const int j = ready[i];
+
+            add_step(plan, j, to[j], false);
+            p.cur[j] = to[j];
+            p.confined[j] = true;
+            p.pending[j] = false;
+            num_pending--;
+        }
+        end_round(plan, &p);
+    }
+
+    free(p.target);
+    free(p.cur);
+    free(p.confined);
+    free(p.pending);
+    free(p.holders);
+    free(ready);
+    return 0;
+
+fail:
+    free(p.target);
+    free(p.cur);
+    free(p.confined);
+    free(p.pending);
+    free(p.holders);
+    free(ready);
+    reconfig_plan_free(plan);
+    return -1;
+}
+
+void reconfig_plan_free(struct reconfig_plan *plan)
+{
+    for (int i = 0; i < plan->num_steps; ++i)
+        if (plan->steps[i].shrink)
+            CPU_FREE(plan->steps[i].set);
+    free(plan->steps);
+    free(plan->rounds);
+    memset(plan, 0, sizeof *plan);
+}
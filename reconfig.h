@@ -0,0 +1,80 @@
+#ifndef RECONFIG_H
+#define RECONFIG_H
+
+#include <stdbool.h>
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * The order in which to write the cpusets of a window, so that no two
+ * applications hold the same CPUs in between: every application that loses
+ * CPUs gives them up first, and then the others take theirs in rounds, each
+ * round only onto CPUs that nobody holds any more. When applications swap
+ * CPUs there is no such order, and the plan overlaps them for as short as
+ * it can.
+ */
+
+/**
+ * One cpuset to write.
+ */
+struct reconfig_step {
+    /* the application, by its index in the arrays given to reconfig_plan() */
+    int app;
+    /* the CPUs it is given */
+    cpu_set_t *set;
+    /* whether it only gives up CPUs, on its way to its new cpuset */
+    bool shrink;
+};
+
+/**
+ * Steps that can be made in any order, once those of the rounds before have
+ * been made.
+ */
+struct reconfig_round {
+    /* the index after the last step of the round */
+    int end;
+    /* whether two applications share CPUs they should not once it is made */
+    bool overlaps;
+};
+
+struct reconfig_plan {
+    struct reconfig_step *steps;
+    int num_steps;
+    struct reconfig_round *rounds;
+    int num_rounds;
+    /* the steps that give up CPUs, and those that take them */
+    int num_shrinks;
+    int num_grows;
+};
+
+/**
+ * Plan moving each of @num_apps applications from its CPUs in @from to
+ * those in @to, of @num_cpus, if it @changed. An application with no CPUs
+ * in @from has not been restricted yet and runs anywhere, so it is never
+ * counted as overlapping; one with none in @to is not written. CPUs that
+ * two applications hold together in @from or in @to, as applications that
+ * share CPUs do, are not counted as overlapping either.
+ *
+ * Returns 0, or -1 (with errno set) if there is no memory. The plan is then
+ * empty; either way it is freed with reconfig_plan_free().
+ */
+int reconfig_plan(struct reconfig_plan *plan,
+                  int                   num_apps,
+                  cpu_set_t *const      from[],
+                  cpu_set_t *const      to[],
+                  const bool            changed[],
+                  int                   num_cpus);
+
+void reconfig_plan_free(struct reconfig_plan *plan);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* RECONFIG_H */
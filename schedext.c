@@ -0,0 +1,141 @@
+/*
+ * sched_ext enforcement of CPU budgets; see bpf/samsched.bpf.c. This is an
+ * alternative to writing each application's cpuset.cpus.
+ */
+#include "schedext.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_BPF
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <linux/types.h>
+
+#include "bpf/samsched.h"
+#include "samsched.skel.h"
+
+static struct samsched_bpf *skel;
+static struct bpf_link *ops_link;
+
+int schedext_init(int num_cpus)
+{
+    int err;
+
+    if (num_cpus > SAMSCHED_MAX_CPUS) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    if (!(skel = samsched_bpf__open()))
+        return -1;
+
+    skel->rodata->nr_cpus = num_cpus;
+    if ((err = samsched_bpf__load(skel)) != 0)
+        goto error;
+
+    if (!(ops_link = bpf_map__attach_struct_ops(skel->maps.samsched_ops))) {
+        err = -errno;
+        goto error;
+    }
+
+    return 0;
+
+error:
+    schedext_exit();
+    errno = -err;
+    return -1;
+}
+
+int schedext_track(pid_t tid, pid_t app_pid)
+{
+    __u32 key = tid, value = app_pid;
+
+    return bpf_map_update_elem(bpf_map__fd(skel->maps.tasks), &key, &value, BPF_ANY);
+}
+
+int schedext_untrack(pid_t tid)
+{
+    __u32 key = tid;
+
+    if (bpf_map_delete_elem(bpf_map__fd(skel->maps.tasks), &key) != 0 && errno != ENOENT)
+        return -1;
+    return 0;
+}
+
+int schedext_set_cpus(pid_t app_pid, const cpu_set_t *set, size_t setsize)
+{
+    __u32 key = app_pid;
+    struct samsched_mask mask;
+
+    memset(&mask, 0, sizeof mask);
+    for (int cpu = 0; cpu < SAMSCHED_MAX_CPUS && (size_t)cpu < setsize * 8; ++cpu) {
+        if (CPU_ISSET_S(cpu, setsize, set))
+            mask.bits[cpu / 64] |= 1ULL << (cpu % 64);
+    }
+
+    return bpf_map_update_elem(bpf_map__fd(skel->maps.app_masks), &key, &mask, BPF_ANY);
+}
+
+int schedext_remove_app(pid_t app_pid)
+{
+    __u32 key = app_pid;
+
+    if (bpf_map_delete_elem(bpf_map__fd(skel->maps.app_masks), &key) != 0 && errno != ENOENT)
+        return -1;
+    return 0;
+}
+
+void schedext_exit(void)
+{
+    bpf_link__destroy(ops_link);
+    ops_link = NULL;
+    samsched_bpf__destroy(skel);
+    skel = NULL;
+}
+
+#else   /* !HAVE_BPF */
+
+int schedext_init(int num_cpus)
+{
+    (void) num_cpus;
+    errno = ENOSYS;
+    return -1;
+}
+
+int schedext_track(pid_t tid, pid_t app_pid)
+{
+    (void) tid;
+    (void) app_pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+int schedext_untrack(pid_t tid)
+{
+    (void) tid;
+    errno = ENOSYS;
+    return -1;
+}
+
+int schedext_set_cpus(pid_t app_pid, const cpu_set_t *set, size_t setsize)
+{
+    (void) app_pid;
+    (void) set;
+    (void) setsize;
+    errno = ENOSYS;
+    return -1;
+}
+
+int schedext_remove_app(pid_t app_pid)
+{
+    (void) app_pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+void schedext_exit(void)
+{
+}
+
+#endif  /* HAVE_BPF */
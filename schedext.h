@@ -0,0 +1,61 @@
+#ifndef SCHEDEXT_H
+#define SCHEDEXT_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Load and enable the sched_ext scheduler for a machine with @num_cpus CPUs.
+ *
+ * While it is enabled, the threads of each managed application only run on
+ * the CPUs set with schedext_set_cpus(), and changing them is a map update
+ * rather than a cpuset write. Applications that have not been given CPUs
+ * yet, and all other tasks, may run anywhere.
+ *
+ * Returns 0 on success, or -1 with errno set. errno is ENOSYS if this
+ * program was built without BPF support (make BPF=1), and may be ENOTSUP if
+ * the kernel lacks sched_ext (Linux 6.12+).
+ */
+int schedext_init(int num_cpus);
+
+/**
+ * Schedule thread @tid, and any thread it creates from now on, as part of
+ * application @app_pid.
+ */
+int schedext_track(pid_t tid, pid_t app_pid);
+
+/**
+ * Stop scheduling thread @tid as part of any application.
+ */
+int schedext_untrack(pid_t tid);
+
+/**
+ * Restrict application @app_pid to the CPUs in @set, which is @setsize bytes
+ * long. Sets of different applications may overlap, in which case they
+ * time-share the common CPUs.
+ */
+int schedext_set_cpus(pid_t app_pid, const cpu_set_t *set, size_t setsize);
+
+/**
+ * Forget the CPUs of application @app_pid.
+ */
+int schedext_remove_app(pid_t app_pid);
+
+/**
+ * Disable the scheduler, which returns all tasks to the default scheduler.
+ */
+void schedext_exit(void);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* SCHEDEXT_H */
@@ -2,6 +2,7 @@
 #include "nupoco.h"
 
 #include "../budgets.h"
+#include "../log.h"
 #include "../util.h"
 
 #include <assert.h>
@@ -243,13 +244,23 @@ nupoco_allocate(const int                   num_apps,
                 cpu_set_t                  *new_cpusets[],
                 cpu_set_t                  *remaining_cpus)
 {
+    /* the CPUs that may be allocated, which are all in @remaining_cpus to begin with */
+    const int num_cpus = CPU_COUNT_S(rem_cpus_sz, remaining_cpus);
+
+    /* the budgeter tries the sockets in this order; it must list them all */
+    for (int i = 0; i < num_apps; i++)
+        for (int s = 0; s < cpuinfo->num_sockets; s++)
+            per_app_socket_orders[i][s] = s;
+
     switch (scheduling_phase) {
     case PROFILING_RUN:
     {
-        printf("NUPOCO Profiling. Will allocate one core for each app.\n");
+        log_debug("NUPOCO Profiling. Will allocate one core for each app.\n");
         // allocate each app to one core during the profiling run
         for (int i = 0; i < num_apps; i++) {
             cpu_set_t *new_cpuset = CPU_ALLOC(cpuinfo->total_cpus);
+
+            CPU_ZERO_S(rem_cpus_sz, new_cpuset);
             budget_default(apps_sorted[i]->cpuset[1], new_cpuset, true, remaining_cpus, rem_cpus_sz, 1, per_app_socket_orders[i]);
             new_cpusets[i] = new_cpuset;
         }
@@ -262,7 +273,7 @@ nupoco_allocate(const int                   num_apps,
         int available_sockets = cpuinfo->num_sockets;
         const int cpus_per_socket = cpuinfo->sockets[0].num_cpus;
 
-        printf("NUPOCO Greedy allocation. Will reserve one socket for each parallel app.\n");
+        log_debug("NUPOCO Greedy allocation. Will reserve one socket for each parallel app.\n");
         // reserve at least one socket for every app that's in its parallel phase
         for (int i = 0; i < num_apps && i < available_sockets; i++) {
             if (app_is_parallel(apps_sorted[i])) {
@@ -334,7 +345,7 @@ nupoco_allocate(const int                   num_apps,
                     cpu_utilization += cpu_utilization_avg * app_used_cpus;
                 }
 
-                cpu_utilization /= cpuinfo->total_cpus;
+                cpu_utilization /= num_cpus;
 
                 double system_utilization = mct_utilization_total + cpu_utilization;
 
@@ -346,7 +357,7 @@ nupoco_allocate(const int                   num_apps,
 
             if (best_i != -1) {
                 per_app_cpu_budget[best_i] += cpus_per_socket;
-                printf("NUPOCO [APP %6d] reserving one more socket\n", apps_sorted[best_i]->pid);
+                log_debug("NUPOCO [APP %6d] reserving one more socket\n", apps_sorted[best_i]->pid);
             }
         }
 
@@ -361,6 +372,7 @@ nupoco_allocate(const int                   num_apps,
         for (int i = 0; i < num_apps; ++i) {
             cpu_set_t *new_cpuset = CPU_ALLOC(cpuinfo->total_cpus);
 
+            CPU_ZERO_S(rem_cpus_sz, new_cpuset);
             budget_default(apps_sorted[i]->cpuset[0], new_cpuset, true, remaining_cpus, rem_cpus_sz, per_app_cpu_budget[i], per_app_socket_orders[i]);
 
             /* subtract allocated cpus from remaining cpus,
@@ -379,7 +391,7 @@ nupoco_allocate(const int                   num_apps,
     {
         struct socket_llcinfo *sockets = calloc(cpuinfo->num_sockets, sizeof sockets[0]);
 
-        printf("NUPOCO Adaptive allocation. Will swap cores between busy and idle apps.\n");
+        log_debug("NUPOCO Adaptive allocation. Will swap cores between busy and idle apps.\n");
         for (int i = 0; i < cpuinfo->num_sockets; i++) {
             sockets[i].appid_min_llc_misses = -1;
             sockets[i].cpuid_max_llc_misses = -1;
@@ -443,14 +455,14 @@ nupoco_allocate(const int                   num_apps,
                 CPU_SET_S(idle_socket.cpuid_min_llc_misses, rem_cpus_sz, new_cpusets[busy_socket.appid_min_llc_misses]);
                 CPU_SET_S(busy_socket.cpuid_max_llc_misses, rem_cpus_sz, new_cpusets[idle_socket.appid_min_llc_misses]);
 
-                printf("NUPOCO [APP %6d] giving CPU %4d --> APP %6d\n",
-                        apps_sorted[idle_socket.appid_min_llc_misses]->pid,
-                        idle_socket.cpuid_min_llc_misses,
-                        apps_sorted[busy_socket.appid_max_llc_misses]->pid);
-                printf("NUPOCO [APP %6d] giving CPU %4d --> APP %6d\n",
-                        apps_sorted[busy_socket.appid_max_llc_misses]->pid,
-                        busy_socket.cpuid_max_llc_misses,
-                        apps_sorted[idle_socket.appid_min_llc_misses]->pid);
+                log_debug("NUPOCO [APP %6d] giving CPU %4d --> APP %6d\n",
+                           apps_sorted[idle_socket.appid_min_llc_misses]->pid,
+                           idle_socket.cpuid_min_llc_misses,
+                           apps_sorted[busy_socket.appid_max_llc_misses]->pid);
+                log_debug("NUPOCO [APP %6d] giving CPU %4d --> APP %6d\n",
+                           apps_sorted[busy_socket.appid_max_llc_misses]->pid,
+                           busy_socket.cpuid_max_llc_misses,
+                           apps_sorted[idle_socket.appid_min_llc_misses]->pid);
             }
         }
 
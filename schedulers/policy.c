@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include "policy.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "nupoco.h"
+#include "sam.h"
+
+#define SAM_POLICY(fn, variant)                                                                 \
+static void                                                                                     \
+fn(const int                   num_apps,                                                        \
+   struct appinfo             *apps_sorted[],                                                   \
+   const int                   range_ends[N_METRICS],                                           \
+   const struct cpuinfo *const cpuinfo,                                                         \
+   const size_t                rem_cpus_sz,                                                     \
+   int                         initial_remaining_cpus,                                          \
+   int                         fair_share,                                                      \
+   const int                   num_counter_orders,                                              \
+   const enum metric           counter_order[],                                                 \
+   int                        *per_app_socket_orders[],                                         \
+   cpu_set_t                  *new_cpusets[],                                                   \
+   cpu_set_t                  *remaining_cpus)                                                  \
+{                                                                                               \
+    sam_allocate(variant, num_apps, apps_sorted, range_ends, cpuinfo, rem_cpus_sz,              \
+                 initial_remaining_cpus, fair_share, num_counter_orders, counter_order,         \
+                 per_app_socket_orders, new_cpusets, remaining_cpus);                           \
+}
+
+SAM_POLICY(allocate_sam_default, SAM_VARIANT_DEFAULT)
+SAM_POLICY(allocate_sam_fair, SAM_VARIANT_FAIR)
+SAM_POLICY(allocate_sam_hillclimb, SAM_VARIANT_HILLCLIMB)
+
+static void
+allocate_nupoco(const int                   num_apps,
+                struct appinfo             *apps_sorted[],
+                const int                   range_ends[N_METRICS],
+                const struct cpuinfo *const cpuinfo,
+                const size_t                rem_cpus_sz,
+                int                         initial_remaining_cpus,
+                int                         fair_share,
+                const int                   num_counter_orders,
+                const enum metric           counter_order[],
+                int                        *per_app_socket_orders[],
+                cpu_set_t                  *new_cpusets[],
+                cpu_set_t                  *remaining_cpus)
+{
+    /* NuPoCo keeps its own phases instead of following the bottlenecks */
+    (void) range_ends;
+    (void) initial_remaining_cpus;
+    (void) fair_share;
+    (void) num_counter_orders;
+    (void) counter_order;
+
+    nupoco_allocate(num_apps, apps_sorted, cpuinfo, rem_cpus_sz, per_app_socket_orders, new_cpusets, remaining_cpus);
+}
+
+const struct policy policies[] = {
+    { "default",   true,  allocate_sam_default,   NULL },
+    { "fair",      false, allocate_sam_fair,      NULL },
+    { "hillclimb", false, allocate_sam_hillclimb, NULL },
+    { "nupoco",    true,  allocate_nupoco,        nupoco_set_profiling },
+    { "perfmon",   true,  NULL,                   NULL },
+};
+
+const int num_policies = sizeof policies / sizeof policies[0];
+
+const struct policy *policy_find(const char *name)
+{
+    for (int i = 0; i < num_policies; ++i)
+        if (strcmp(policies[i].name, name) == 0)
+            return &policies[i];
+    return NULL;
+}
+
+void policy_group_apps(const struct policy *p,
+                       struct appinfo      *apps[],
+                       int                  num_apps,
+                       int                  num_counter_orders,
+                       const enum metric    counter_order[],
+                       struct appinfo      *apps_sorted[],
+                       int                  range_ends[N_METRICS + 1])
+{
+    range_ends[0] = 0;
+    for (int i = 0; i < N_METRICS; ++i) {
+        range_ends[i + 1] = range_ends[i];
+        for (int j = 0; j < num_apps; ++j) {
+            /* whatever is left over goes in the last group */
+            bool last = i == N_METRICS - 1;
+
+            if (apps[j] &&
+                (last ||
+                 (p->by_bottleneck
+                  ? i >= num_counter_orders || apps[j]->bottleneck[counter_order[i]] > SAM_MIN_THREADS
+                  : counter_order[i] == METRIC_AVGIPC))) {
+                apps_sorted[range_ends[i + 1]++] = apps[j];
+                apps[j] = NULL;
+            }
+        }
+
+        /*
+         * We sort the apps that have bottlenecks. For the remaining apps
+         * (i >= num_counter_orders), we do not sort them.
+         */
+        if (i < num_counter_orders) {
+            int met = counter_order[i];
+            qsort_r(&apps_sorted[range_ends[i]], range_ends[i + 1] - range_ends[i], sizeof *apps_sorted,
+                    &compare_apps_by_metric_desc, (void *)&met);
+        }
+    }
+}
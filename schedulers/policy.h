@@ -0,0 +1,81 @@
+#ifndef POLICY_SCHEDULER_H
+#define POLICY_SCHEDULER_H
+
+#include <stdbool.h>
+
+#include "../cpuinfo.h"
+#include "../mapper.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * An allocation policy. The daemon runs one at a time, chosen with -P and
+ * changed at run time through the control socket; applications keep their
+ * state (performance history, allocations) across a change.
+ */
+struct policy {
+    /* the name it is chosen by */
+    const char *name;
+    /*
+     * Whether applications are grouped by their bottlenecks, in counter
+     * order, before allocating. Otherwise they are only grouped by whether
+     * they are bound by IPC.
+     */
+    bool by_bottleneck;
+    /*
+     * Fill in new_cpusets[] for @apps_sorted, which are grouped as in
+     * @range_ends. NULL for a policy that only monitors.
+     */
+    void (*allocate)(const int                   num_apps,
+                     struct appinfo             *apps_sorted[],
+                     const int                   range_ends[N_METRICS],
+                     const struct cpuinfo *const cpuinfo,
+                     const size_t                rem_cpus_sz,
+                     int                         initial_remaining_cpus,
+                     int                         fair_share,
+                     const int                   num_counter_orders,
+                     const enum metric           counter_order[],
+                     int                        *per_app_socket_orders[],
+                     cpu_set_t                  *new_cpusets[],
+                     cpu_set_t                  *remaining_cpus);
+    /*
+     * Called when the policy is chosen and whenever an application exits,
+     * to start over with the applications that are left. May be NULL.
+     */
+    void (*reset)(void);
+};
+
+/* every policy, the default first */
+extern const struct policy policies[];
+extern const int num_policies;
+
+/**
+ * Returns the policy called @name, or NULL if there is none.
+ */
+const struct policy *policy_find(const char *name);
+
+/**
+ * Arrange the @num_apps applications in @apps into @apps_sorted, for policy
+ * @p, which look like:
+ *
+ *   [ apps sorted by bottleneck 1 | apps sorted by bottleneck 2 | ... | remaining ]
+ *
+ * where group i ends at @range_ends[i + 1], and the applications with
+ * bottleneck @counter_order[i] are sorted by it. Every entry of @apps is set
+ * to NULL as it is taken.
+ */
+void policy_group_apps(const struct policy *p,
+                       struct appinfo      *apps[],
+                       int                  num_apps,
+                       int                  num_counter_orders,
+                       const enum metric    counter_order[],
+                       struct appinfo      *apps_sorted[],
+                       int                  range_ends[N_METRICS + 1]);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif /* POLICY_SCHEDULER_H */
@@ -1,10 +1,14 @@
 #define _GNU_SOURCE
 #include "sam.h"
+#include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../budgets.h"
+#include "../log.h"
+#include "../tunables.h"
 #include "../util.h"
 
 static int compare_ints_mapped(const void *arg1, const void *arg2, void *ptr)
@@ -13,8 +17,117 @@ static int compare_ints_mapped(const void *arg1, const void *arg2, void *ptr)
   return map[*(const int *)arg1] > map[*(const int *)arg2];
 }
 
+/**
+ * Decide which of the @num_apps applications, on @num_cpus CPUs, share
+ * CPUs instead of getting tunables.sam_min_contexts or more of their own:
+ * those that used fewer than tunables.sam_share_below CPUs over the last
+ * window and, for as long as the others do not fit, those that used the
+ * fewest. The shared ones
+ * get quotas of what they used, with headroom, and weights to match;
+ * those that had to give up CPUs of their own get no quota.
+ *
+ * Sets @shared[j] for each application that shares, and returns the number
+ * of CPUs they share, or 0 if none does.
+ */
+static int share_cpus(const int                   num_apps,
+                      struct appinfo             *apps_sorted[],
+                      const int                   num_cpus,
+                      bool                        shared[])
+{
+    bool *squeezed = calloc(num_apps, sizeof *squeezed);
+    int num_own = num_apps, num_shared = 0, num_squeezed = 0;
+    double quotas = 0;
+    int pool;
+
+    for (int j = 0; j < num_apps; ++j) {
+        const double used = apps_sorted[j]->extra_metric[EXTRA_METRIC_CPU_MILLI] / 1000.0;
+
+        apps_sorted[j]->cpu_quota_milli = 0;
+        apps_sorted[j]->cpu_weight = 0;
+        shared[j] = apps_sorted[j]->times_allocated > 0 && used < tunables.sam_share_below;
+        if (shared[j]) {
+            num_own--;
+            num_shared++;
+        }
+    }
+
+    /* the shared CPUs are at least one */
+    while (num_own > 0 && num_own * tunables.sam_min_contexts + (num_shared > 0) > num_cpus) {
+        int least = -1;
+
+        for (int j = 0; j < num_apps; ++j)
+            if (!shared[j] && (least < 0 || apps_sorted[j]->extra_metric[EXTRA_METRIC_CPU_MILLI] <
+                                            apps_sorted[least]->extra_metric[EXTRA_METRIC_CPU_MILLI]))
+                least = j;
+        shared[least] = squeezed[least] = true;
+        num_own--;
+        num_shared++;
+        num_squeezed++;
+    }
+
+    if (num_shared == 0) {
+        free(squeezed);
+        return 0;
+    }
+
+    for (int j = 0; j < num_apps; ++j)
+        if (shared[j] && !squeezed[j])
+            quotas += MAX(apps_sorted[j]->extra_metric[EXTRA_METRIC_CPU_MILLI] / 1000.0 * SAM_SHARE_HEADROOM,
+                          SAM_SHARE_MIN_QUOTA);
+    pool = (int)ceil(quotas) + num_squeezed * tunables.sam_min_contexts;
+    pool = MAX(MIN(pool, num_cpus - num_own * tunables.sam_min_contexts), 1);
+
+    for (int j = 0; j < num_apps; ++j) {
+        struct appinfo *an = apps_sorted[j];
+
+        if (!shared[j])
+            continue;
+        if (squeezed[j]) {
+            an->cpu_quota_milli = 0;
+            an->cpu_weight = 100;
+        } else {
+            const double quota = MIN(MAX(an->extra_metric[EXTRA_METRIC_CPU_MILLI] / 1000.0 * SAM_SHARE_HEADROOM,
+                                         SAM_SHARE_MIN_QUOTA), pool);
+
+            an->cpu_quota_milli = quota * 1000;
+            an->cpu_weight = MAX(MIN((int)(quota * 100), 10000), 1);
+        }
+        log_debug("[APP %6d] shares %d CPUs with a quota of %d/1000 and a weight of %d\n", an->pid, pool,
+                  an->cpu_quota_milli, an->cpu_weight);
+    }
+
+    free(squeezed);
+    return pool;
+}
+
+/**
+ * Take the @n last CPUs of @remaining_cpus into @pool. The same CPUs are
+ * taken every window for as long as nothing else changes, so that the
+ * applications sharing them stay put.
+ */
+static void take_shared_cpus(const struct cpuinfo *const cpuinfo,
+                             const size_t                rem_cpus_sz,
+                             int                         n,
+                             cpu_set_t                  *pool,
+                             cpu_set_t                  *remaining_cpus)
+{
+    CPU_ZERO_S(rem_cpus_sz, pool);
+    for (int s = cpuinfo->num_sockets - 1; s >= 0 && n > 0; --s) {
+        for (int c = cpuinfo->sockets[s].num_cpus - 1; c >= 0 && n > 0; --c) {
+            const int cpu = cpuinfo->sockets[s].cpus[c].tnumber;
+
+            if (CPU_ISSET_S(cpu, rem_cpus_sz, remaining_cpus)) {
+                CPU_SET_S(cpu, rem_cpus_sz, pool);
+                CPU_CLR_S(cpu, rem_cpus_sz, remaining_cpus);
+                n--;
+            }
+        }
+    }
+}
+
 void
-sam_allocate(const int                   num_apps,
+sam_allocate(enum sam_variant            variant,
+             const int                   num_apps,
              struct appinfo             *apps_sorted[],
              const int                   range_ends[N_METRICS],
              const struct cpuinfo *const cpuinfo,
@@ -29,6 +142,31 @@ sam_allocate(const int                   num_apps,
 {
     int *per_app_cpu_budget = calloc(num_apps, sizeof per_app_cpu_budget[0]);
     int *needs_more = calloc(num_apps, sizeof needs_more[0]);
+    bool *shared = calloc(num_apps, sizeof *shared);
+    cpu_set_t *shared_cpus = CPU_ALLOC(cpuinfo->total_cpus);
+    cpu_set_t *held = CPU_ALLOC(cpuinfo->total_cpus);
+    /* the CPUs that may be allocated, which are all in @remaining_cpus to begin with */
+    const int num_cpus = CPU_COUNT_S(rem_cpus_sz, remaining_cpus);
+    const int num_shared_cpus = share_cpus(num_apps, apps_sorted, num_cpus, shared);
+
+    if (num_shared_cpus > 0) {
+        int num_own = 0;
+
+        /* the applications that share hold the same CPUs, so count again what the others hold */
+        initial_remaining_cpus = num_cpus - num_shared_cpus;
+        for (int j = 0; j < num_apps; ++j) {
+            if (!shared[j]) {
+                CPU_AND_S(rem_cpus_sz, held, apps_sorted[j]->cpuset[0], remaining_cpus);
+                initial_remaining_cpus -= CPU_COUNT_S(rem_cpus_sz, held);
+                num_own++;
+            }
+        }
+        initial_remaining_cpus = MAX(initial_remaining_cpus, 0);
+        if (num_own > 0)
+            fair_share = MAX((num_cpus - num_shared_cpus) / num_own, tunables.sam_min_contexts);
+
+        take_shared_cpus(cpuinfo, rem_cpus_sz, num_shared_cpus, shared_cpus, remaining_cpus);
+    }
 
     /*
      * Each application computes its ideal budget.
@@ -37,27 +175,34 @@ sam_allocate(const int                   num_apps,
         for (int j = range_ends[i]; j < range_ends[i + 1]; ++j) {
             const int curr_alloc_len = CPU_COUNT_S(rem_cpus_sz, apps_sorted[j]->cpuset[0]);
 
+            if (shared[j])
+                continue;
+
             //per_app_cpu_budget[j] = MAX((int) apps_sorted[j]->bottleneck[METRIC_ACTIVE], SAM_MIN_CONTEXTS);
             initial_remaining_cpus += curr_alloc_len;
             per_app_cpu_budget[j] = curr_alloc_len;
-#if defined(FAIR)
-            sam_policy_fair(j, apps_sorted, per_app_cpu_budget, fair_share);
-#elif defined(HILL_CLIMBING)
-            sam_policy_hillclimb(j, apps_sorted, per_app_cpu_budget,
-                    fair_share, curr_alloc_len, rem_cpus_sz, cpuinfo, i,
-                    counter_order);
-#else
-            sam_policy_default(j, apps_sorted, per_app_cpu_budget,
-                    fair_share, curr_alloc_len, rem_cpus_sz, cpuinfo, i,
-                    counter_order);
-#endif
+            switch (variant) {
+            case SAM_VARIANT_FAIR:
+                sam_policy_fair(j, apps_sorted, per_app_cpu_budget, fair_share);
+                break;
+            case SAM_VARIANT_HILLCLIMB:
+                sam_policy_hillclimb(j, apps_sorted, per_app_cpu_budget,
+                        fair_share, curr_alloc_len, rem_cpus_sz, cpuinfo, i,
+                        counter_order);
+                break;
+            default:
+                sam_policy_default(j, apps_sorted, per_app_cpu_budget,
+                        fair_share, curr_alloc_len, rem_cpus_sz, cpuinfo, i,
+                        counter_order);
+                break;
+            }
             /* this really shouldn't be necessary, but it is for some reason
              * I can't explain at the moment
              */
-            per_app_cpu_budget[j] = MAX(MIN(per_app_cpu_budget[j], cpuinfo->total_cpus), SAM_MIN_CONTEXTS);
-            printf("[APP %6d] requiring %d / %d remaining CPUs\n", apps_sorted[j]->pid, per_app_cpu_budget[j],
-                    initial_remaining_cpus);
-            printf("[APP %6d] current allocation is %d\n", apps_sorted[j]->pid, curr_alloc_len);
+            per_app_cpu_budget[j] = MAX(MIN(per_app_cpu_budget[j], num_cpus), tunables.sam_min_contexts);
+            log_debug("[APP %6d] requiring %d / %d remaining CPUs\n", apps_sorted[j]->pid, per_app_cpu_budget[j],
+                       initial_remaining_cpus);
+            log_debug("[APP %6d] current allocation is %d\n", apps_sorted[j]->pid, curr_alloc_len);
             int diff = initial_remaining_cpus - per_app_cpu_budget[j];
             needs_more[j] = MAX(-diff, 0);
             initial_remaining_cpus = MAX(diff, 0);
@@ -70,6 +215,9 @@ sam_allocate(const int                   num_apps,
      */
     for (int i = 0; i < N_METRICS; ++i) {
         for (int j = range_ends[i]; j < range_ends[i + 1]; ++j) {
+            if (shared[j])
+                continue;
+
             /*
              * Make sure we have enough CPUs to give the budget.
              */
@@ -78,7 +226,7 @@ sam_allocate(const int                   num_apps,
                 initial_remaining_cpus -= added;
                 needs_more[j] -= added;
                 per_app_cpu_budget[j] += added;
-                printf("[APP %6d] took %d from remaining CPUs\n", apps_sorted[j]->pid, added);
+                log_debug("[APP %6d] took %d from remaining CPUs\n", apps_sorted[j]->pid, added);
             }
 
             if (needs_more[j] > 0) {
@@ -90,13 +238,13 @@ sam_allocate(const int                   num_apps,
                 int *spare_candidates_map = calloc(num_apps, sizeof *spare_candidates_map);
                 int num_spare_candidates = 0;
 
-                printf("[APP %6d] requests %d more hardware contexts\n", apps_sorted[j]->pid, needs_more[j]);
+                log_debug("[APP %6d] requests %d more hardware contexts\n", apps_sorted[j]->pid, needs_more[j]);
 
                 /*
                  * Find the least efficient application to steal CPUs from.
                  */
                 for (int l = 0; l < num_apps; ++l) {
-                    if (l == j)
+                    if (l == j || shared[l])
                         continue;
 
                     int curr_alloc_len_l = CPU_COUNT_S(rem_cpus_sz, apps_sorted[l]->cpuset[0]);
@@ -142,7 +290,7 @@ sam_allocate(const int                   num_apps,
                     for (int l = num_spare_candidates - 1; l >= 0 && needs_more[j] > 0; --l) {
                         int m = spare_candidates_map[spare_candidates[l]->appno];
 
-                        for (int n = 0; n < spare_cores[m] && per_app_cpu_budget[m] > SAM_MIN_CONTEXTS && needs_more[j] > 0;
+                        for (int n = 0; n < spare_cores[m] && per_app_cpu_budget[m] > tunables.sam_min_contexts && needs_more[j] > 0;
                                 ++n) {
                             per_app_cpu_budget[m]--;
                             per_app_cpu_budget[j]++;
@@ -155,14 +303,14 @@ sam_allocate(const int                   num_apps,
                      * If there were no candidates with spares, take from other applications,
                      * but only if we really need to.
                      */
-                    if (per_app_cpu_budget[j] < SAM_MIN_CONTEXTS || apps_sorted[j]->times_allocated < 1) {
+                    if (per_app_cpu_budget[j] < tunables.sam_min_contexts || apps_sorted[j]->times_allocated < 1) {
                         int old_cpu_budget_j;
                         do {
                             old_cpu_budget_j = per_app_cpu_budget[j];
                             for (int l = num_candidates - 1; l >= 0 && needs_more[j] > 0; --l) {
                                 int m = candidates_map[candidates[l]->appno];
 
-                                if (per_app_cpu_budget[m] > SAM_MIN_CONTEXTS) {
+                                if (per_app_cpu_budget[m] > tunables.sam_min_contexts) {
                                     per_app_cpu_budget[m]--;
                                     per_app_cpu_budget[j]++;
                                     needs_more[j]--;
@@ -174,19 +322,19 @@ sam_allocate(const int                   num_apps,
 
                     for (int l = 0; l < num_apps; ++l) {
                         if (amt_taken[l] > 0)
-                            printf("[APP %6d] took %d contexts from APP %6d\n", apps_sorted[j]->pid, amt_taken[l],
-                                    apps_sorted[l]->pid);
+                            log_debug("[APP %6d] took %d contexts from APP %6d\n", apps_sorted[j]->pid, amt_taken[l],
+                                       apps_sorted[l]->pid);
                     }
 
                     free(amt_taken);
                 }
 
                 if (needs_more[j] > 0)
-                    printf("[APP %6d] could not find %d extra contexts\n", apps_sorted[j]->pid, needs_more[j]);
+                    log_debug("[APP %6d] could not find %d extra contexts\n", apps_sorted[j]->pid, needs_more[j]);
 
-                if (per_app_cpu_budget[j] < SAM_MIN_CONTEXTS) {
-                    fprintf(stderr, "%s:%d: APP %6d: per_app_cpu_budget[%d] (%d) < %d (SAM_MIN_CONTEXTS) !\n", __FILE__,
-                            __LINE__, apps_sorted[j]->pid, j, per_app_cpu_budget[j], SAM_MIN_CONTEXTS);
+                if (per_app_cpu_budget[j] < tunables.sam_min_contexts) {
+                    fprintf(stderr, "%s:%d: APP %6d: per_app_cpu_budget[%d] (%d) < %d (sam_min_contexts) !\n", __FILE__,
+                            __LINE__, apps_sorted[j]->pid, j, per_app_cpu_budget[j], tunables.sam_min_contexts);
                     abort();
                 }
 
@@ -197,9 +345,9 @@ sam_allocate(const int                   num_apps,
                 free(spare_candidates_map);
             }
 
-            if (per_app_cpu_budget[j] < SAM_MIN_CONTEXTS) {
-                fprintf(stderr, "%s:%d: APP %6d: per_app_cpu_budget[%d] (%d) < %d (SAM_MIN_CONTEXTS) !\n", __FILE__,
-                        __LINE__, apps_sorted[j]->pid, j, per_app_cpu_budget[j], SAM_MIN_CONTEXTS);
+            if (per_app_cpu_budget[j] < tunables.sam_min_contexts) {
+                fprintf(stderr, "%s:%d: APP %6d: per_app_cpu_budget[%d] (%d) < %d (sam_min_contexts) !\n", __FILE__,
+                        __LINE__, apps_sorted[j]->pid, j, per_app_cpu_budget[j], tunables.sam_min_contexts);
                 abort();
             }
 
@@ -246,11 +394,14 @@ sam_allocate(const int                   num_apps,
 
             memcpy(per_app_socket_orders[j], temp, cpuinfo->num_sockets * sizeof *per_app_socket_orders[j]);
 
-            printf("[APP %6d] score:  ", apps_sorted[j]->pid);
-            for (int s = 0; s < cpuinfo->num_sockets; ++s) {
-                printf(" %d ", per_app_socket_orders[j][s]);
+            if (log_enabled(LOG_LEVEL_DEBUG)) {
+                char score[256];
+                size_t len = 0;
+
+                for (int s = 0; s < cpuinfo->num_sockets && len < sizeof score; ++s)
+                    len += snprintf(score + len, sizeof score - len, " %d ", per_app_socket_orders[j][s]);
+                log_debug("[APP %6d] score:  %s\n", apps_sorted[j]->pid, score);
             }
-            printf("\n");
         }
     }
 
@@ -264,6 +415,14 @@ sam_allocate(const int                   num_apps,
             new_cpuset = CPU_ALLOC(cpuinfo->total_cpus);
             CPU_ZERO_S(rem_cpus_sz, new_cpuset);
 
+            if (shared[j]) {
+                /* already taken out of [remaining_cpus] */
+                memcpy(new_cpuset, shared_cpus, rem_cpus_sz);
+                per_app_cpu_budget[j] = num_shared_cpus;
+                new_cpusets[j] = new_cpuset;
+                continue;
+            }
+
             if (i < num_counter_orders) {
                 int met = counter_order[i];
 
@@ -292,4 +451,7 @@ sam_allocate(const int                   num_apps,
 
     free(per_app_cpu_budget);
     free(needs_more);
+    free(shared);
+    CPU_FREE(shared_cpus);
+    CPU_FREE(held);
 }
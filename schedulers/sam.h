@@ -33,6 +33,15 @@ static inline int guess_optimization(const int cpus_per_socket, const int budget
   return f * SAM_PERF_STEP;
 }
 
+/**
+ * How sam_allocate() decides each application's ideal budget.
+ */
+enum sam_variant {
+  SAM_VARIANT_DEFAULT,
+  SAM_VARIANT_FAIR,
+  SAM_VARIANT_HILLCLIMB,
+};
+
 /**
  * SAM-MAP fair share variant
  */
@@ -74,7 +83,8 @@ sam_policy_default(const int                 j,
  * The main procedure for the SAM-MAP scheduler.
  */
 void
-sam_allocate(const int                   num_apps,
+sam_allocate(enum sam_variant            variant,
+             const int                   num_apps,
              struct appinfo             *apps_sorted[],
              const int                   range_ends[N_METRICS],
              const struct cpuinfo *const cpuinfo,
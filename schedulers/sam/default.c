@@ -5,6 +5,8 @@
 #include <sched.h>
 #include <stdlib.h>
 
+#include "../../log.h"
+#include "../../tunables.h"
 #include "../../util.h"
 
 static inline int determine_step_size(const int cpus_per_socket, enum metric bottleneck, int curr_alloc, int dir)
@@ -72,21 +74,21 @@ sam_policy_default(const int                j,
              * Original decision making:
              * Change requested resources.
              */
-            if (curr_perf > prev_perf && (curr_perf - prev_perf) / (double)prev_perf >= SAM_PERF_THRESH &&
+            if (curr_perf > prev_perf && (curr_perf - prev_perf) / (double)prev_perf >= tunables.sam_perf_thresh &&
                     apps_sorted[j]->exploring && (prev_alloc_len != curr_alloc_len)) {
                 /* Keep going in the same direction. */
-                printf("[APP %6d] continuing in same direction \n", apps_sorted[j]->pid);
+                log_debug("[APP %6d] continuing in same direction \n", apps_sorted[j]->pid);
                 if (prev_alloc_len < curr_alloc_len)
                     per_app_cpu_budget[j] =
                         MIN(per_app_cpu_budget[j] + determine_step_size(cpus_per_socket, counter_order[i], curr_alloc_len, 1),
                                 cpuinfo->total_cpus);
                 else
                     per_app_cpu_budget[j] = MAX(
-                            per_app_cpu_budget[j] - determine_step_size(cpus_per_socket, counter_order[i], curr_alloc_len, -1), SAM_MIN_CONTEXTS);
+                            per_app_cpu_budget[j] - determine_step_size(cpus_per_socket, counter_order[i], curr_alloc_len, -1), tunables.sam_min_contexts);
                 if (prev_alloc_len == 0 && per_app_cpu_budget[j] == cpuinfo->total_cpus)
                     apps_sorted[j]->exploring = false;
             } else {
-                if (curr_perf < prev_perf && (prev_perf - curr_perf) / (double)prev_perf >= SAM_PERF_THRESH &&
+                if (curr_perf < prev_perf && (prev_perf - curr_perf) / (double)prev_perf >= tunables.sam_perf_thresh &&
                         (prev_alloc_len != curr_alloc_len)) {
                     if (apps_sorted[j]->exploring) {
                         /*
@@ -95,21 +97,21 @@ sam_policy_default(const int                j,
                         per_app_cpu_budget[j] = prev_alloc_len;
                     } else {
                         int guess = per_app_cpu_budget[j] + guess_optimization(cpus_per_socket, per_app_cpu_budget[j], counter_order[i]);
-                        guess = MAX(MIN(guess, cpuinfo->total_cpus), SAM_MIN_CONTEXTS);
+                        guess = MAX(MIN(guess, cpuinfo->total_cpus), tunables.sam_min_contexts);
                         apps_sorted[j]->exploring = true;
                         per_app_cpu_budget[j] = guess;
                     }
-                    printf("[APP %6d] exploring %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len, per_app_cpu_budget[j]);
+                    log_debug("[APP %6d] exploring %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len, per_app_cpu_budget[j]);
                 } else {
                     apps_sorted[j]->exploring = false;
-                    printf("[APP %6d] exploring no more \n", apps_sorted[j]->pid);
-                    if (random() / (double)RAND_MAX <= SAM_DISTURB_PROB) {
+                    log_debug("[APP %6d] exploring no more \n", apps_sorted[j]->pid);
+                    if (random() / (double)RAND_MAX <= tunables.sam_disturb_prob) {
                         int guess = per_app_cpu_budget[j] + guess_optimization(cpus_per_socket, per_app_cpu_budget[j], counter_order[i]);
-                        guess = MAX(MIN(guess, cpuinfo->total_cpus), SAM_MIN_CONTEXTS);
+                        guess = MAX(MIN(guess, cpuinfo->total_cpus), tunables.sam_min_contexts);
                         apps_sorted[j]->exploring = true;
                         per_app_cpu_budget[j] = guess;
-                        printf("[APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
-                                per_app_cpu_budget[j]);
+                        log_debug("[APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
+                                   per_app_cpu_budget[j]);
                     }
                 }
             }
@@ -117,16 +119,16 @@ sam_policy_default(const int                j,
             /* save performance history */
             memcpy(apps_sorted[j]->perf_history[curr_alloc_len], history,
                     sizeof apps_sorted[j]->perf_history[curr_alloc_len]);
-        } else if (!apps_sorted[j]->exploring && random() / (double)RAND_MAX <= SAM_DISTURB_PROB) {
+        } else if (!apps_sorted[j]->exploring && random() / (double)RAND_MAX <= tunables.sam_disturb_prob) {
             /*
              * Introduce random disturbances.
              */
             int guess = per_app_cpu_budget[j] + guess_optimization(cpus_per_socket, per_app_cpu_budget[j], counter_order[i]);
-            guess = MAX(MIN(guess, cpuinfo->total_cpus), SAM_MIN_CONTEXTS);
+            guess = MAX(MIN(guess, cpuinfo->total_cpus), tunables.sam_min_contexts);
             apps_sorted[j]->exploring = true;
             per_app_cpu_budget[j] = guess;
-            printf("[APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
-                    per_app_cpu_budget[j]);
+            log_debug("[APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
+                       per_app_cpu_budget[j]);
         }
     } else {
         /*
@@ -134,6 +136,6 @@ sam_policy_default(const int                j,
          * give it is the fair share.
          */
         per_app_cpu_budget[j] = fair_share;
-        printf("[APP %6d] setting fair share \n", apps_sorted[j]->pid);
+        log_debug("[APP %6d] setting fair share \n", apps_sorted[j]->pid);
     }
 }
@@ -5,6 +5,8 @@
 #include <sched.h>
 #include <stdlib.h>
 
+#include "../../log.h"
+#include "../../tunables.h"
 #include "../../util.h"
 
 void
@@ -48,58 +50,58 @@ sam_policy_hillclimb(const int              j,
 
             /* Original decision making:
              * Change requested resources. */
-            if (curr_perf > prev_perf && (curr_perf - prev_perf) / (double)prev_perf >= SAM_PERF_THRESH &&
+            if (curr_perf > prev_perf && (curr_perf - prev_perf) / (double)prev_perf >= tunables.sam_perf_thresh &&
                     apps_sorted[j]->exploring) {
                 /* Keep going in the same direction. */
-                printf("HILL CLIMBING [APP %6d] continuing in same direction \n", apps_sorted[j]->pid);
+                log_debug("HILL CLIMBING [APP %6d] continuing in same direction \n", apps_sorted[j]->pid);
                 if (prev_alloc_len < curr_alloc_len)
                     per_app_cpu_budget[j] = MIN(per_app_cpu_budget[j] + SAM_PERF_STEP, cpuinfo->total_cpus);
                 else
-                    per_app_cpu_budget[j] = MAX(per_app_cpu_budget[j] - SAM_PERF_STEP, SAM_MIN_CONTEXTS);
+                    per_app_cpu_budget[j] = MAX(per_app_cpu_budget[j] - SAM_PERF_STEP, tunables.sam_min_contexts);
             } else {
-                if (curr_perf < prev_perf && (prev_perf - curr_perf) / (double)prev_perf >= SAM_PERF_THRESH) {
+                if (curr_perf < prev_perf && (prev_perf - curr_perf) / (double)prev_perf >= tunables.sam_perf_thresh) {
                     if (apps_sorted[j]->exploring) {
                         /* Revert to previous count if performance reduction was great enough.
                         */
                         per_app_cpu_budget[j] = prev_alloc_len;
                     } else {
                         int guess = per_app_cpu_budget[j] + guess_optimization(cpus_per_socket, per_app_cpu_budget[j], counter_order[i]);
-                        guess = MAX(MIN(guess, cpuinfo->total_cpus), SAM_MIN_CONTEXTS);
+                        guess = MAX(MIN(guess, cpuinfo->total_cpus), tunables.sam_min_contexts);
                         apps_sorted[j]->exploring = true;
                         per_app_cpu_budget[j] = guess;
                     }
-                    printf("HILL CLIMBING [APP %6d] exploring %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
-                            per_app_cpu_budget[j]);
+                    log_debug("HILL CLIMBING [APP %6d] exploring %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
+                               per_app_cpu_budget[j]);
                 } else {
                     apps_sorted[j]->exploring = false;
-                    printf("HILL CLIMBING [APP %6d] exploring no more \n", apps_sorted[j]->pid);
-                    if (random() / (double)RAND_MAX <= SAM_DISTURB_PROB) {
+                    log_debug("HILL CLIMBING [APP %6d] exploring no more \n", apps_sorted[j]->pid);
+                    if (random() / (double)RAND_MAX <= tunables.sam_disturb_prob) {
                         int guess = per_app_cpu_budget[j] + guess_optimization(cpus_per_socket, per_app_cpu_budget[j], counter_order[i]);
-                        guess = MAX(MIN(guess, cpuinfo->total_cpus), SAM_MIN_CONTEXTS);
+                        guess = MAX(MIN(guess, cpuinfo->total_cpus), tunables.sam_min_contexts);
                         apps_sorted[j]->exploring = true;
                         per_app_cpu_budget[j] = guess;
-                        printf("HILL CLIMBING [APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid,
-                                curr_alloc_len, per_app_cpu_budget[j]);
+                        log_debug("HILL CLIMBING [APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid,
+                                   curr_alloc_len, per_app_cpu_budget[j]);
                     }
                 }
             }
             /* save performance history */
             memcpy(apps_sorted[j]->perf_history[curr_alloc_len], history,
                     sizeof apps_sorted[j]->perf_history[curr_alloc_len]);
-        } else if (!apps_sorted[j]->exploring && random() / (double)RAND_MAX <= SAM_DISTURB_PROB) {
+        } else if (!apps_sorted[j]->exploring && random() / (double)RAND_MAX <= tunables.sam_disturb_prob) {
             /* Introduce random disturbances. */
             int guess = per_app_cpu_budget[j] + guess_optimization(cpus_per_socket, per_app_cpu_budget[j], counter_order[i]);
-            guess = MAX(MIN(guess, cpuinfo->total_cpus), SAM_MIN_CONTEXTS);
+            guess = MAX(MIN(guess, cpuinfo->total_cpus), tunables.sam_min_contexts);
             apps_sorted[j]->exploring = true;
             per_app_cpu_budget[j] = guess;
-            printf("HILL CLIMBING [APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
-                    per_app_cpu_budget[j]);
+            log_debug("HILL CLIMBING [APP %6d] random disturbance: %d -> %d\n", apps_sorted[j]->pid, curr_alloc_len,
+                       per_app_cpu_budget[j]);
         }
     } else {
         /* If this app has never been given an allocation, the first allocation we should
          * give it is the fair share.  */
 
         per_app_cpu_budget[j] = fair_share;
-        printf("HILL CLIMBING [APP %6d] setting fair share \n", apps_sorted[j]->pid);
+        log_debug("HILL CLIMBING [APP %6d] setting fair share \n", apps_sorted[j]->pid);
     }
 }
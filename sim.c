@@ -0,0 +1,642 @@
+/*
+ * sam-sim: a discrete-event simulator for the allocation policies.
+ *
+ * It runs the real policy code (see schedulers/policy.h) on a synthetic
+ * machine, made with make_cpuinfo(), and a mix of synthetic applications,
+ * without counters, cgroups or privileges. Virtual time advances a window at
+ * a time. In each window every application makes progress according to a
+ * model of its CPUs, the counters the policy would have seen are derived
+ * from that, and the policy's allocation is applied for the next window.
+ *
+ * The application model:
+ *   - it runs @threads threads, and speeds up with the cores it gets
+ *     following Amdahl's law with serial fraction @serial;
+ *   - a second hardware thread on a core adds @smt_yield of a core;
+ *   - a memory-bound application is limited by the bandwidth of each socket
+ *     it runs on, which it shares with the other memory-bound applications
+ *     there, in proportion to their CPUs on the socket;
+ *   - a communicating application slows down by @spread_penalty for each
+ *     socket beyond the first, and shows an inter-socket bottleneck when
+ *     spread and an intra-socket one when not.
+ *
+ * An application with no CPUs allocated yet (as when samd first sees it)
+ * shares the CPUs that nobody was given with the others in the same state.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpuinfo.h"
+#include "log.h"
+#include "mapper.h"
+#include "reconfig.h"
+#include "tunables.h"
+#include "util.h"
+#include "schedulers/policy.h"
+
+/* instructions per second of one core running alone */
+#define CORE_IPS            2e9
+/* the cores' worth of memory bandwidth that a socket has */
+#define SOCKET_BANDWIDTH    8.0
+/* cpuset churn at or below this fraction of the CPUs counts as settled */
+#define SETTLED_CHURN       0.01
+#define SETTLED_WINDOWS     10
+
+/* the budgeters look up the machine here */
+struct cpuinfo *cpuinfo;
+/* the socket and core of each CPU */
+static int *cpu_socket;
+static int *cpu_core;
+
+enum app_class {
+    CLASS_COMPUTE,
+    CLASS_MEMORY,
+    CLASS_COMMUNICATING,
+    N_CLASSES,
+};
+
+static const char *class_names[N_CLASSES] = { "compute", "memory", "communicating" };
+
+struct sim_app {
+    /* what the policy sees */
+    struct appinfo info;
+    enum app_class class;
+    int threads;
+    double serial;
+    double smt_yield;
+    double spread_penalty;
+    /* instructions left to run */
+    double work;
+    /* in virtual seconds */
+    double arrival;
+    double finish;
+    bool running;
+    bool done;
+    /* the sum of this application's speedup over fair share, per window */
+    double relative_sum;
+    int windows;
+};
+
+/*
+ * An allocation that takes longer than max_call_secs of CPU time stops the
+ * simulation: NuPoCo's greedy phase takes seconds a window from about 50
+ * applications on 8x128 CPUs, and hours with hundreds. SIGPROF cuts the
+ * call short, so the message is made before it starts.
+ */
+static double max_call_secs = 1;
+static char too_slow_msg[256];
+
+static void on_too_slow(int sig)
+{
+    ssize_t written = write(STDOUT_FILENO, too_slow_msg, strlen(too_slow_msg));
+
+    (void)sig;
+    (void)written;
+    _exit(2);
+}
+
+static void arm_call_limit(double secs)
+{
+    struct itimerval it = { { 0, 0 }, { (time_t)secs, (suseconds_t)((secs - (time_t)secs) * 1e6) } };
+
+    setitimer(ITIMER_PROF, &it, NULL);
+}
+
+/* a random number in [0, 1), from the model's own generator */
+static double uniform(unsigned int *seed)
+{
+    return rand_r(seed) / ((double)RAND_MAX + 1);
+}
+
+static double amdahl(double serial, double cores)
+{
+    return cores > 0 ? 1 / (serial + (1 - serial) / cores) : 0;
+}
+
+/**
+ * The speedup, over one core, of @app on the @n CPUs in @cpus. @mem_share is
+ * the share of each socket's memory bandwidth it gets, for a memory-bound
+ * application.
+ */
+static double app_speedup(const struct sim_app *app, const int cpus[], int n, const double mem_share[])
+{
+    bool *core_used = calloc(cpuinfo->total_cores, sizeof *core_used);
+    int sockets_used = 0;
+    int used = MIN(n, app->threads);
+    int cores = 0;
+    double speedup, bandwidth = 0;
+
+    for (int i = 0; i < used; ++i) {
+        if (!core_used[cpu_core[cpus[i]]]) {
+            core_used[cpu_core[cpus[i]]] = true;
+            cores++;
+        }
+    }
+    for (int s = 0; s < cpuinfo->num_sockets; ++s) {
+        if (mem_share[s] > 0) {
+            sockets_used++;
+            bandwidth += SOCKET_BANDWIDTH * mem_share[s];
+        }
+    }
+    free(core_used);
+
+    speedup = amdahl(app->serial, cores + app->smt_yield * (used - cores));
+    if (app->class == CLASS_MEMORY && speedup > bandwidth)
+        speedup = bandwidth;
+    if (app->class == CLASS_COMMUNICATING && sockets_used > 1)
+        speedup /= 1 + app->spread_penalty * (sockets_used - 1);
+    return speedup;
+}
+
+/* Jain's fairness index of @n values */
+static double jain(const double x[], int n)
+{
+    double sum = 0, sum_sq = 0;
+
+    for (int i = 0; i < n; ++i) {
+        sum += x[i];
+        sum_sq += x[i] * x[i];
+    }
+    return sum_sq > 0 ? sum * sum / (n * sum_sq) : 1;
+}
+
+static int parse_topology(const char *arg, int *sockets, int *cpus_per_socket, int *cpus_per_core)
+{
+    *cpus_per_core = 2;
+    return sscanf(arg, "%dx%dx%d", sockets, cpus_per_socket, cpus_per_core) >= 2 ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-P policy] [-T SOCKETSxCPUS[xCPUS_PER_CORE]] [-n apps] [-m compute:memory:communicating]\n"
+            "       [-d mean-seconds] [-a arrival-seconds] [-w max-windows] [-x max-seconds-per-call]\n"
+            "       [-c config-file] [-r seed] [-l off|error|warn|info|debug|trace]\n"
+            "Defaults: -x 1\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const struct policy *policy = policy_find("default");
+    int num_sockets = 2, cpus_per_socket = 20, cpus_per_core = 2;
+    int num_sim_apps = 8;
+    double mix[N_CLASSES] = { 1, 1, 1 };
+    double mean_duration = 60;
+    double arrival_spread = 0;
+    int max_windows = 10000;
+    const char *config_path = NULL;
+    unsigned int seed = 1;
+    struct sim_app *apps;
+    size_t sz;
+    double now = 0, dt;
+    uint64_t total_churn = 0, total_writes = 0;
+    uint64_t total_steps = 0, total_rounds = 0;
+    int overlap_windows = 0;
+    double sched_cpu_sum = 0, sched_cpu_max = 0;
+    double instructions = 0;
+    double settled_at = -1;
+    int quiet_windows = 0;
+    int num_done = 0;
+    int window;
+    int opt;
+
+    log_set_level(LOG_LEVEL_WARN);
+
+    while ((opt = getopt(argc, argv, "P:T:n:m:d:a:w:x:c:r:l:h")) != -1) {
+        switch (opt) {
+        case 'P':
+            if (!(policy = policy_find(optarg))) {
+                fprintf(stderr, "Unknown policy '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'T':
+            if (parse_topology(optarg, &num_sockets, &cpus_per_socket, &cpus_per_core) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'n':
+            num_sim_apps = atoi(optarg);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%lf:%lf:%lf", &mix[CLASS_COMPUTE], &mix[CLASS_MEMORY], &mix[CLASS_COMMUNICATING]) != 3 ||
+                mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[0] + mix[1] + mix[2] <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'd':
+            mean_duration = atof(optarg);
+            break;
+        case 'a':
+            arrival_spread = atof(optarg);
+            break;
+        case 'w':
+            max_windows = atoi(optarg);
+            break;
+        case 'x':
+            max_call_secs = atof(optarg);
+            if (max_call_secs <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            config_path = optarg;
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'l': {
+            int level = log_level_from_string(optarg);
+
+            if (level < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            log_set_level((enum log_level)level);
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return opt != 'h';
+        }
+    }
+    if (num_sim_apps < 1 || mean_duration <= 0 || arrival_spread < 0 || max_windows < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!(cpuinfo = make_cpuinfo(num_sockets, cpus_per_socket, cpus_per_core, 2000000000UL))) {
+        fprintf(stderr, "Impossible topology %dx%dx%d\n", num_sockets, cpus_per_socket, cpus_per_core);
+        return 1;
+    }
+    cpu_socket = calloc(cpuinfo->total_cpus, sizeof *cpu_socket);
+    cpu_core = calloc(cpuinfo->total_cpus, sizeof *cpu_core);
+    for (int s = 0; s < cpuinfo->num_sockets; ++s) {
+        for (int c = 0; c < cpuinfo->sockets[s].num_cpus; ++c) {
+            cpu_socket[cpuinfo->sockets[s].cpus[c].tnumber] = s;
+            cpu_core[cpuinfo->sockets[s].cpus[c].tnumber] = cpuinfo->sockets[s].cpus[c].core_id;
+        }
+    }
+
+    tunables_default(&tunables, cpuinfo->total_cores);
+    if (config_path && tunables_load(&tunables, config_path, true, cpuinfo->total_cores) != 0)
+        return 1;
+
+    sz = CPU_ALLOC_SIZE(cpuinfo->total_cpus);
+    dt = tunables.window_ms / 1000.0;
+    srandom(seed);
+
+    /* make up the applications */
+    apps = calloc(num_sim_apps, sizeof *apps);
+    for (int i = 0; i < num_sim_apps; ++i) {
+        struct sim_app *app = &apps[i];
+        double pick = uniform(&seed) * (mix[0] + mix[1] + mix[2]);
+        int fair = MAX(cpuinfo->total_cpus / num_sim_apps, 1);
+
+        app->class = pick < mix[0] ? CLASS_COMPUTE : pick < mix[0] + mix[1] ? CLASS_MEMORY : CLASS_COMMUNICATING;
+        app->threads = SAM_MIN_THREADS + 1 + rand_r(&seed) % cpuinfo->sockets[0].num_cpus;
+        app->serial = 0.001 + 0.1 * uniform(&seed);
+        app->smt_yield = 0.1 + 0.4 * uniform(&seed);
+        app->spread_penalty = app->class == CLASS_COMMUNICATING ? 0.2 + 0.8 * uniform(&seed) : 0;
+        app->arrival = arrival_spread * uniform(&seed);
+        app->work = mean_duration * (0.5 + uniform(&seed)) * CORE_IPS * amdahl(app->serial, MIN(fair, app->threads));
+
+        app->info.pid = i + 1;
+        app->info.pidfd = -1;
+        app->info.cpuset[0] = CPU_ALLOC(cpuinfo->total_cpus);
+        app->info.cpuset[1] = CPU_ALLOC(cpuinfo->total_cpus);
+        CPU_ZERO_S(sz, app->info.cpuset[0]);
+        CPU_ZERO_S(sz, app->info.cpuset[1]);
+        app->info.perf_history = (uint64_t(*)[2])calloc(cpuinfo->total_cpus + 1, sizeof *app->info.perf_history);
+    }
+
+    if (policy->reset)
+        policy->reset();
+    signal(SIGPROF, on_too_slow);
+
+    for (window = 0; window < max_windows && num_done < num_sim_apps; ++window, now += dt) {
+        int num_running = 0, num_unallocated = 0;
+        int *owner = calloc(cpuinfo->total_cpus, sizeof *owner);
+        int *shared_by = calloc(cpuinfo->total_cpus, sizeof *shared_by);
+        double *mem_cpus = calloc(cpuinfo->num_sockets, sizeof *mem_cpus);
+        int free_cpus[cpuinfo->total_cpus];
+        int num_free = 0;
+        int fair_share;
+
+        /* arrivals */
+        for (int i = 0; i < num_sim_apps; ++i)
+            if (!apps[i].running && !apps[i].done && apps[i].arrival <= now)
+                apps[i].running = true;
+
+        /* who runs where: the CPUs nobody was given are shared by the rest */
+        for (int i = 0; i < num_sim_apps; ++i) {
+            if (!apps[i].running)
+                continue;
+            num_running++;
+            if (CPU_COUNT_S(sz, apps[i].info.cpuset[0]) == 0)
+                num_unallocated++;
+            for (int c = 0; c < cpuinfo->total_cpus; ++c) {
+                if (CPU_ISSET_S(c, sz, apps[i].info.cpuset[0])) {
+                    owner[c] = i + 1;
+                    if (apps[i].info.cpu_weight > 0)
+                        shared_by[c]++;
+                    if (apps[i].class == CLASS_MEMORY)
+                        mem_cpus[cpu_socket[c]]++;
+                }
+            }
+        }
+        for (int c = 0; c < cpuinfo->total_cpus; ++c)
+            if (!owner[c])
+                free_cpus[num_free++] = c;
+
+        /* run the window */
+        fair_share = num_running > 0 ? MAX(cpuinfo->total_cpus / num_running, 1) : 1;
+        for (int i = 0; i < num_sim_apps; ++i) {
+            struct sim_app *app = &apps[i];
+            int cpus[cpuinfo->total_cpus];
+            double share[cpuinfo->num_sockets];
+            int n = 0, sharers = 1;
+            double speedup, ips;
+
+            if (!app->running)
+                continue;
+
+            memset(share, 0, sizeof share);
+            if (CPU_COUNT_S(sz, app->info.cpuset[0]) > 0) {
+                for (int c = 0; c < cpuinfo->total_cpus; ++c)
+                    if (CPU_ISSET_S(c, sz, app->info.cpuset[0]))
+                        cpus[n++] = c;
+            } else {
+                /* time-shared, so count an equal share of each free CPU */
+                for (int c = 0; c < num_free; ++c)
+                    cpus[n++] = free_cpus[c];
+            }
+            for (int c = 0; c < n; ++c) {
+                int s = cpu_socket[cpus[c]];
+
+                share[s] += mem_cpus[s] > 0 && CPU_COUNT_S(sz, app->info.cpuset[0]) > 0 ? 1 / mem_cpus[s] : 1.0 / n;
+            }
+
+            speedup = app_speedup(app, cpus, n, share);
+            if (CPU_COUNT_S(sz, app->info.cpuset[0]) == 0)
+                sharers = MAX(num_unallocated, 1);
+            /* the policy's shared CPUs are split between the applications on them, up to their quotas */
+            for (int c = 0; c < n && app->info.cpu_weight > 0; ++c)
+                sharers = MAX(sharers, shared_by[cpus[c]]);
+            speedup /= sharers;
+            if (app->info.cpu_quota_milli > 0)
+                speedup = MIN(speedup, app->info.cpu_quota_milli / 1000.0);
+            ips = speedup * CORE_IPS;
+
+            app->relative_sum += speedup / amdahl(app->serial, MIN(fair_share, app->threads));
+            app->windows++;
+            instructions += MIN(ips * dt, app->work);
+            if (ips * dt >= app->work) {
+                app->finish = now + (ips > 0 ? app->work / ips : dt);
+                app->work = 0;
+                app->running = false;
+                app->done = true;
+                num_done++;
+                if (policy->reset)
+                    policy->reset();
+                continue;
+            }
+            app->work -= ips * dt;
+
+            /* what the counters would have shown */
+            memset(app->info.bottleneck, 0, sizeof app->info.bottleneck);
+            memset(app->info.metric, 0, sizeof app->info.metric);
+            app->info.bottleneck[METRIC_ACTIVE] = app->threads;
+            app->info.metric[METRIC_ACTIVE] = app->threads;
+            switch (app->class) {
+            case CLASS_COMPUTE:
+                app->info.bottleneck[METRIC_AVGIPC] = app->threads;
+                app->info.metric[METRIC_AVGIPC] = ips;
+                break;
+            case CLASS_MEMORY:
+                app->info.bottleneck[METRIC_MEM] = app->threads;
+                app->info.metric[METRIC_MEM] = ips / 50;
+                break;
+            case CLASS_COMMUNICATING: {
+                bool spread = false;
+
+                for (int c = 1; c < n; ++c)
+                    spread |= cpu_socket[cpus[c]] != cpu_socket[cpus[0]];
+                app->info.bottleneck[spread ? METRIC_INTER : METRIC_INTRA] = app->threads;
+                app->info.metric[spread ? METRIC_INTER : METRIC_INTRA] = ips / 1000;
+                break;
+            }
+            default:
+                break;
+            }
+            app->info.extra_metric[EXTRA_METRIC_IPS] = ips * (0.98 + 0.04 * uniform(&seed));
+            app->info.extra_metric[EXTRA_METRIC_LLC_MISSES] = app->class == CLASS_MEMORY ? ips / 50 : ips / 5000;
+            app->info.extra_metric[EXTRA_METRIC_DRAM_REQUESTS] = app->info.extra_metric[EXTRA_METRIC_LLC_MISSES];
+            app->info.extra_metric[EXTRA_METRIC_CPU_MILLI] = MIN(n, app->threads) * 1000 / sharers;
+            if (app->info.cpu_quota_milli > 0)
+                app->info.extra_metric[EXTRA_METRIC_CPU_MILLI] =
+                    MIN(app->info.extra_metric[EXTRA_METRIC_CPU_MILLI], (uint64_t)app->info.cpu_quota_milli);
+        }
+        free(owner);
+        free(shared_by);
+        free(mem_cpus);
+
+        /* schedule, as samd's scheduler thread does, and time it */
+        num_running = 0;
+        for (int i = 0; i < num_sim_apps; ++i)
+            num_running += apps[i].running;
+        if (num_running > 0 && policy->allocate) {
+            struct appinfo **apps_unsorted = calloc(num_running, sizeof *apps_unsorted);
+            struct appinfo **apps_sorted = calloc(num_running, sizeof *apps_sorted);
+            cpu_set_t **new_cpusets = calloc(num_running, sizeof *new_cpusets);
+            int **per_app_socket_orders = calloc(num_running, sizeof *per_app_socket_orders);
+            cpu_set_t *remaining_cpus = CPU_ALLOC(cpuinfo->total_cpus);
+            int num_cpus = 0;
+            int range_ends[N_METRICS + 1] = { 0 };
+            uint64_t churn = 0;
+            struct timespec start, finish;
+            double elapsed;
+            int j = 0;
+
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+            /* as in samd, the housekeeping CPUs are held back unless they are all there is */
+            CPU_ZERO_S(sz, remaining_cpus);
+            for (int c = 0; c < cpuinfo->total_cpus; ++c) {
+                if (c >= CPU_SETSIZE || !CPU_ISSET(c, &tunables.housekeeping_cpus)) {
+                    CPU_SET_S(c, sz, remaining_cpus);
+                    num_cpus++;
+                }
+            }
+            if (num_cpus == 0) {
+                for (int c = 0; c < cpuinfo->total_cpus; ++c)
+                    CPU_SET_S(c, sz, remaining_cpus);
+                num_cpus = cpuinfo->total_cpus;
+            }
+            int initial_remaining_cpus = num_cpus;
+
+            fair_share = MAX(num_cpus / num_running, tunables.sam_min_contexts);
+            for (int i = 0; i < num_sim_apps; ++i) {
+                if (!apps[i].running)
+                    continue;
+                apps_unsorted[j] = &apps[i].info;
+                /* as in samd, the applications are numbered as they are listed */
+                apps[i].info.appno = j;
+                per_app_socket_orders[j] = calloc(cpuinfo->num_sockets, sizeof *per_app_socket_orders[j]);
+                initial_remaining_cpus -= CPU_COUNT_S(sz, apps[i].info.cpuset[0]);
+                j++;
+            }
+            initial_remaining_cpus = MIN(MAX(initial_remaining_cpus, 0), num_cpus);
+
+            snprintf(too_slow_msg, sizeof too_slow_msg,
+                     "policy %s: over %g s of CPU time for one allocation of %d applications in window %d, "
+                     "stopping (see -x)\n", policy->name, max_call_secs, num_running, window);
+            arm_call_limit(max_call_secs);
+            policy_group_apps(policy, apps_unsorted, num_running, tunables.num_counter_orders,
+                              tunables.counter_order, apps_sorted, range_ends);
+            policy->allocate(num_running, apps_sorted, range_ends, cpuinfo, sz, initial_remaining_cpus, fair_share,
+                             tunables.num_counter_orders, tunables.counter_order, per_app_socket_orders,
+                             new_cpusets, remaining_cpus);
+            arm_call_limit(0);
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &finish);
+            elapsed = timespec_to_secs(timespec_sub(finish, start));
+            sched_cpu_sum += elapsed;
+            if (elapsed > sched_cpu_max)
+                sched_cpu_max = elapsed;
+
+            /* order the writes, as samd does */
+            {
+                cpu_set_t **from = calloc(num_running, sizeof *from);
+                cpu_set_t **to = calloc(num_running, sizeof *to);
+                bool *changed = calloc(num_running, sizeof *changed);
+                struct reconfig_plan plan;
+
+                for (int k = 0; k < num_running; ++k) {
+                    from[k] = apps_sorted[k]->cpuset[0];
+                    to[k] = new_cpusets[k] ? new_cpusets[k] : from[k];
+                    changed[k] = !CPU_EQUAL_S(sz, from[k], to[k]);
+                }
+                if (reconfig_plan(&plan, num_running, from, to, changed, cpuinfo->total_cpus) == 0) {
+                    total_steps += plan.num_steps;
+                    total_rounds += plan.num_rounds;
+                    for (int r = 0; r < plan.num_rounds; ++r) {
+                        if (plan.rounds[r].overlaps) {
+                            overlap_windows++;
+                            break;
+                        }
+                    }
+                }
+                reconfig_plan_free(&plan);
+                free(from);
+                free(to);
+                free(changed);
+            }
+
+            /* apply the budgets, as samd does once the cpuset is written */
+            for (int i = 0; i < N_METRICS; ++i) {
+                for (int k = range_ends[i]; k < range_ends[i + 1]; ++k) {
+                    struct appinfo *an = apps_sorted[k];
+                    int count = new_cpusets[k] ? CPU_COUNT_S(sz, new_cpusets[k]) : 0;
+
+                    if (count > 0) {
+                        if (!CPU_EQUAL_S(sz, an->cpuset[0], new_cpusets[k])) {
+                            cpu_set_t *diff = CPU_ALLOC(cpuinfo->total_cpus);
+
+                            CPU_XOR_S(sz, diff, an->cpuset[0], new_cpusets[k]);
+                            churn += CPU_COUNT_S(sz, diff);
+                            total_writes++;
+                            CPU_FREE(diff);
+                        }
+                        if (!CPU_EQUAL_S(sz, an->cpuset[0], new_cpusets[k]) || (enum metric)i != an->curr_bottleneck) {
+                            memcpy(an->cpuset[1], an->cpuset[0], sz);
+                            memcpy(an->cpuset[0], new_cpusets[k], sz);
+                            an->prev_bottleneck = an->curr_bottleneck;
+                            an->curr_bottleneck = (enum metric)i;
+                        }
+                        an->times_allocated++;
+                        if (count == fair_share)
+                            an->curr_fair_share = count;
+                    }
+                    if (new_cpusets[k])
+                        CPU_FREE(new_cpusets[k]);
+                    free(per_app_socket_orders[k]);
+                }
+            }
+            total_churn += churn;
+
+            if (churn <= SETTLED_CHURN * cpuinfo->total_cpus) {
+                if (++quiet_windows == SETTLED_WINDOWS && settled_at < 0)
+                    settled_at = now + dt - SETTLED_WINDOWS * dt;
+            } else {
+                quiet_windows = 0;
+                settled_at = -1;
+            }
+
+            free(apps_unsorted);
+            free(apps_sorted);
+            free(new_cpusets);
+            free(per_app_socket_orders);
+            CPU_FREE(remaining_cpus);
+        }
+    }
+
+    {
+        double *relative = calloc(num_sim_apps, sizeof *relative);
+        double turnaround = 0, makespan = 0;
+        int counts[N_CLASSES] = { 0 };
+
+        for (int i = 0; i < num_sim_apps; ++i) {
+            counts[apps[i].class]++;
+            relative[i] = apps[i].windows > 0 ? apps[i].relative_sum / apps[i].windows : 0;
+            if (apps[i].done) {
+                turnaround += apps[i].finish - apps[i].arrival;
+                if (apps[i].finish > makespan)
+                    makespan = apps[i].finish;
+            }
+        }
+
+        printf("policy %s: %d applications (", policy->name, num_sim_apps);
+        for (int c = 0; c < N_CLASSES; ++c)
+            printf("%s%d %s", c > 0 ? ", " : "", counts[c], class_names[c]);
+        printf(") on %d sockets x %d CPUs (%d per core), %d ms windows\n",
+               num_sockets, cpus_per_socket, cpus_per_core, tunables.window_ms);
+        printf("  windows     %d (%.1f s virtual)\n", window, now);
+        printf("  completed   %d / %d", num_done, num_sim_apps);
+        if (num_done > 0)
+            printf(", makespan %.1f s, mean turnaround %.1f s", makespan, turnaround / num_done);
+        printf("\n  throughput  %.3g instructions/s (%.1f cores' worth)\n",
+               now > 0 ? instructions / now : 0, now > 0 ? instructions / now / CORE_IPS : 0);
+        printf("  fairness    %.3f (Jain's index of speedup relative to a fair share)\n", jain(relative, num_sim_apps));
+        printf("  churn       %.1f CPUs and %.2f cpuset writes per window, ", (double)total_churn / MAX(window, 1),
+               (double)total_writes / MAX(window, 1));
+        if (settled_at >= 0)
+            printf("settled after %.1f s\n", settled_at);
+        else
+            printf("never settled\n");
+        printf("  transitions %.2f writes in %.2f rounds per window, so that CPUs are freed before they are taken; "
+               "%d windows overlapped\n", (double)total_steps / MAX(window, 1), (double)total_rounds / MAX(window, 1),
+               overlap_windows);
+        printf("  scheduler   %.1f us mean, %.1f us max CPU time per window\n",
+               1e6 * sched_cpu_sum / MAX(window, 1), 1e6 * sched_cpu_max);
+        free(relative);
+    }
+
+    for (int i = 0; i < num_sim_apps; ++i) {
+        CPU_FREE(apps[i].info.cpuset[0]);
+        CPU_FREE(apps[i].info.cpuset[1]);
+        free(apps[i].info.perf_history);
+    }
+    free(apps);
+    free(cpu_socket);
+    free(cpu_core);
+    return 0;
+}
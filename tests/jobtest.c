@@ -13,6 +13,7 @@
 #include <fcntl.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include "../control.h"
 #include "../util.h"
 #include <pthread.h>
 #include <sys/sysinfo.h>
@@ -90,13 +91,64 @@ void handle_quit(int sig) {
     }
 }
 
+/*
+ * Read the CPUs that @jb may run on into @intlist. We ask the daemon over
+ * @conn (connecting first if needed), and fall back to the job's affinity if
+ * the daemon is not running.
+ */
+static int read_job_cpus(const struct job *jb, int *conn, int **intlist, size_t *intlist_l) {
+    pid_t pid = jb->pid;
+    struct sam_ctl_app app;
+    char cpus[SAM_CTL_MAX_MESSAGE];
+    cpu_set_t *set;
+    size_t cpus_sz = CPU_ALLOC_SIZE(nprocs);
+
+    /* sam-launch runs the application as its child */
+    if (strstr(jb->argv[0], "sam-launch") != NULL) {
+        char path[128];
+        FILE *fp;
+
+        snprintf(path, sizeof path, "/proc/%d/task/%d/children", jb->pid, jb->pid);
+        if (!(fp = fopen(path, "r")))
+            return -1;
+        if (fscanf(fp, "%d", &pid) != 1) {
+            fclose(fp);
+            errno = ESRCH;
+            return -1;
+        }
+        fclose(fp);
+    }
+
+    if (*conn < 0)
+        *conn = sam_ctl_connect();
+
+    if (*conn >= 0) {
+        if (sam_ctl_get_app(*conn, pid, &app, cpus, sizeof cpus) == 0 && cpus[0] != '\0')
+            return string_to_intlist(cpus, intlist, intlist_l);
+        if (errno != ESRCH) {
+            /* the daemon went away */
+            close(*conn);
+            *conn = -1;
+        }
+    }
+
+    if (!(set = CPU_ALLOC(nprocs)))
+        return -1;
+    if (sched_getaffinity(pid, cpus_sz, set) != 0) {
+        CPU_FREE(set);
+        return -1;
+    }
+    cpuset_to_intlist(set, nprocs, intlist, intlist_l);
+    CPU_FREE(set);
+    return 0;
+}
+
 void *monitor_cpuset_changes(void *arg) {
-    /* read procfs every second and compare change in cpusets */
+    int conn = -1;
+
+    /* poll every second and compare change in cpusets */
     while (!wants_to_quit && !stop_thread) {
         for (struct job *jb = job_list; jb && !wants_to_quit && !stop_thread; jb = jb->next) {
-            char cmd[1024];
-            char *buf;
-            FILE *pf;
             int *intlist = NULL;
             size_t intlist_l = 0;
             cpu_set_t *set = NULL;
@@ -104,32 +156,9 @@ void *monitor_cpuset_changes(void *arg) {
 
             pthread_mutex_lock(&jb->mtx);
 
-            /* hack */
-            if (strstr(jb->argv[0], "sam-launch") != NULL)
-                snprintf(cmd, sizeof cmd - 1, "cat /proc/$(cat /proc/%d/task/%d/children | awk '{print $1}')/status | grep Cpus_allowed_list | awk '{print $2}'", jb->pid, jb->pid);
-            else
-                snprintf(cmd, sizeof cmd - 1, 
-                        "cat /proc/%d/status | grep Cpus_allowed_list | awk '{print $2}'", jb->pid);
-
-            if (!(pf = popen(cmd, "r"))) {
-                fprintf(stderr, "%sWARNING: %10s: failed to read /proc/%d/status: %m%s\n", warn_color, jb->name, jb->pid, reset);
-                pthread_mutex_unlock(&jb->mtx);
-                continue;
-            }
-
-            fscanf(pf, "%ms", &buf);
-            if (!buf || string_to_intlist(buf, &intlist, &intlist_l) != 0) {
-                if (errno == 0)
-                    fprintf(stderr, "%sWARNING: %10s: expected intlist, found '%s%s%s'%s\n", 
-                            warn_color, jb->name, buf, reset, warn_color, reset);
-                else
-                    fprintf(stderr, "%sWARNING: %10s: could not read intlist: %m%s\n", 
-                            warn_color, jb->name, reset);
-            }
-            free(buf);
-            buf = NULL;
-            pclose(pf);
-            pf = NULL;
+            if (jb->pid > 0 && read_job_cpus(jb, &conn, &intlist, &intlist_l) != 0 && errno != ESRCH)
+                fprintf(stderr, "%sWARNING: %10s: could not read the CPUs of %d: %m%s\n",
+                        warn_color, jb->name, jb->pid, reset);
 
             if (!intlist) {
                 pthread_mutex_unlock(&jb->mtx);
@@ -201,6 +230,8 @@ void *monitor_cpuset_changes(void *arg) {
         }
         nanosleep(&(struct timespec) { 1, 0 }, NULL);
     }
+    if (conn >= 0)
+        close(conn);
     return NULL;
 }
 
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# measure how each phase of samd scales with the number of managed threads
+
+if (( $UID != 0 )); then
+    echo "I need to be root"
+    exit 1
+fi
+
+project_dir=..
+thread_counts=${THREAD_COUNTS:-"10000 50000 100000"}
+duration=${DURATION:-30}    # seconds that each thread count is measured
+
+trap 'echo "signal caught, exiting..."; kill $samd_pid $app_pid 2>/dev/null; exit 1' SIGTERM SIGINT
+
+# samd sizes its tables from pid_max at startup, so raise the limits first
+sysctl -q -w kernel.pid_max=4194304
+sysctl -q -w kernel.threads-max=$((4 * 1024 * 1024))
+sysctl -q -w vm.max_map_count=$((4 * 1024 * 1024))
+ulimit -u unlimited
+
+for n in $thread_counts; do
+    $project_dir/samd > samd-t$n.out &
+    samd_pid=$!
+    sleep 1
+    $project_dir/sam-launch ./threadhog $n $duration > threadhog-t$n.out &
+    app_pid=$!
+    wait $app_pid
+    sleep 2         # wait for scheduler to unmanage application
+    kill $samd_pid  # send SIGTERM for scheduler graceful termination
+    wait $samd_pid
+
+    echo "== $n threads ($(head -n1 threadhog-t$n.out)) =="
+    (cd $project_dir && ./overhead.sh) < samd-t$n.out
+done
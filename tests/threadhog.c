@@ -0,0 +1,54 @@
+/*
+ * Spawn a given number of idle threads and keep them alive for a while.
+ * Used by scale-threads.sh to measure how samd scales with thread count.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+static void *idle_thread(void *arg) {
+    for (;;)
+        pause();
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_attr_t attr;
+    int nthreads, duration;
+    int created = 0;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s NTHREADS SECONDS\n", argv[0]);
+        return 1;
+    }
+
+    nthreads = atoi(argv[1]);
+    duration = atoi(argv[2]);
+
+    /* keep each thread's footprint small so that 100k threads fit */
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN);
+
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_t thread;
+        int ret;
+
+        if ((ret = pthread_create(&thread, &attr, &idle_thread, NULL)) != 0) {
+            fprintf(stderr, "could only create %d threads: %s\n", created, strerror(ret));
+            break;
+        }
+        pthread_detach(thread);
+        created++;
+    }
+
+    printf("%d threads running for %d seconds\n", created, duration);
+    fflush(stdout);
+    sleep(duration);
+
+    return created == nthreads ? 0 : 1;
+}
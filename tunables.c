@@ -0,0 +1,222 @@
+/*
+ * The configuration file; see tunables.h.
+ */
+#define _GNU_SOURCE
+#include "tunables.h"
+#include "perfio.h"
+#include "util.h"
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct tunables tunables;
+
+static const char *metric_keys[N_METRICS] = {
+    [METRIC_ACTIVE] = "active",
+    [METRIC_AVGIPC] = "ipc",
+    [METRIC_MEM]    = "memory",
+    [METRIC_INTRA]  = "intra",
+    [METRIC_INTER]  = "inter",
+};
+
+void tunables_default(struct tunables *t, int total_cores)
+{
+    memset(t, 0, sizeof *t);
+    t->shar_mem_thresh = SHAR_MEM_THRESH;
+    t->shar_coherence_thresh = SHAR_COHERENCE_THRESH;
+    t->sam_min_contexts = SAM_MIN_CONTEXTS;
+    t->sam_perf_thresh = SAM_PERF_THRESH;
+    t->sam_disturb_prob = SAM_DISTURB_PROB;
+
+    t->thresh_pt[METRIC_ACTIVE] = 1000000;  /* cycles */
+    t->thresh_pt[METRIC_AVGIPC] = 70;       /* instructions scaled to 100 */
+    t->thresh_pt[METRIC_MEM] = t->shar_mem_thresh / total_cores;
+    t->thresh_pt[METRIC_INTRA] = t->shar_coherence_thresh;
+    t->thresh_pt[METRIC_INTER] = t->shar_coherence_thresh;
+
+    t->num_counter_orders = 0;
+    t->counter_order[t->num_counter_orders++] = METRIC_INTER;
+    t->counter_order[t->num_counter_orders++] = METRIC_INTRA;
+    t->counter_order[t->num_counter_orders++] = METRIC_MEM;
+    t->counter_order[t->num_counter_orders++] = METRIC_AVGIPC;
+
+    t->window_ms = PERFIO_WINDOW_MS;
+    t->mem_follow_windows = SAM_MEM_FOLLOW_WINDOWS;
+    t->mem_migrate_mb_per_s = SAM_MEM_MIGRATE_MB_PER_S;
+    snprintf(t->cpuset_partition, sizeof t->cpuset_partition, "member");
+}
+
+static char *trim(char *s)
+{
+    char *end;
+
+    while (isspace((unsigned char)*s))
+        s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+static int parse_long(const char *value, long min, long max, long *out)
+{
+    char *end;
+    long v;
+
+    errno = 0;
+    v = strtol(value, &end, 0);
+    if (errno != 0 || end == value || *end != '\0' || v < min || v > max)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_double(const char *value, double min, double max, double *out)
+{
+    char *end;
+    double v;
+
+    errno = 0;
+    v = strtod(value, &end);
+    if (errno != 0 || end == value || *end != '\0' || !(v >= min && v <= max))
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_metric(const char *value)
+{
+    for (int i = 0; i < N_METRICS; ++i)
+        if (strcmp(value, metric_keys[i]) == 0)
+            return i;
+    return -1;
+}
+
+static int parse_counter_order(char *value, struct tunables *t)
+{
+    bool seen[N_METRICS] = { false };
+    char *save = NULL;
+
+    t->num_counter_orders = 0;
+    for (char *tok = strtok_r(value, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int met = parse_metric(trim(tok));
+
+        if (met < 0 || seen[met])
+            return -1;
+        seen[met] = true;
+        t->counter_order[t->num_counter_orders++] = met;
+    }
+    return 0;
+}
+
+int tunables_load(struct tunables *t, const char *path, bool must_exist, int total_cores)
+{
+    struct tunables next;
+    bool thresh_set[N_METRICS] = { false };
+    FILE *fp;
+    char *line = NULL;
+    size_t sz = 0;
+    int lineno = 0;
+    int ret = 0;
+
+    tunables_default(&next, total_cores);
+
+    if (!(fp = fopen(path, "r"))) {
+        if (errno == ENOENT && !must_exist) {
+            *t = next;
+            return 0;
+        }
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (getline(&line, &sz, fp) != -1) {
+        char *key, *value, *eq;
+        long l;
+        int met;
+
+        lineno++;
+        if ((eq = strchr(line, '#')))
+            *eq = '\0';
+        key = trim(line);
+        if (!*key)
+            continue;
+        if (!(eq = strchr(key, '='))) {
+            fprintf(stderr, "%s:%d: expected 'name = value'\n", path, lineno);
+            ret = -1;
+            break;
+        }
+        *eq = '\0';
+        key = trim(key);
+        value = trim(eq + 1);
+
+        if (strcmp(key, "shar_mem_thresh") == 0)
+            ret |= parse_long(value, 0, LONG_MAX, &next.shar_mem_thresh) != 0 ? -1 : 0;
+        else if (strcmp(key, "shar_coherence_thresh") == 0)
+            ret |= parse_long(value, 0, LONG_MAX, &next.shar_coherence_thresh) != 0 ? -1 : 0;
+        else if (strcmp(key, "sam_min_contexts") == 0) {
+            if (parse_long(value, 1, INT_MAX, &l) == 0)
+                next.sam_min_contexts = l;
+            else
+                ret = -1;
+        } else if (strcmp(key, "sam_perf_thresh") == 0)
+            ret |= parse_double(value, 0, 1, &next.sam_perf_thresh) != 0 ? -1 : 0;
+        else if (strcmp(key, "sam_share_below") == 0)
+            ret |= parse_double(value, 0, 1024, &next.sam_share_below) != 0 ? -1 : 0;
+        else if (strcmp(key, "sam_disturb_prob") == 0)
+            ret |= parse_double(value, 0, 1, &next.sam_disturb_prob) != 0 ? -1 : 0;
+        else if (strncmp(key, "thresh_pt.", 10) == 0 && (met = parse_metric(key + 10)) >= 0) {
+            ret |= parse_long(value, 0, LONG_MAX, &next.thresh_pt[met]) != 0 ? -1 : 0;
+            thresh_set[met] = true;
+        } else if (strcmp(key, "counter_order") == 0)
+            ret |= parse_counter_order(value, &next);
+        else if (strcmp(key, "window_ms") == 0) {
+            if (parse_long(value, 10, 60000, &l) == 0)
+                next.window_ms = l;
+            else
+                ret = -1;
+        } else if (strcmp(key, "mem_follow_windows") == 0) {
+            if (parse_long(value, 0, INT_MAX, &l) == 0)
+                next.mem_follow_windows = l;
+            else
+                ret = -1;
+        } else if (strcmp(key, "mem_migrate_mb_per_s") == 0)
+            ret |= parse_long(value, 1, LONG_MAX / (1 << 20), &next.mem_migrate_mb_per_s) != 0 ? -1 : 0;
+        else if (strcmp(key, "housekeeping_cpus") == 0)
+            ret |= string_to_cpuset(value, &next.housekeeping_cpus, CPU_SETSIZE) < 0 ? -1 : 0;
+        else if (strcmp(key, "cpuset_partition") == 0) {
+            if (strcmp(value, "member") == 0 || strcmp(value, "root") == 0 || strcmp(value, "isolated") == 0)
+                snprintf(next.cpuset_partition, sizeof next.cpuset_partition, "%s", value);
+            else
+                ret = -1;
+        } else {
+            fprintf(stderr, "%s:%d: unknown setting '%s'\n", path, lineno, key);
+            ret = -1;
+            break;
+        }
+
+        if (ret != 0) {
+            fprintf(stderr, "%s:%d: invalid value '%s' for %s\n", path, lineno, value, key);
+            break;
+        }
+    }
+
+    free(line);
+    fclose(fp);
+    if (ret != 0)
+        return -1;
+
+    /* the per-thread thresholds follow the system-wide ones unless given */
+    if (!thresh_set[METRIC_MEM])
+        next.thresh_pt[METRIC_MEM] = next.shar_mem_thresh / total_cores;
+    if (!thresh_set[METRIC_INTRA])
+        next.thresh_pt[METRIC_INTRA] = next.shar_coherence_thresh;
+    if (!thresh_set[METRIC_INTER])
+        next.thresh_pt[METRIC_INTER] = next.shar_coherence_thresh;
+
+    *t = next;
+    return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * tunables.h
+ *
+ * The parameters that decide how applications are classified and allocated,
+ * read from a configuration file (SAM_CONFIG_FILE by default) rather than
+ * fixed at build time.
+ */
+#ifndef TUNABLES_H
+#define TUNABLES_H
+
+#include "mapper.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct tunables {
+    /* LLC misses per second, over all cores, that make memory a bottleneck */
+    long shar_mem_thresh;
+    /* snoops per second that make communication a bottleneck */
+    long shar_coherence_thresh;
+    /* the fewest CPUs an application is given */
+    int sam_min_contexts;
+    /* the change in performance, as a fraction, that hill climbing acts on */
+    double sam_perf_thresh;
+    /* the probability of a random disturbance */
+    double sam_disturb_prob;
+    /* per-thread thresholds for each bottleneck */
+    long thresh_pt[N_METRICS];
+    /* the bottlenecks to allocate for, in order of priority */
+    enum metric counter_order[N_METRICS];
+    int num_counter_orders;
+    /*
+     * Applications that use fewer CPUs than this share CPUs with quotas
+     * instead of getting sam_min_contexts of their own; 0 shares CPUs only
+     * when the applications do not fit otherwise.
+     */
+    double sam_share_below;
+    /* the length of a sampling window */
+    int window_ms;
+    /*
+     * The windows an application's CPUs must stay on the same NUMA nodes
+     * before its memory is moved there; 0 leaves memory where it is.
+     */
+    int mem_follow_windows;
+    /* the memory that may be moved between nodes per second, in MiB */
+    long mem_migrate_mb_per_s;
+    /*
+     * The CPUs left to interrupts and system daemons, which no application
+     * is given even when its parent cgroup has them.
+     */
+    cpu_set_t housekeeping_cpus;
+    /*
+     * What the sam cgroup's cpuset.cpus.partition is set to on cgroup v2:
+     * "root" or "isolated" keep every other task off the CPUs applications
+     * are given, which needs housekeeping_cpus for those tasks; "member"
+     * leaves the CPUs shared.
+     */
+    char cpuset_partition[16];
+};
+
+/**
+ * The tunables that the scheduler is using for the current window. The
+ * schedulers only read this; the scheduler thread sets it before each window.
+ */
+extern struct tunables tunables;
+
+/**
+ * Fill in @t with the built-in defaults, for a machine with @total_cores
+ * cores.
+ */
+void tunables_default(struct tunables *t, int total_cores);
+
+/**
+ * Read the configuration file at @path into @t, starting from the defaults.
+ * Unless @must_exist, a missing file just leaves the defaults.
+ *
+ * The file has one "name = value" per line, and '#' starts a comment:
+ *
+ *   shar_mem_thresh = 30000000
+ *   counter_order = inter, intra, memory, ipc
+ *   thresh_pt.memory = 2500000
+ *   housekeeping_cpus = 0,1
+ *   cpuset_partition = isolated
+ *
+ * Every value is checked before returning, so @t is only changed if the
+ * whole file is valid.
+ *
+ * Returns 0 on success, or -1 with the problem printed to stderr.
+ */
+int tunables_load(struct tunables *t, const char *path, bool must_exist, int total_cores);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* TUNABLES_H */
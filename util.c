@@ -3,6 +3,58 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+int sys_pidfd_open(pid_t pid, unsigned int flags) {
+    return syscall(SYS_pidfd_open, pid, flags);
+}
+
+pid_t pidfd_to_pid(int pidfd) {
+    char path[64];
+    char *line = NULL;
+    size_t sz = 0;
+    FILE *fp;
+    int pid = 0;
+    bool found = false;
+
+    snprintf(path, sizeof path, "/proc/self/fdinfo/%d", pidfd);
+    if (!(fp = fopen(path, "r")))
+        return -1;
+
+    while (getline(&line, &sz, fp) != -1)
+        if ((found = sscanf(line, "Pid: %d", &pid) == 1))
+            break;
+
+    free(line);
+    fclose(fp);
+
+    if (!found) {
+        errno = EBADF;
+        return -1;
+    }
+    /* -1 once the process has been reaped */
+    return pid < 0 ? 0 : pid;
+}
+
+int pidlist_push(struct pidlist *list, pid_t pid) {
+    if (list->length == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        pid_t *pids = (pid_t*) realloc(list->pids, capacity * sizeof *pids);
+
+        if (!pids)
+            return -1;
+        list->pids = pids;
+        list->capacity = capacity;
+    }
+
+    list->pids[list->length++] = pid;
+    return 0;
+}
 
 char *intlist_to_string(const int *list, 
                         size_t length,
@@ -123,3 +175,103 @@ error:
     *length_in = 0;
     return -1;
 }
+
+/* write @v in decimal at @p, returning the end */
+static char *put_uint(char *p, unsigned int v) {
+    char digits[10];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+int cpuset_to_string(const cpu_set_t *set, int num_cpus, char *buf, size_t buflen) {
+    const size_t cpus_sz = CPU_ALLOC_SIZE(num_cpus);
+    /* a range is at most two numbers of 10 digits, '-' and ',' */
+    const size_t max_range = 2 * 10 + 2;
+    char *p = buf;
+
+    for (int i = 0; i < num_cpus; ++i) {
+        int first = i;
+
+        if (!CPU_ISSET_S(i, cpus_sz, set))
+            continue;
+        while (i + 1 < num_cpus && CPU_ISSET_S(i + 1, cpus_sz, set))
+            i++;
+
+        if ((size_t)(p - buf) + max_range + 1 > buflen) {
+            if (buflen > 0)
+                buf[0] = '\0';
+            errno = ENOSPC;
+            return -1;
+        }
+        if (p != buf)
+            *p++ = ',';
+        p = put_uint(p, first);
+        if (i > first) {
+            *p++ = '-';
+            p = put_uint(p, i);
+        }
+    }
+
+    if (buflen > 0)
+        *p = '\0';
+    return p - buf;
+}
+
+/* read a decimal number at *@pp into @v, advancing *@pp past it */
+static int get_uint(const char **pp, unsigned int *v) {
+    const char *p = *pp;
+    unsigned long n = 0;
+
+    if (*p < '0' || *p > '9')
+        return -1;
+    while (*p >= '0' && *p <= '9') {
+        n = n * 10 + (*p++ - '0');
+        if (n > 0xffffffffUL)
+            return -1;
+    }
+    *v = n;
+    *pp = p;
+    return 0;
+}
+
+int string_to_cpuset(const char *str, cpu_set_t *set, int num_cpus) {
+    const size_t cpus_sz = CPU_ALLOC_SIZE(num_cpus);
+    const char *p = str;
+    int count = 0;
+
+    CPU_ZERO_S(cpus_sz, set);
+    while (*p && *p != '\n') {
+        unsigned int first, last;
+
+        if (get_uint(&p, &first) != 0)
+            goto invalid;
+        last = first;
+        if (*p == '-') {
+            p++;
+            if (get_uint(&p, &last) != 0 || last < first)
+                goto invalid;
+        }
+        for (unsigned int c = first; c <= last && c < (unsigned int)num_cpus; ++c) {
+            if (!CPU_ISSET_S(c, cpus_sz, set)) {
+                CPU_SET_S(c, cpus_sz, set);
+                count++;
+            }
+        }
+        if (*p == ',')
+            p++;
+        else if (*p && *p != '\n')
+            goto invalid;
+    }
+    return count;
+
+invalid:
+    errno = EINVAL;
+    return -1;
+}
@@ -6,6 +6,9 @@
 #define _GNU_SOURCE
 #endif
 #include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <time.h>
 
 #define MAX(a,b)    ((a) > (b) ? (a) : (b))
@@ -16,6 +19,61 @@
 extern "C" {
 #endif
 
+/**
+ * A growable list of PIDs. The storage is kept between uses, so a list that
+ * is cleared and refilled every iteration only allocates when it grows.
+ */
+struct pidlist {
+    pid_t *pids;
+    size_t length;
+    size_t capacity;
+};
+
+/**
+ * Append @pid to @list, growing it if necessary.
+ *
+ * Returns 0 on success, or -1 (with errno set) if the list could not grow.
+ */
+int pidlist_push(struct pidlist *list, pid_t pid);
+
+static inline void pidlist_clear(struct pidlist *list) {
+    list->length = 0;
+}
+
+/**
+ * Remove @pid from @list, if it is there. The order of the other PIDs is not
+ * kept.
+ *
+ * Returns whether @pid was found.
+ */
+static inline bool pidlist_remove(struct pidlist *list, pid_t pid) {
+    for (size_t i = 0; i < list->length; ++i) {
+        if (list->pids[i] == pid) {
+            list->pids[i] = list->pids[--list->length];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Obtain a file descriptor that refers to process @pid. It becomes readable
+ * once the process has exited, and it keeps referring to that process even
+ * if @pid is later reused.
+ *
+ * Returns the pidfd, or -1 (with errno set) on failure, e.g. ENOSYS on
+ * kernels older than 5.3.
+ */
+int sys_pidfd_open(pid_t pid, unsigned int flags);
+
+/**
+ * The PID of the process that @pidfd refers to, from /proc/self/fdinfo.
+ *
+ * Returns the PID, 0 if the process has exited and been reaped, or -1 (with
+ * errno set) if @pidfd is not a pidfd.
+ */
+pid_t pidfd_to_pid(int pidfd);
+
 char *intlist_to_string(const int *list, 
                         size_t length,
                         char *buf,
@@ -35,6 +93,25 @@ void intlist_to_cpuset(const int *list,
 int string_to_intlist(const char *str, 
                       int **value_in, size_t *length_in);
 
+/**
+ * Write the CPUs of @set, of @num_cpus, to @buf as a cpuset list in ranges,
+ * as the kernel prints them ("0-19,40-59"), NUL-terminated. An empty set is
+ * the empty string.
+ *
+ * Returns the length of the list, or -1 (with errno set to ENOSPC) if it
+ * does not fit in @buflen.
+ */
+int cpuset_to_string(const cpu_set_t *set, int num_cpus, char *buf, size_t buflen);
+
+/**
+ * Parse the cpuset list @str, such as "0-3,8,10-11\n", into @set, of
+ * @num_cpus, which it clears first. CPUs of @num_cpus or more are ignored.
+ *
+ * Returns the number of CPUs in @set, or -1 (with errno set to EINVAL) if
+ * @str is not a list.
+ */
+int string_to_cpuset(const char *str, cpu_set_t *set, int num_cpus);
+
 static inline struct timespec timespec_sub(struct timespec ts1, struct timespec ts2) {
     struct timespec diff = {
         .tv_sec = ts1.tv_sec - ts2.tv_sec,
@@ -42,7 +119,7 @@ static inline struct timespec timespec_sub(struct timespec ts1, struct timespec
     };
     if (ts1.tv_nsec < ts2.tv_nsec) {
         diff.tv_sec -= 1;
-        diff.tv_nsec = 1000000000 - diff.tv_nsec;
+        diff.tv_nsec += 1000000000;
     }
     return diff;
 }
@@ -59,6 +136,11 @@ static inline double timespec_to_secs(struct timespec ts)
     return ts.tv_sec + (double) ts.tv_nsec / 1e+9;
 }
 
+static inline uint64_t timespec_to_ns(struct timespec ts)
+{
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 #if defined(__cplusplus)
 };
 #endif
@@ -0,0 +1,297 @@
+/*
+ * Thread communication graphs from the wakeup tracer (bpf/samwake.bpf.c),
+ * and their partitioning into clusters that fit a topology domain.
+ */
+#define _GNU_SOURCE
+#include "wakegraph.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_BPF
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <linux/types.h>
+
+#include "bpf/samwake.h"
+#include "samwake.skel.h"
+
+static struct samwake_bpf *skel;
+static struct samwake_edge_key *keys;
+static size_t keys_capacity;
+
+int wakegraph_init(void)
+{
+    int err;
+
+    if (!(skel = samwake_bpf__open_and_load()))
+        return -1;
+
+    if ((err = samwake_bpf__attach(skel)) != 0) {
+        wakegraph_exit();
+        errno = -err;
+        return -1;
+    }
+
+    return 0;
+}
+
+int wakegraph_track(pid_t tid, pid_t app_pid)
+{
+    __u32 key = tid;
+    struct samwake_task value = { .app = app_pid };
+
+    return bpf_map_update_elem(bpf_map__fd(skel->maps.tasks), &key, &value, BPF_ANY);
+}
+
+int wakegraph_untrack(pid_t tid)
+{
+    __u32 key = tid;
+
+    if (bpf_map_delete_elem(bpf_map__fd(skel->maps.tasks), &key) != 0 && errno != ENOENT)
+        return -1;
+    return 0;
+}
+
+static int compare_edges(const void *a_ptr, const void *b_ptr)
+{
+    const struct wake_edge *a = a_ptr;
+    const struct wake_edge *b = b_ptr;
+
+    if (a->app_pid != b->app_pid)
+        return a->app_pid < b->app_pid ? -1 : 1;
+    if (a->weight != b->weight)
+        return a->weight > b->weight ? -1 : 1;
+    return 0;
+}
+
+int wakegraph_read(struct wakegraph *g)
+{
+    int fd = bpf_map__fd(skel->maps.edges);
+    struct samwake_edge_key *prev;
+    size_t num_keys = 0;
+
+    g->num_edges = 0;
+
+    /* collect the keys first, since deleting entries upsets the iteration */
+    for (;;) {
+        if (num_keys == keys_capacity) {
+            size_t capacity = keys_capacity ? keys_capacity * 2 : 1024;
+            struct samwake_edge_key *grown = realloc(keys, capacity * sizeof *keys);
+
+            if (!grown)
+                return -1;
+            keys = grown;
+            keys_capacity = capacity;
+        }
+        /* the previous key is taken after growing, which may have moved the array */
+        prev = num_keys > 0 ? &keys[num_keys - 1] : NULL;
+        if (bpf_map_get_next_key(fd, prev, &keys[num_keys]) != 0)
+            break;
+        num_keys++;
+    }
+    if (errno != ENOENT)
+        return -1;
+
+    if (num_keys > g->capacity) {
+        struct wake_edge *grown = realloc(g->edges, num_keys * sizeof *g->edges);
+
+        if (!grown)
+            return -1;
+        g->edges = grown;
+        g->capacity = num_keys;
+    }
+
+    for (size_t i = 0; i < num_keys; ++i) {
+        struct samwake_edge value;
+        struct wake_edge *e = &g->edges[g->num_edges];
+
+        if (bpf_map_lookup_and_delete_elem(fd, &keys[i], &value) != 0)
+            continue;
+
+        e->app_pid = keys[i].app;
+        e->waker = keys[i].waker;
+        e->wakee = keys[i].wakee;
+        e->weight = value.wakeups + (WAKEGRAPH_FUTEX_WEIGHT - 1) * value.futex_wakeups;
+        g->num_edges++;
+    }
+
+    qsort(g->edges, g->num_edges, sizeof *g->edges, &compare_edges);
+    return 0;
+}
+
+void wakegraph_exit(void)
+{
+    samwake_bpf__destroy(skel);
+    skel = NULL;
+
+    free(keys);
+    keys = NULL;
+    keys_capacity = 0;
+}
+
+#else   /* !HAVE_BPF */
+
+int wakegraph_init(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int wakegraph_track(pid_t tid, pid_t app_pid)
+{
+    (void) tid;
+    (void) app_pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+int wakegraph_untrack(pid_t tid)
+{
+    (void) tid;
+    errno = ENOSYS;
+    return -1;
+}
+
+int wakegraph_read(struct wakegraph *g)
+{
+    g->num_edges = 0;
+    errno = ENOSYS;
+    return -1;
+}
+
+void wakegraph_exit(void)
+{
+}
+
+#endif  /* HAVE_BPF */
+
+struct tid_index {
+    pid_t tid;
+    int index;
+};
+
+static int compare_tid_index(const void *a_ptr, const void *b_ptr)
+{
+    const struct tid_index *a = a_ptr;
+    const struct tid_index *b = b_ptr;
+
+    return (a->tid > b->tid) - (a->tid < b->tid);
+}
+
+static int lookup_tid(const struct tid_index *index, size_t n, pid_t tid)
+{
+    struct tid_index key = { .tid = tid };
+    const struct tid_index *found = bsearch(&key, index, n, sizeof *index, &compare_tid_index);
+
+    return found ? found->index : -1;
+}
+
+static int compare_group_size_desc(const void *a_ptr, const void *b_ptr, void *arg)
+{
+    const int *size = arg;
+    int a = size[*(const int *)a_ptr];
+    int b = size[*(const int *)b_ptr];
+
+    return (a < b) - (a > b);
+}
+
+static int find_root(int *parent, int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+int wakegraph_partition(const struct wake_edge *edges,
+                        size_t num_edges,
+                        const pid_t *tids,
+                        size_t num_tids,
+                        int cluster_size,
+                        int *cluster_of)
+{
+    struct tid_index *index = NULL;
+    int *parent = NULL, *size = NULL, *groups = NULL, *space = NULL;
+    int num_groups = 0, num_clusters = 0;
+
+    if (cluster_size < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (num_tids == 0)
+        return 0;
+
+    index = malloc(num_tids * sizeof *index);
+    parent = malloc(num_tids * sizeof *parent);
+    size = malloc(num_tids * sizeof *size);
+    groups = malloc(num_tids * sizeof *groups);
+    space = malloc(num_tids * sizeof *space);
+    if (!index || !parent || !size || !groups || !space) {
+        num_clusters = -1;
+        goto out;
+    }
+
+    for (size_t i = 0; i < num_tids; ++i) {
+        index[i].tid = tids[i];
+        index[i].index = i;
+        parent[i] = i;
+        size[i] = 1;
+    }
+    qsort(index, num_tids, sizeof *index, &compare_tid_index);
+
+    /* merge along the heaviest edges while the clusters fit */
+    for (size_t e = 0; e < num_edges; ++e) {
+        int a = lookup_tid(index, num_tids, edges[e].waker);
+        int b = lookup_tid(index, num_tids, edges[e].wakee);
+
+        if (a < 0 || b < 0)
+            continue;
+        if ((a = find_root(parent, a)) == (b = find_root(parent, b)))
+            continue;
+        if (size[a] + size[b] > cluster_size)
+            continue;
+
+        if (size[a] < size[b]) {
+            int t = a;
+            a = b;
+            b = t;
+        }
+        parent[b] = a;
+        size[a] += size[b];
+    }
+
+    /* pack the groups into clusters, largest first (first fit decreasing) */
+    for (size_t i = 0; i < num_tids; ++i)
+        if (parent[i] == (int)i)
+            groups[num_groups++] = i;
+
+    qsort_r(groups, num_groups, sizeof *groups, &compare_group_size_desc, size);
+
+    for (int i = 0, first_open = 0; i < num_groups; ++i) {
+        int g = groups[i], c;
+
+        while (first_open < num_clusters && space[first_open] == 0)
+            ++first_open;
+        for (c = first_open; c < num_clusters && space[c] < size[g]; ++c)
+            ;
+        if (c == num_clusters)
+            space[num_clusters++] = cluster_size;
+        space[c] -= size[g];
+        /* a root's size is no longer needed, so remember its cluster there */
+        size[g] = c;
+    }
+
+    for (size_t i = 0; i < num_tids; ++i)
+        cluster_of[i] = size[find_root(parent, i)];
+
+out:
+    free(index);
+    free(parent);
+    free(size);
+    free(groups);
+    free(space);
+    return num_clusters;
+}
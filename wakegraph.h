@@ -0,0 +1,98 @@
+#ifndef WAKEGRAPH_H
+#define WAKEGRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * An edge of an application's thread communication graph: @waker woke up
+ * @wakee, with the given weight, over the last window.
+ */
+struct wake_edge {
+    pid_t app_pid;
+    pid_t waker;
+    pid_t wakee;
+    uint64_t weight;
+};
+
+/**
+ * The edges of all traced applications, as read by wakegraph_read().
+ */
+struct wakegraph {
+    struct wake_edge *edges;
+    size_t num_edges;
+    size_t capacity;
+};
+
+/**
+ * How much more a futex wake counts than any other wakeup. Futex wakes are
+ * the handoffs of locks, condition variables and barriers, which usually
+ * means the two threads touch the same data.
+ */
+#define WAKEGRAPH_FUTEX_WEIGHT  4
+
+/**
+ * Load the wakeup tracer.
+ *
+ * Returns 0 on success, or -1 with errno set. errno is ENOSYS if this
+ * program was built without BPF support (make BPF=1).
+ */
+int wakegraph_init(void);
+
+/**
+ * Trace wakeups between thread @tid, and any thread it creates from now on,
+ * and the other threads of application @app_pid.
+ */
+int wakegraph_track(pid_t tid, pid_t app_pid);
+
+/**
+ * Stop tracing thread @tid.
+ */
+int wakegraph_untrack(pid_t tid);
+
+/**
+ * Replace the edges in @g with those traced since the last call, and reset
+ * them in the tracer.
+ *
+ * The edges are sorted by application and, within an application, from
+ * heaviest to lightest, ready for wakegraph_partition().
+ */
+int wakegraph_read(struct wakegraph *g);
+
+/**
+ * Unload the wakeup tracer.
+ */
+void wakegraph_exit(void);
+
+/**
+ * Partition the threads @tids of one application into clusters of at most
+ * @cluster_size threads, keeping the threads that wake each other most in
+ * the same cluster.
+ *
+ * @edges are that application's edges, from heaviest to lightest. Edges
+ * with a thread that is not in @tids are ignored.
+ *
+ * Threads are merged greedily along the heaviest edges for as long as the
+ * merged cluster fits, and the resulting groups are then packed into as few
+ * clusters as will fit them, largest first. On return, @cluster_of[i] is the
+ * cluster of @tids[i], numbered from 0.
+ *
+ * Returns the number of clusters, or -1 with errno set.
+ */
+int wakegraph_partition(const struct wake_edge *edges,
+                        size_t num_edges,
+                        const pid_t *tids,
+                        size_t num_tids,
+                        int cluster_size,
+                        int *cluster_of);
+
+#if defined(__cplusplus)
+};
+#endif
+
+#endif  /* WAKEGRAPH_H */